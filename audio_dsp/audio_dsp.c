@@ -0,0 +1,479 @@
+#include "audio_dsp.h"
+#include <hot_path.h>
+#include <math.h>
+#include <string.h>
+
+#define AUDIO_DSP_BIQUAD_FRAC_BITS 12
+#define AUDIO_DSP_PI 3.14159265f
+
+#define AUDIO_DSP_AGC_GAIN_FRAC_BITS 12
+#define AUDIO_DSP_AGC_RAMP_FRAC_BITS 8 // Extra bits for gain ramp, so that slow ramps don't round to zero step
+#define AUDIO_DSP_AGC_OUTPUT_SHIFT (31 - 15 - AUDIO_DSP_AGC_GAIN_FRAC_BITS) // int16 times Q12 to Q31
+#define AUDIO_DSP_AGC_COEFF_ONE 0x8000
+#define AUDIO_DSP_AGC_ATTACK_MS 10
+#define AUDIO_DSP_AGC_RELEASE_MS 2000
+#define AUDIO_DSP_AGC_TARGET 16384 // Peak envelope target, -6 dBFS
+#define AUDIO_DSP_AGC_GAIN_MIN (AUDIO_DSP_AGC_GAIN_UNITY / 4) // -12 dB
+#define AUDIO_DSP_AGC_GAIN_MAX (AUDIO_DSP_AGC_GAIN_UNITY * 4) // +12 dB
+#define AUDIO_DSP_AGC_SILENCE 64 // Block peak below that doesn't move the envelope
+#define AUDIO_DSP_LIMITER_KNEE 20675 // -4 dBFS
+#define AUDIO_DSP_LIMITER_CEILING 32112 // -0.18 dBFS
+#define AUDIO_DSP_LIMITER_KNEE_WIDTH (2 * (AUDIO_DSP_LIMITER_CEILING - AUDIO_DSP_LIMITER_KNEE))
+#define AUDIO_DSP_LIMITER_RECOVERY_STEP (AUDIO_DSP_AGC_GAIN_UNITY / 16) // Max gain rise per sub-block
+
+#define AUDIO_DSP_RESAMPLE_POSITION_PREVIOUS 0xFFFF0000 // Between last frame of the previous block and first one of this
+
+/* 16.16 interpolation between two samples, same rounding as btstack_resample */
+static inline int16_t audio_dsp_lerp(int32_t s1, int32_t s2, uint32_t t)
+{
+    return (int16_t)((s1 * (int32_t)(0x10000 - t) + s2 * (int32_t)t) >> 16);
+}
+
+#if (defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP) || defined(AUDIO_DSP_EMULATE_PACKED)
+
+typedef uint32_t __attribute__((may_alias)) audio_dsp_frame_t;
+
+#if defined(AUDIO_DSP_EMULATE_PACKED)
+
+/* Bit-exact C models of the instructions below, so that host tests can check packed kernels against portable ones */
+static inline int32_t audio_dsp_smulwb(int32_t a, uint32_t b)
+{
+    return (int32_t)(((int64_t)a * (int16_t)(b & 0xFFFF)) >> 16);
+}
+
+static inline int32_t audio_dsp_smulwt(int32_t a, uint32_t b)
+{
+    return (int32_t)(((int64_t)a * (int16_t)(b >> 16)) >> 16);
+}
+
+static inline uint32_t audio_dsp_pkhbt(int32_t a, int32_t b)
+{
+    return ((uint32_t)a & 0xFFFF) | ((uint32_t)b << 16);
+}
+
+static inline uint32_t audio_dsp_pkhtb(uint32_t a, uint32_t b)
+{
+    return (a & 0xFFFF0000) | (b >> 16);
+}
+
+static inline int32_t audio_dsp_smlsd(uint32_t a, uint32_t b, int32_t acc)
+{
+    const int64_t result = (int64_t)(int16_t)(a & 0xFFFF) * (int16_t)(b & 0xFFFF) - (int64_t)(int16_t)(a >> 16) * (int16_t)(b >> 16) + acc;
+    return (int32_t)(uint32_t)result;
+}
+
+#else
+
+/* (a * b[15:0]) >> 16 */
+static inline int32_t audio_dsp_smulwb(int32_t a, uint32_t b)
+{
+    int32_t result;
+    __asm__ ("smulwb %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+}
+
+/* (a * b[31:16]) >> 16 */
+static inline int32_t audio_dsp_smulwt(int32_t a, uint32_t b)
+{
+    int32_t result;
+    __asm__ ("smulwt %0, %1, %2" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+}
+
+/* Low half from a, high half from b */
+static inline uint32_t audio_dsp_pkhbt(int32_t a, int32_t b)
+{
+    uint32_t result;
+    __asm__ ("pkhbt %0, %1, %2, lsl #16" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+}
+
+/* High half from a, low half from high half of b */
+static inline uint32_t audio_dsp_pkhtb(uint32_t a, uint32_t b)
+{
+    uint32_t result;
+    __asm__ ("pkhtb %0, %1, %2, asr #16" : "=r" (result) : "r" (a), "r" (b));
+    return result;
+}
+
+/* a[15:0] * b[15:0] - a[31:16] * b[31:16] + acc, exact as long as the result fits */
+static inline int32_t audio_dsp_smlsd(uint32_t a, uint32_t b, int32_t acc)
+{
+    int32_t result;
+    __asm__ ("smlsd %0, %1, %2, %3" : "=r" (result) : "r" (a), "r" (b), "r" (acc));
+    return result;
+}
+
+#endif
+
+static inline uint32_t audio_dsp_scale_frame(uint32_t frame, int32_t gain)
+{
+    /* Gain doubled, so that >> 16 of SMULW equals >> 15 of Q15 product */
+    const int32_t gain_q16 = gain * 2;
+    return audio_dsp_pkhbt(audio_dsp_smulwb(gain_q16, frame), audio_dsp_smulwt(gain_q16, frame));
+}
+
+void HOT_PATH_FUNC(audio_dsp_gain_stereo)(int16_t *buffer, size_t frames_count, int32_t gain)
+{
+    audio_dsp_frame_t *frames = (audio_dsp_frame_t *)buffer;
+    for (size_t i = 0; i < frames_count; ++i) {
+        frames[i] = audio_dsp_scale_frame(frames[i], gain);
+    }
+}
+
+void HOT_PATH_FUNC(audio_dsp_ramp_stereo)(int16_t *buffer, size_t frames_count, int32_t gain_start, int32_t gain_step)
+{
+    audio_dsp_frame_t *frames = (audio_dsp_frame_t *)buffer;
+    int32_t gain = gain_start;
+    for (size_t i = 0; i < frames_count; ++i) {
+        frames[i] = audio_dsp_scale_frame(frames[i], gain);
+        gain += gain_step;
+    }
+}
+
+static inline uint32_t audio_dsp_lerp_frame(uint32_t a, uint32_t b, uint32_t t)
+{
+    /* s1 * (0x10000 - t) + s2 * t is (s1 + s2) * 0x8000 + (s2 - s1) * (t - 0x8000) - both weights fit int16 that way,
+     * so that SMLSD does each channel in one instruction. Sum fits int32, same as in the portable one. */
+    const uint32_t weight = ((t - 0x8000) & 0xFFFF) * 0x10001;
+    const int32_t left = audio_dsp_smlsd(audio_dsp_pkhbt((int32_t)b, (int32_t)a), weight, ((int16_t)a + (int16_t)b) * 0x8000);
+    const int32_t right = audio_dsp_smlsd(audio_dsp_pkhtb(a, b), weight, ((int16_t)(a >> 16) + (int16_t)(b >> 16)) * 0x8000);
+    return audio_dsp_pkhbt(left >> 16, right >> 16);
+}
+
+static inline void audio_dsp_lerp_frames(const int16_t *a, const int16_t *b, uint32_t t, uint32_t channels, int16_t *output)
+{
+    if (channels == AUDIO_DSP_CHANNELS) {
+        *(audio_dsp_frame_t *)output = audio_dsp_lerp_frame(*(const audio_dsp_frame_t *)a, *(const audio_dsp_frame_t *)b, t);
+        return;
+    }
+    output[0] = audio_dsp_lerp(a[0], b[0], t);
+}
+
+#else
+
+void HOT_PATH_FUNC(audio_dsp_gain_stereo)(int16_t *buffer, size_t frames_count, int32_t gain)
+{
+    for (size_t i = 0; i < frames_count; ++i) {
+        buffer[2 * i] = (buffer[2 * i] * gain) >> 15;
+        buffer[2 * i + 1] = (buffer[2 * i + 1] * gain) >> 15;
+    }
+}
+
+void HOT_PATH_FUNC(audio_dsp_ramp_stereo)(int16_t *buffer, size_t frames_count, int32_t gain_start, int32_t gain_step)
+{
+    int32_t gain = gain_start;
+    for (size_t i = 0; i < frames_count; ++i) {
+        buffer[2 * i] = (buffer[2 * i] * gain) >> 15;
+        buffer[2 * i + 1] = (buffer[2 * i + 1] * gain) >> 15;
+        gain += gain_step;
+    }
+}
+
+static inline void audio_dsp_lerp_frames(const int16_t *a, const int16_t *b, uint32_t t, uint32_t channels, int16_t *output)
+{
+    for (uint32_t c = 0; c < channels; ++c) {
+        output[c] = audio_dsp_lerp(a[c], b[c], t);
+    }
+}
+
+#endif
+
+void audio_dsp_resample_init(audio_dsp_resample_t *resample, uint8_t num_channels)
+{
+    resample->position = 0;
+    resample->factor = AUDIO_DSP_RESAMPLE_FACTOR_UNITY;
+    memset(resample->last_frame, 0, sizeof(resample->last_frame));
+    resample->num_channels = (num_channels < AUDIO_DSP_CHANNELS) ? num_channels : AUDIO_DSP_CHANNELS;
+}
+
+void audio_dsp_resample_set_factor(audio_dsp_resample_t *resample, uint32_t factor)
+{
+    resample->factor = factor;
+}
+
+uint32_t HOT_PATH_FUNC(audio_dsp_resample_block)(audio_dsp_resample_t *resample, const int16_t *input, uint32_t frames_count, int16_t *output)
+{
+    if (frames_count == 0) {
+        return 0;
+    }
+
+    const uint32_t channels = resample->num_channels;
+    uint32_t output_frames = 0;
+    while (resample->position >= AUDIO_DSP_RESAMPLE_POSITION_PREVIOUS) {
+        audio_dsp_lerp_frames(resample->last_frame, input, resample->position & 0xFFFF, channels, &output[output_frames * channels]);
+        output_frames++;
+        resample->position += resample->factor;
+    }
+
+    while ((resample->position >> 16) < (frames_count - 1)) {
+        const int16_t *frame = &input[(resample->position >> 16) * channels];
+        audio_dsp_lerp_frames(frame, &frame[channels], resample->position & 0xFFFF, channels, &output[output_frames * channels]);
+        output_frames++;
+        resample->position += resample->factor;
+    }
+
+    memcpy(resample->last_frame, &input[(frames_count - 1) * channels], channels * sizeof(int16_t));
+    resample->position -= frames_count << 16;
+    return output_frames;
+}
+
+void HOT_PATH_FUNC(audio_dsp_fade_stereo)(int16_t *buffer, size_t frames_count, bool fade_in)
+{
+    const int32_t step = AUDIO_DSP_GAIN_UNITY / (int32_t)frames_count;
+    if (fade_in) {
+        audio_dsp_ramp_stereo(buffer, frames_count, 0, step);
+    }
+    else {
+        audio_dsp_ramp_stereo(buffer, frames_count, AUDIO_DSP_GAIN_UNITY, -step);
+    }
+}
+
+void HOT_PATH_FUNC(audio_dsp_gain_stereo_32)(const int16_t *input, int32_t *output, size_t frames_count, int32_t gain)
+{
+    /* Q15 product doubled is Q31, nothing is dropped. Plain multiply on both cores, SMULW* would drop the low half.
+     * Doubled by multiplying - left shift of a negative product is undefined, compilers emit the same shift. */
+    for (size_t i = 0; i < AUDIO_DSP_CHANNELS * frames_count; ++i) {
+        output[i] = (input[i] * gain) * 2;
+    }
+}
+
+static int32_t audio_dsp_agc_coeff(float block_ms, float time_constant_ms)
+{
+    return (int32_t)lroundf((1.0f - expf(-block_ms / time_constant_ms)) * AUDIO_DSP_AGC_COEFF_ONE);
+}
+
+void audio_dsp_agc_init(audio_dsp_agc_t *agc, uint32_t sample_rate, size_t block_frames)
+{
+    /* Float math only here, coefficients are per block since envelope is updated once per block */
+    const float block_ms = (1000.0f * block_frames) / sample_rate;
+    agc->attack_coeff = audio_dsp_agc_coeff(block_ms, AUDIO_DSP_AGC_ATTACK_MS);
+    agc->release_coeff = audio_dsp_agc_coeff(block_ms, AUDIO_DSP_AGC_RELEASE_MS);
+
+    audio_dsp_agc_reset(agc);
+}
+
+void audio_dsp_agc_reset(audio_dsp_agc_t *agc)
+{
+    agc->envelope = AUDIO_DSP_AGC_TARGET;
+    agc->gain = AUDIO_DSP_AGC_GAIN_UNITY;
+    agc->level_gain = 0; // Ramps up from silence
+    agc->applied_gain = 0;
+    agc->delay_peak = 0;
+    memset(agc->delay, 0, sizeof(agc->delay));
+}
+
+static inline int32_t audio_dsp_block_peak(const int16_t *buffer, size_t samples_count)
+{
+    int32_t max = 0;
+    int32_t min = 0;
+    for (size_t i = 0; i < samples_count; ++i) {
+        const int32_t x = buffer[i];
+        max = (x > max) ? x : max;
+        min = (x < min) ? x : min;
+    }
+    return (max > -min) ? max : -min;
+}
+
+/* Soft knee - unity below the knee, quadratic curve above it that meets the ceiling with zero slope */
+static inline int32_t audio_dsp_limiter_curve(int32_t level)
+{
+    if (level <= AUDIO_DSP_LIMITER_KNEE) {
+        return level;
+    }
+    if (level >= (AUDIO_DSP_LIMITER_KNEE + AUDIO_DSP_LIMITER_KNEE_WIDTH)) {
+        return AUDIO_DSP_LIMITER_CEILING;
+    }
+
+    const int32_t over = level - AUDIO_DSP_LIMITER_KNEE;
+    return level - (over * over) / (2 * AUDIO_DSP_LIMITER_KNEE_WIDTH);
+}
+
+/* Envelope of the source level, fast attack and slow release. Held in silence and pauses,
+ * so that the noise floor isn't pumped up and the next track starts at the same gain */
+static void audio_dsp_agc_track(audio_dsp_agc_t *agc, int32_t peak)
+{
+    if (peak < AUDIO_DSP_AGC_SILENCE) {
+        return;
+    }
+
+    const int32_t coeff = (peak > agc->envelope) ? agc->attack_coeff : agc->release_coeff;
+    agc->envelope += ((peak - agc->envelope) * coeff) >> 15;
+
+    const int32_t gain = (AUDIO_DSP_AGC_TARGET << AUDIO_DSP_AGC_GAIN_FRAC_BITS) / agc->envelope;
+    agc->gain = (gain > AUDIO_DSP_AGC_GAIN_MAX) ? AUDIO_DSP_AGC_GAIN_MAX : ((gain < AUDIO_DSP_AGC_GAIN_MIN) ? AUDIO_DSP_AGC_GAIN_MIN : gain);
+}
+
+/* Gain to reach by the end of the sub-block going out now. It has to hold for that sub-block and for the next
+ * one (peak), which starts at this gain - so the ramp down happens ahead of the peak, not at its first sample. */
+static int32_t HOT_PATH_FUNC(audio_dsp_agc_limit)(audio_dsp_agc_t *agc, int32_t level_gain, int32_t peak)
+{
+    const int32_t max_peak = (peak > agc->delay_peak) ? peak : agc->delay_peak;
+    int32_t target = level_gain;
+    if (max_peak > 0) {
+        const int32_t level = (max_peak * target) >> AUDIO_DSP_AGC_GAIN_FRAC_BITS;
+        if (level > AUDIO_DSP_LIMITER_KNEE) {
+            target = (target * audio_dsp_limiter_curve(level)) / level;
+        }
+
+        /* Hard bound for rounding */
+        const int32_t gain_bound = (AUDIO_DSP_LIMITER_CEILING << AUDIO_DSP_AGC_GAIN_FRAC_BITS) / max_peak;
+        target = (target > gain_bound) ? gain_bound : target;
+    }
+
+    /* Down as fast as the next peak needs, back up gradually */
+    const int32_t recovered = agc->applied_gain + AUDIO_DSP_LIMITER_RECOVERY_STEP;
+    return (target > recovered) ? recovered : target;
+}
+
+/* AGC gain with volume for the end of sub-block index out of count, ramping across the block */
+static inline int32_t audio_dsp_agc_level(int32_t level_start, int32_t level_end, size_t index, size_t count)
+{
+    return level_start + ((level_end - level_start) * (int32_t)(index + 1)) / (int32_t)count;
+}
+
+void HOT_PATH_FUNC(audio_dsp_agc_process)(audio_dsp_agc_t *agc, int16_t *buffer, size_t frames_count, int32_t volume)
+{
+    const size_t sub_blocks = frames_count / AUDIO_DSP_AGC_LOOKAHEAD_FRAMES;
+    const int32_t level_start = agc->level_gain;
+    const int32_t level_end = (agc->gain * volume) >> 15;
+    int32_t block_peak = 0;
+
+    for (size_t b = 0; b < sub_blocks; ++b) {
+        int16_t *samples = &buffer[b * AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS];
+        const int32_t peak = audio_dsp_block_peak(samples, AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS);
+        const int32_t target = audio_dsp_agc_limit(agc, audio_dsp_agc_level(level_start, level_end, b, sub_blocks), peak);
+
+        /* Delayed sub-block goes out in place of this one, which waits for the next. Ramp from previous
+         * sub-block gain, both ends are within the bound, so is every gain in between. */
+        int32_t ramp = agc->applied_gain * (1 << AUDIO_DSP_AGC_RAMP_FRAC_BITS);
+        const int32_t step = ((target - agc->applied_gain) * (1 << AUDIO_DSP_AGC_RAMP_FRAC_BITS)) / AUDIO_DSP_AGC_LOOKAHEAD_FRAMES;
+        for (size_t i = 0; i < AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS; i += AUDIO_DSP_CHANNELS) {
+            const int32_t g = ramp >> AUDIO_DSP_AGC_RAMP_FRAC_BITS;
+            const int16_t left = samples[i];
+            const int16_t right = samples[i + 1];
+            samples[i] = (agc->delay[i] * g) >> AUDIO_DSP_AGC_GAIN_FRAC_BITS;
+            samples[i + 1] = (agc->delay[i + 1] * g) >> AUDIO_DSP_AGC_GAIN_FRAC_BITS;
+            agc->delay[i] = left;
+            agc->delay[i + 1] = right;
+            ramp += step;
+        }
+
+        agc->applied_gain = target;
+        agc->delay_peak = peak;
+        block_peak = (peak > block_peak) ? peak : block_peak;
+    }
+
+    agc->level_gain = level_end;
+    audio_dsp_agc_track(agc, block_peak);
+}
+
+void HOT_PATH_FUNC(audio_dsp_agc_process_32)(audio_dsp_agc_t *agc, const int16_t *input, int32_t *output, size_t frames_count, int32_t volume)
+{
+    const size_t sub_blocks = frames_count / AUDIO_DSP_AGC_LOOKAHEAD_FRAMES;
+    const int32_t level_start = agc->level_gain;
+    const int32_t level_end = (agc->gain * volume) >> 15;
+    int32_t block_peak = 0;
+
+    for (size_t b = 0; b < sub_blocks; ++b) {
+        const size_t offset = b * AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS;
+        const int32_t peak = audio_dsp_block_peak(&input[offset], AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS);
+        const int32_t target = audio_dsp_agc_limit(agc, audio_dsp_agc_level(level_start, level_end, b, sub_blocks), peak);
+
+        /* Same ramp, product is kept whole - limiter ceiling times Q12 gain still fits after scaling to Q31 */
+        int32_t ramp = agc->applied_gain * (1 << AUDIO_DSP_AGC_RAMP_FRAC_BITS);
+        const int32_t step = ((target - agc->applied_gain) * (1 << AUDIO_DSP_AGC_RAMP_FRAC_BITS)) / AUDIO_DSP_AGC_LOOKAHEAD_FRAMES;
+        for (size_t i = 0; i < AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS; i += AUDIO_DSP_CHANNELS) {
+            const int32_t g = ramp >> AUDIO_DSP_AGC_RAMP_FRAC_BITS;
+            output[offset + i] = (agc->delay[i] * g) * (1 << AUDIO_DSP_AGC_OUTPUT_SHIFT);
+            output[offset + i + 1] = (agc->delay[i + 1] * g) * (1 << AUDIO_DSP_AGC_OUTPUT_SHIFT);
+            agc->delay[i] = input[offset + i];
+            agc->delay[i + 1] = input[offset + i + 1];
+            ramp += step;
+        }
+
+        agc->applied_gain = target;
+        agc->delay_peak = peak;
+        block_peak = (peak > block_peak) ? peak : block_peak;
+    }
+
+    agc->level_gain = level_end;
+    audio_dsp_agc_track(agc, block_peak);
+}
+
+static int32_t audio_dsp_to_fixed(float value)
+{
+    return (int32_t)lroundf(value * (1 << AUDIO_DSP_BIQUAD_FRAC_BITS));
+}
+
+static inline int32_t audio_dsp_biquad_process(const audio_dsp_biquad_coeffs_t *c, audio_dsp_biquad_state_t *s, int32_t x)
+{
+    /* Direct form I, output state is clamped to int16 range so that accumulator can't overflow */
+    int32_t acc = c->b0 * x + c->b1 * s->x1 + c->b2 * s->x2 - c->a1 * s->y1 - c->a2 * s->y2;
+    int32_t y = (acc + (1 << (AUDIO_DSP_BIQUAD_FRAC_BITS - 1))) >> AUDIO_DSP_BIQUAD_FRAC_BITS;
+    y = (y > INT16_MAX) ? INT16_MAX : ((y < INT16_MIN) ? INT16_MIN : y);
+
+    s->x2 = s->x1;
+    s->x1 = x;
+    s->y2 = s->y1;
+    s->y1 = y;
+
+    return y;
+}
+
+void audio_dsp_crossover_init(audio_dsp_crossover_t *xo, uint32_t sample_rate, uint32_t crossover_freq)
+{
+    /* Butterworth sections (Q = 1/sqrt(2)), RBJ cookbook */
+    const float w0 = 2.0f * AUDIO_DSP_PI * crossover_freq / sample_rate;
+    const float cos_w0 = cosf(w0);
+    const float alpha = sinf(w0) / (2.0f * 0.70710678f);
+    const float a0 = 1.0f + alpha;
+
+    const float lp_b0 = (1.0f - cos_w0) / 2.0f / a0;
+    const float hp_b0 = (1.0f + cos_w0) / 2.0f / a0;
+    const int32_t a1 = audio_dsp_to_fixed(-2.0f * cos_w0 / a0);
+    const int32_t a2 = audio_dsp_to_fixed((1.0f - alpha) / a0);
+
+    audio_dsp_biquad_coeffs_t *lp = &xo->coeffs[AUDIO_DSP_CROSSOVER_LOW];
+    lp->b0 = audio_dsp_to_fixed(lp_b0);
+    lp->b1 = audio_dsp_to_fixed(2.0f * lp_b0);
+    lp->b2 = lp->b0;
+    lp->a1 = a1;
+    lp->a2 = a2;
+
+    audio_dsp_biquad_coeffs_t *hp = &xo->coeffs[AUDIO_DSP_CROSSOVER_HIGH];
+    hp->b0 = audio_dsp_to_fixed(hp_b0);
+    hp->b1 = audio_dsp_to_fixed(-2.0f * hp_b0);
+    hp->b2 = hp->b0;
+    hp->a1 = a1;
+    hp->a2 = a2;
+
+    audio_dsp_crossover_reset(xo);
+}
+
+void audio_dsp_crossover_reset(audio_dsp_crossover_t *xo)
+{
+    memset(xo->state, 0, sizeof(xo->state));
+}
+
+void HOT_PATH_FUNC(audio_dsp_crossover_process)(audio_dsp_crossover_t *xo, const int16_t *input, int16_t *low, int16_t *high, size_t frames_count)
+{
+    const audio_dsp_biquad_coeffs_t *lp = &xo->coeffs[AUDIO_DSP_CROSSOVER_LOW];
+    const audio_dsp_biquad_coeffs_t *hp = &xo->coeffs[AUDIO_DSP_CROSSOVER_HIGH];
+
+    for (size_t i = 0; i < AUDIO_DSP_CHANNELS * frames_count; i += AUDIO_DSP_CHANNELS) {
+        for (size_t ch = 0; ch < AUDIO_DSP_CHANNELS; ++ch) {
+            audio_dsp_biquad_state_t (*state)[AUDIO_DSP_CROSSOVER_STAGES] = xo->state[ch];
+            const int32_t x = input[i + ch];
+
+            /* Input is read before low band output is written, so in-place works */
+            int32_t y_low = audio_dsp_biquad_process(lp, &state[AUDIO_DSP_CROSSOVER_LOW][0], x);
+            y_low = audio_dsp_biquad_process(lp, &state[AUDIO_DSP_CROSSOVER_LOW][1], y_low);
+            int32_t y_high = audio_dsp_biquad_process(hp, &state[AUDIO_DSP_CROSSOVER_HIGH][0], x);
+            y_high = audio_dsp_biquad_process(hp, &state[AUDIO_DSP_CROSSOVER_HIGH][1], y_high);
+
+            low[i + ch] = y_low;
+            high[i + ch] = y_high;
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Kernels work on interleaved stereo int16 frames. Gains are Q15, unity is 0x8000.
+ * On cores with the DSP extension (RP2350) variants processing the whole L/R pair
+ * per word are selected at compile time, they are bit-exact with the portable ones.
+ * That covers gain, ramps and resampling - SBC synthesis is done by the BTstack decoder. */
+
+#define AUDIO_DSP_GAIN_UNITY 0x8000
+
+#define AUDIO_DSP_CHANNELS 2
+#define AUDIO_DSP_CROSSOVER_BANDS 2
+#define AUDIO_DSP_CROSSOVER_STAGES 2 // Linkwitz-Riley 4th order is two cascaded 2nd order Butterworth sections
+
+/* AGC gains are Q12, so that boost up to 4x still fits int32 product with int16 sample */
+#define AUDIO_DSP_AGC_GAIN_UNITY 0x1000
+/* Limiter lookahead, output is delayed by that much. Blocks passed to AGC have to be a multiple of it. */
+#define AUDIO_DSP_AGC_LOOKAHEAD_FRAMES 32
+
+/* Resampling factor is the 16.16 step through input per output frame */
+#define AUDIO_DSP_RESAMPLE_FACTOR_UNITY 0x10000
+
+/* Biquad coefficients, fixed-point Q12 - keeps accumulator within 32 bits without a 64-bit multiply on M0+.
+ * That is accurate enough for crossover frequencies above ~500 Hz at 44.1/48 kHz. */
+typedef struct audio_dsp_biquad_coeffs
+{
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+} audio_dsp_biquad_coeffs_t;
+
+typedef struct audio_dsp_biquad_state
+{
+    int32_t x1;
+    int32_t x2;
+    int32_t y1;
+    int32_t y2;
+} audio_dsp_biquad_state_t;
+
+typedef enum
+{
+    AUDIO_DSP_CROSSOVER_LOW = 0,
+    AUDIO_DSP_CROSSOVER_HIGH
+} audio_dsp_crossover_band_t;
+
+typedef struct audio_dsp_crossover
+{
+    audio_dsp_biquad_coeffs_t coeffs[AUDIO_DSP_CROSSOVER_BANDS];
+    audio_dsp_biquad_state_t state[AUDIO_DSP_CHANNELS][AUDIO_DSP_CROSSOVER_BANDS][AUDIO_DSP_CROSSOVER_STAGES];
+} audio_dsp_crossover_t;
+
+/* Block based AGC with lookahead soft knee limiter. Envelope follows the peak of each block, AGC gain and
+ * volume ramp across the next one. Limiter works on sub-blocks of lookahead size - gain ramps down over the
+ * sub-block preceding a peak, so it is already low enough when the peak plays. Output never exceeds the
+ * ceiling and the gain never steps, it can only recover at a limited rate. */
+typedef struct audio_dsp_agc
+{
+    int32_t attack_coeff; // Q15, per block
+    int32_t release_coeff; // Q15, per block
+    int32_t envelope;
+    int32_t gain; // Q12, AGC only
+    int32_t level_gain; // Q12, with volume, reached at the end of the previous block
+    int32_t applied_gain; // Q12, with volume and limiter, reached at the end of the previous sub-block
+    int32_t delay_peak;
+    int16_t delay[AUDIO_DSP_AGC_LOOKAHEAD_FRAMES * AUDIO_DSP_CHANNELS]; // Input sub-block waiting for the next one
+} audio_dsp_agc_t;
+
+/* Linear interpolating resampler, same output as btstack_resample. Mono or stereo, stereo frames are interpolated
+ * as packed L/R pairs on cores with the DSP extension. Last input frame of each block is kept for the next one. */
+typedef struct audio_dsp_resample
+{
+    uint32_t position; // 16.16 into the current block, wraps below zero for positions before its first frame
+    uint32_t factor;
+    int16_t last_frame[AUDIO_DSP_CHANNELS];
+    uint8_t num_channels;
+} audio_dsp_resample_t;
+
+void audio_dsp_gain_stereo(int16_t *buffer, size_t frames_count, int32_t gain);
+/* Output in int32_t with the value in upper bits, so gain doesn't requantize to 16 bits */
+void audio_dsp_gain_stereo_32(const int16_t *input, int32_t *output, size_t frames_count, int32_t gain);
+void audio_dsp_ramp_stereo(int16_t *buffer, size_t frames_count, int32_t gain_start, int32_t gain_step);
+/* Linear fade across the whole buffer, from silence or to silence */
+void audio_dsp_fade_stereo(int16_t *buffer, size_t frames_count, bool fade_in);
+
+void audio_dsp_resample_init(audio_dsp_resample_t *resample, uint8_t num_channels);
+void audio_dsp_resample_set_factor(audio_dsp_resample_t *resample, uint32_t factor);
+/* Returns number of output frames, output has to hold frames_count * AUDIO_DSP_RESAMPLE_FACTOR_UNITY / factor + 1.
+ * Input and output are word aligned, so that stereo frames can be accessed as one word. */
+uint32_t audio_dsp_resample_block(audio_dsp_resample_t *resample, const int16_t *input, uint32_t frames_count, int16_t *output);
+
+void audio_dsp_agc_init(audio_dsp_agc_t *agc, uint32_t sample_rate, size_t block_frames);
+void audio_dsp_agc_reset(audio_dsp_agc_t *agc);
+/* Volume is Q15 like in audio_dsp_gain_stereo and is applied together with AGC gain, before the limiter */
+void audio_dsp_agc_process(audio_dsp_agc_t *agc, int16_t *buffer, size_t frames_count, int32_t volume);
+void audio_dsp_agc_process_32(audio_dsp_agc_t *agc, const int16_t *input, int32_t *output, size_t frames_count, int32_t volume);
+
+void audio_dsp_crossover_init(audio_dsp_crossover_t *xo, uint32_t sample_rate, uint32_t crossover_freq);
+void audio_dsp_crossover_reset(audio_dsp_crossover_t *xo);
+/* Splits input into low and high band in one pass, low may point to the same buffer as input */
+void audio_dsp_crossover_process(audio_dsp_crossover_t *xo, const int16_t *input, int16_t *low, int16_t *high, size_t frames_count);
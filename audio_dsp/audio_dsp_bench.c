@@ -0,0 +1,129 @@
+#include "audio_dsp_bench.h"
+
+#if AUDIO_DSP_BENCHMARK_ENABLED
+
+#include "audio_dsp.h"
+#include <hardware/structs/systick.h>
+#include <hardware/sync.h>
+#include <stdio.h>
+#include <string.h>
+
+#define AUDIO_DSP_BENCH_FRAMES 1024 // Music DMA period of bt_i2s
+#define AUDIO_DSP_BENCH_SAMPLES (AUDIO_DSP_BENCH_FRAMES * AUDIO_DSP_CHANNELS)
+#define AUDIO_DSP_BENCH_RUNS 8
+#define AUDIO_DSP_BENCH_SAMPLE_RATE 44100
+#define AUDIO_DSP_BENCH_CROSSOVER_FREQ_HZ 2000
+#define AUDIO_DSP_BENCH_GAIN 0x5A82 // -3 dB
+#define AUDIO_DSP_BENCH_RESAMPLE_FACTOR 0x10040 // Steady-state playout correction, output fits one period
+#define AUDIO_DSP_BENCH_SYSTICK_MASK 0xFFFFFF // 24-bit down counter
+#define AUDIO_DSP_BENCH_SYSTICK_ENABLE 0x1
+#define AUDIO_DSP_BENCH_SYSTICK_CORE_CLOCK 0x4
+
+typedef struct
+{
+    const char *name;
+    void (*kernel)(void);
+    uint32_t units; // Per period
+    const char *unit;
+} audio_dsp_bench_entry_t;
+
+typedef struct
+{
+    int16_t input[AUDIO_DSP_BENCH_SAMPLES];
+    int16_t buffer[AUDIO_DSP_BENCH_SAMPLES];
+    int16_t high[AUDIO_DSP_BENCH_SAMPLES];
+    int32_t output_32[AUDIO_DSP_BENCH_SAMPLES];
+    audio_dsp_crossover_t crossover;
+    audio_dsp_agc_t agc;
+    audio_dsp_resample_t resample;
+} audio_dsp_bench_ctx_t;
+
+static audio_dsp_bench_ctx_t ctx;
+
+static void audio_dsp_bench_gain(void)
+{
+    audio_dsp_gain_stereo(ctx.buffer, AUDIO_DSP_BENCH_FRAMES, AUDIO_DSP_BENCH_GAIN);
+}
+
+static void audio_dsp_bench_gain_32(void)
+{
+    audio_dsp_gain_stereo_32(ctx.buffer, ctx.output_32, AUDIO_DSP_BENCH_FRAMES, AUDIO_DSP_BENCH_GAIN);
+}
+
+static void audio_dsp_bench_crossover(void)
+{
+    audio_dsp_crossover_process(&ctx.crossover, ctx.buffer, ctx.buffer, ctx.high, AUDIO_DSP_BENCH_FRAMES);
+}
+
+static void audio_dsp_bench_agc(void)
+{
+    audio_dsp_agc_process(&ctx.agc, ctx.buffer, AUDIO_DSP_BENCH_FRAMES, AUDIO_DSP_BENCH_GAIN);
+}
+
+static void audio_dsp_bench_agc_32(void)
+{
+    audio_dsp_agc_process_32(&ctx.agc, ctx.buffer, ctx.output_32, AUDIO_DSP_BENCH_FRAMES, AUDIO_DSP_BENCH_GAIN);
+}
+
+static void audio_dsp_bench_resample(void)
+{
+    audio_dsp_resample_block(&ctx.resample, ctx.buffer, AUDIO_DSP_BENCH_FRAMES, ctx.high);
+}
+
+static const audio_dsp_bench_entry_t entries[] = {
+    {"gain_stereo", audio_dsp_bench_gain, AUDIO_DSP_BENCH_FRAMES, "frame"},
+    {"gain_stereo_32", audio_dsp_bench_gain_32, AUDIO_DSP_BENCH_FRAMES, "frame"},
+    {"agc_process", audio_dsp_bench_agc, AUDIO_DSP_BENCH_FRAMES, "frame"},
+    {"agc_process_32", audio_dsp_bench_agc_32, AUDIO_DSP_BENCH_FRAMES, "frame"},
+    {"resample_block", audio_dsp_bench_resample, AUDIO_DSP_BENCH_FRAMES, "input frame"},
+    {"crossover_process", audio_dsp_bench_crossover, AUDIO_DSP_BENCH_FRAMES, "frame"},
+    {"crossover_process", audio_dsp_bench_crossover, AUDIO_DSP_BENCH_SAMPLES * AUDIO_DSP_CROSSOVER_BANDS * AUDIO_DSP_CROSSOVER_STAGES, "biquad"}
+};
+
+/* Runs kernel on a fresh copy of the input, returns cycles taken */
+static uint32_t audio_dsp_bench_measure(void (*kernel)(void))
+{
+    memcpy(ctx.buffer, ctx.input, sizeof(ctx.buffer));
+
+    const uint32_t interrupts = save_and_disable_interrupts();
+    const uint32_t start = systick_hw->cvr;
+    kernel();
+    const uint32_t end = systick_hw->cvr;
+    restore_interrupts(interrupts);
+
+    return (start - end) & AUDIO_DSP_BENCH_SYSTICK_MASK;
+}
+
+void audio_dsp_bench_run(void)
+{
+    systick_hw->rvr = AUDIO_DSP_BENCH_SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = AUDIO_DSP_BENCH_SYSTICK_ENABLE | AUDIO_DSP_BENCH_SYSTICK_CORE_CLOCK;
+
+    /* Music-like level, full scale peaks included */
+    uint32_t seed = 1;
+    for (size_t i = 0; i < AUDIO_DSP_BENCH_SAMPLES; ++i) {
+        seed = seed * 1664525U + 1013904223U;
+        ctx.input[i] = (int16_t)(seed >> 16);
+    }
+    audio_dsp_crossover_init(&ctx.crossover, AUDIO_DSP_BENCH_SAMPLE_RATE, AUDIO_DSP_BENCH_CROSSOVER_FREQ_HZ);
+    audio_dsp_agc_init(&ctx.agc, AUDIO_DSP_BENCH_SAMPLE_RATE, AUDIO_DSP_BENCH_FRAMES);
+    audio_dsp_resample_init(&ctx.resample, AUDIO_DSP_CHANNELS);
+    audio_dsp_resample_set_factor(&ctx.resample, AUDIO_DSP_BENCH_RESAMPLE_FACTOR);
+
+    /* First run includes XIP cache misses (unless in SRAM), best of the rest is the kernel itself */
+    for (size_t i = 0; i < count_of(entries); ++i) {
+        const uint32_t first = audio_dsp_bench_measure(entries[i].kernel);
+        uint32_t best = first;
+        for (uint32_t run = 1; run < AUDIO_DSP_BENCH_RUNS; ++run) {
+            const uint32_t cycles = audio_dsp_bench_measure(entries[i].kernel);
+            best = (cycles < best) ? cycles : best;
+        }
+        printf("DSP bench: %s %lu cycles per %s, first run %lu cycles per period\n", entries[i].name,
+               (unsigned long)((best + (entries[i].units / 2)) / entries[i].units), entries[i].unit, (unsigned long)first);
+    }
+
+    systick_hw->csr = 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+/* Cycle counts of audio_dsp kernels on the target, for one music DMA period each. Measured with SysTick
+ * on the core clock, with interrupts off, once at boot before Bluetooth starts. Compare builds for both
+ * boards and with and without AUDIO_HOT_PATH_IN_RAM. Enabled with CMake option AUDIO_DSP_BENCHMARK. */
+
+#ifndef AUDIO_DSP_BENCHMARK_ENABLED
+#define AUDIO_DSP_BENCHMARK_ENABLED 0
+#endif
+
+#if AUDIO_DSP_BENCHMARK_ENABLED
+
+void audio_dsp_bench_run(void);
+
+#else
+
+static inline void audio_dsp_bench_run(void) {}
+
+#endif
@@ -1,4 +1,5 @@
 #include "audio_i2s.h"
+#include <hot_path.h>
 #include <audio_i2s.pio.h>
 #include <hardware/pio.h>
 #include <hardware/dma.h>
@@ -7,32 +8,132 @@
 #include <stdlib.h>
 
 #define AUDIO_I2S_CHANNELS 2
+#define AUDIO_I2S_TDM_CHANNELS_MAX 8
 #define AUDIO_I2S_BUFFER_COUNT 2
 #define AUDIO_I2S_BITS_PER_BYTE 8
+#define AUDIO_I2S_BYTES_PER_WORD 4
+#define AUDIO_I2S_SLOT_BITS_MIN 16
+#define AUDIO_I2S_SLOT_BITS_MAX 32
 #define AUDIO_I2S_CLKDIV_FRAC_PART 256ULL
 
+static int audio_i2s_resolve_format(audio_i2s_t *i2s)
+{
+    const audio_i2s_config_t *config = i2s->config;
+    i2s->slot_bits = (config->slot_bits != 0) ? config->slot_bits : (config->sample_size * AUDIO_I2S_BITS_PER_BYTE);
+    i2s->channels = (config->channels != 0) ? config->channels : AUDIO_I2S_CHANNELS;
+
+    if ((i2s->slot_bits < AUDIO_I2S_SLOT_BITS_MIN) || (i2s->slot_bits > AUDIO_I2S_SLOT_BITS_MAX)) {
+        return -EINVAL;
+    }
+    if ((config->format == AUDIO_I2S_FORMAT_TDM) ? (i2s->channels > AUDIO_I2S_TDM_CHANNELS_MAX) : (i2s->channels != AUDIO_I2S_CHANNELS)) {
+        return -EINVAL;
+    }
+
+    switch (config->sample_size) {
+        case sizeof(int16_t):
+            /* Packed L/R pairs, one DMA word per frame - TDM slot order wouldn't match */
+            if ((i2s->slot_bits != AUDIO_I2S_SLOT_BITS_MIN) || (config->format == AUDIO_I2S_FORMAT_TDM)) {
+                return -EINVAL;
+            }
+            i2s->words_per_frame = 1;
+            break;
+
+        case sizeof(int32_t):
+            i2s->words_per_frame = i2s->channels;
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    switch (config->format) {
+        case AUDIO_I2S_FORMAT_I2S:
+            i2s->program = &i2s_out_master_program;
+            break;
+
+        case AUDIO_I2S_FORMAT_LEFT_JUSTIFIED:
+            i2s->program = &lj_out_master_program;
+            break;
+
+        case AUDIO_I2S_FORMAT_TDM:
+            i2s->program = &tdm_out_master_program;
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    /* Shared program has to be the one this format needs, in the same instruction memory */
+    const audio_i2s_t *owner = config->program_owner;
+    if ((owner != NULL) && ((owner->program != i2s->program) || (owner->config->pio != config->pio))) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static size_t audio_i2s_buffer_size(audio_i2s_t *i2s)
+{
+    return i2s->config->buffer_frames_count * i2s->words_per_frame * AUDIO_I2S_BYTES_PER_WORD;
+}
+
 static uint32_t audio_i2s_compute_clkdiv(audio_i2s_t *i2s)
 {
     const uint64_t sysclk_freq = clock_get_hz(clk_sys);
-    const uint64_t bclk_freq = i2s->config->sample_rate * i2s->config->sample_size * AUDIO_I2S_BITS_PER_BYTE * AUDIO_I2S_CHANNELS;
+    const uint64_t bclk_freq = (uint64_t)i2s->config->sample_rate * i2s->slot_bits * i2s->channels;
     return (AUDIO_I2S_CLKDIV_FRAC_PART * sysclk_freq) / (2ULL * bclk_freq);
 }
 
-static void audio_i2s_sm_init(audio_i2s_t *i2s)
+static void audio_i2s_sm_set_clkdiv(audio_i2s_t *i2s)
 {
-    i2s->sm = pio_claim_unused_sm(i2s->config->pio, true);
-    i2s->sm_offset = pio_add_program(i2s->config->pio, &i2s_out_master_program);
-    i2s_out_master_program_init(i2s->config->pio, i2s->sm, i2s->sm_offset, i2s->config->data_pin, i2s->config->clock_pin_base);
     const uint32_t divider = audio_i2s_compute_clkdiv(i2s);
     pio_sm_set_clkdiv_int_frac(i2s->config->pio, i2s->sm, divider >> 8U, divider & 0xFFU);
 }
 
+static void audio_i2s_sm_init(audio_i2s_t *i2s)
+{
+    const audio_i2s_config_t *config = i2s->config;
+    i2s->sm = pio_claim_unused_sm(config->pio, true);
+    i2s->sm_offset = (config->program_owner != NULL) ? config->program_owner->sm_offset : pio_add_program(config->pio, i2s->program);
+
+    /* Packed pairs start with right channel, as it is in the upper half of the word shifted out first */
+    const bool packed = (i2s->words_per_frame == 1);
+    const uint pull_threshold = packed ? (AUDIO_I2S_BYTES_PER_WORD * AUDIO_I2S_BITS_PER_BYTE) : i2s->slot_bits;
+    pio_sm_config sm_config;
+    uint entry;
+    uint32_t y;
+
+    switch (config->format) {
+        case AUDIO_I2S_FORMAT_LEFT_JUSTIFIED:
+            sm_config = lj_out_master_program_get_default_config(i2s->sm_offset);
+            entry = packed ? lj_out_master_offset_entry_point : lj_out_master_offset_entry_left;
+            y = i2s->slot_bits - 2;
+            break;
+
+        case AUDIO_I2S_FORMAT_TDM:
+            sm_config = tdm_out_master_program_get_default_config(i2s->sm_offset);
+            entry = tdm_out_master_offset_entry_left;
+            y = (i2s->slot_bits * i2s->channels) - 2; // Whole frame is one loop
+            break;
+
+        default:
+            sm_config = i2s_out_master_program_get_default_config(i2s->sm_offset);
+            entry = packed ? i2s_out_master_offset_entry_point : i2s_out_master_offset_entry_left;
+            y = i2s->slot_bits - 2;
+            break;
+    }
+
+    audio_i2s_program_init(config->pio, i2s->sm, i2s->sm_offset, &sm_config, entry, config->data_pin, config->clock_pin_base, pull_threshold, y);
+    audio_i2s_sm_set_clkdiv(i2s);
+}
+
 static void audio_i2s_sm_deinit(audio_i2s_t *i2s)
 {
     pio_sm_clear_fifos(i2s->config->pio, i2s->sm);
     pio_sm_drain_tx_fifo(i2s->config->pio, i2s->sm);
-    pio_remove_program(i2s->config->pio, &i2s_out_master_program, i2s->sm_offset);
-    pio_clear_instruction_memory(i2s->config->pio);
+    if (i2s->config->program_owner == NULL) {
+        pio_remove_program(i2s->config->pio, i2s->program, i2s->sm_offset);
+    }
     pio_sm_unclaim(i2s->config->pio, i2s->sm);
 }
 
@@ -44,7 +145,7 @@ static void audio_i2s_dma_init(audio_i2s_t *i2s)
 
     /* Set up control blocks */
     i2s->ctrl_blocks[0] = &i2s->pcm_buffer[0];
-    i2s->ctrl_blocks[1] = &i2s->pcm_buffer[i2s->config->buffer_frames_count * AUDIO_I2S_CHANNELS];
+    i2s->ctrl_blocks[1] = &i2s->pcm_buffer[audio_i2s_buffer_size(i2s)];
     
     /* Configure control channel */
     dma_channel_config c = dma_channel_get_default_config(i2s->dma_ctrl_ch);
@@ -60,12 +161,14 @@ static void audio_i2s_dma_init(audio_i2s_t *i2s)
     channel_config_set_write_increment(&c, false);
     channel_config_set_chain_to(&c, i2s->dma_ctrl_ch);
     channel_config_set_dreq(&c, pio_get_dreq(i2s->config->pio, i2s->sm, true));
-    dma_channel_configure(i2s->dma_data_ch, &c, &i2s->config->pio->txf[i2s->sm], NULL, i2s->config->buffer_frames_count, false);
+    dma_channel_configure(i2s->dma_data_ch, &c, &i2s->config->pio->txf[i2s->sm], NULL, i2s->config->buffer_frames_count * i2s->words_per_frame, false);
 
-    /* Configure DMA interrupt */
-    dma_channel_set_irq0_enabled(i2s->dma_data_ch, true);
-    irq_set_exclusive_handler(DMA_IRQ_0, i2s->config->dma_handler);
-    irq_set_enabled(DMA_IRQ_0, true);
+    /* Configure DMA interrupt, instances without handler are expected to run in sync with one that has it */
+    if (i2s->config->dma_handler != NULL) {
+        dma_channel_set_irq0_enabled(i2s->dma_data_ch, true);
+        irq_set_exclusive_handler(DMA_IRQ_0, i2s->config->dma_handler);
+        irq_set_enabled(DMA_IRQ_0, true);
+    }
 
     /* Start DMA */
     dma_channel_start(i2s->dma_ctrl_ch);
@@ -78,7 +181,9 @@ static void audio_i2s_dma_deinit(audio_i2s_t *i2s)
     dma_channel_cleanup(i2s->dma_ctrl_ch);
 
     /* Disable DMA interrupt */
-    irq_set_enabled(DMA_IRQ_0, false);
+    if (i2s->config->dma_handler != NULL) {
+        irq_set_enabled(DMA_IRQ_0, false);
+    }
 
     /* Free used DMA channels */
     dma_channel_unclaim(i2s->dma_data_ch);
@@ -88,11 +193,16 @@ static void audio_i2s_dma_deinit(audio_i2s_t *i2s)
 int audio_i2s_init(audio_i2s_t *i2s)
 {   
     // TODO lots of sanity checks
+    const int err = audio_i2s_resolve_format(i2s);
+    if (err) {
+        return err;
+    }
+
     pio_gpio_init(i2s->config->pio, i2s->config->data_pin);
     pio_gpio_init(i2s->config->pio, i2s->config->clock_pin_base);
     pio_gpio_init(i2s->config->pio, i2s->config->clock_pin_base + 1);
-    const size_t buffer_size = i2s->config->buffer_frames_count * AUDIO_I2S_CHANNELS * i2s->config->sample_size;
-    i2s->pcm_buffer = calloc(1,  buffer_size * AUDIO_I2S_BUFFER_COUNT);
+    i2s->pcm_buffer_size = audio_i2s_buffer_size(i2s) * AUDIO_I2S_BUFFER_COUNT;
+    i2s->pcm_buffer = calloc(1, i2s->pcm_buffer_size);
     if (i2s->pcm_buffer == NULL) {
         return -ENOMEM;
     }
@@ -103,6 +213,23 @@ int audio_i2s_init(audio_i2s_t *i2s)
     return 0;
 }
 
+int audio_i2s_reconfigure(audio_i2s_t *i2s)
+{
+    /* Buffers are not reallocated, new geometry has to fit in the space allocated in init. Sample format stays as set up in init */
+    const size_t buffer_size = audio_i2s_buffer_size(i2s);
+    if ((buffer_size * AUDIO_I2S_BUFFER_COUNT) > i2s->pcm_buffer_size) {
+        return -ENOMEM;
+    }
+
+    audio_i2s_sm_set_clkdiv(i2s);
+
+    /* Takes effect from the next buffer switch */
+    i2s->ctrl_blocks[1] = &i2s->pcm_buffer[buffer_size];
+    dma_channel_set_trans_count(i2s->dma_data_ch, i2s->config->buffer_frames_count * i2s->words_per_frame, false);
+
+    return 0;
+}
+
 void audio_i2s_deinit(audio_i2s_t *i2s)
 {
     audio_i2s_enable(i2s, false);
@@ -117,13 +244,42 @@ void audio_i2s_enable(audio_i2s_t *i2s, bool enabled)
     pio_sm_set_enabled(i2s->config->pio, i2s->sm, enabled);
 }
 
-void audio_i2s_clear_dma_irq(audio_i2s_t *i2s)
+void audio_i2s_enable_synced(audio_i2s_t *const *i2s, size_t count, bool enabled)
+{
+    /* All instances have to share the same PIO block */
+    uint32_t sm_mask = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sm_mask |= (1U << i2s[i]->sm);
+    }
+
+    if (enabled) {
+        pio_enable_sm_mask_in_sync(i2s[0]->config->pio, sm_mask); // Restarts clock dividers as well, so the outputs are phase aligned
+    }
+    else {
+        pio_set_sm_mask_enabled(i2s[0]->config->pio, sm_mask, false);
+    }
+}
+
+void HOT_PATH_FUNC(audio_i2s_clear_dma_irq)(audio_i2s_t *i2s)
 {
     dma_hw->ints0 = (1U << i2s->dma_data_ch);
 }
 
-int16_t *audio_i2s_get_next_buffer(audio_i2s_t *i2s)
+void *HOT_PATH_FUNC(audio_i2s_get_next_buffer)(audio_i2s_t *i2s)
 {
     /* Return address set to be sent as next via control DMA */
-    return *(int16_t **)dma_hw->ch[i2s->dma_ctrl_ch].read_addr;
+    return *(void **)dma_hw->ch[i2s->dma_ctrl_ch].read_addr;
+}
+
+uint32_t HOT_PATH_FUNC(audio_i2s_get_remaining_frames)(audio_i2s_t *i2s)
+{
+    /* Frames of current buffer not yet handed to PIO, RP2350 keeps mode in upper bits */
+    return (dma_channel_hw_addr(i2s->dma_data_ch)->transfer_count & 0x0FFFFFFFU) / i2s->words_per_frame;
+}
+
+void *audio_i2s_get_current_buffer(audio_i2s_t *i2s)
+{
+    /* Return the other buffer, the one being sent by data DMA right now */
+    void *next_buffer = audio_i2s_get_next_buffer(i2s);
+    return (next_buffer == i2s->ctrl_blocks[0]) ? i2s->ctrl_blocks[1] : i2s->ctrl_blocks[0];
 }
@@ -7,7 +7,18 @@
 
 #define ALIGN(var, size) __attribute__((aligned(size))) var
 
-/* I2S peripheral configuration structure */
+typedef enum
+{
+    AUDIO_I2S_FORMAT_I2S = 0,
+    AUDIO_I2S_FORMAT_LEFT_JUSTIFIED,
+    AUDIO_I2S_FORMAT_TDM // One BCLK wide frame sync before the first slot (DSP mode A)
+} audio_i2s_format_t;
+
+struct audio_i2s_pio_ctx;
+
+/* I2S peripheral configuration structure.
+ * Samples are either int16_t packed in L/R pairs (sample_size 2, 16-bit slots only), or int32_t
+ * with the value in the upper bits (sample_size 4) - slot_bits of them go out, MSB first. */
 typedef struct audio_i2s_config 
 {
     PIO pio;
@@ -15,8 +26,12 @@ typedef struct audio_i2s_config
     uint8_t clock_pin_base;
     uint32_t sample_rate;
     uint8_t sample_size;
+    uint8_t slot_bits; // 16, 24 or 32, 0 means the same as sample size
+    uint8_t channels; // Slots per frame, 0 means 2. Only TDM takes more than 2
+    audio_i2s_format_t format;
     uint32_t buffer_frames_count;
     void (*dma_handler)(void);
+    const struct audio_i2s_pio_ctx *program_owner; // Output on the same PIO with the same format whose program is reused, NULL loads own copy
 } audio_i2s_config_t;
 
 typedef struct audio_i2s_pio_ctx
@@ -25,14 +40,23 @@ typedef struct audio_i2s_pio_ctx
     uint8_t sm_offset;
     uint dma_ctrl_ch;
     uint dma_data_ch;
-    ALIGN(int16_t *ctrl_blocks[2], 8);
-    int16_t *pcm_buffer;
+    ALIGN(void *ctrl_blocks[2], 8);
+    uint8_t *pcm_buffer;
+    size_t pcm_buffer_size;
+    const pio_program_t *program;
+    uint8_t slot_bits;
+    uint8_t channels;
+    uint8_t words_per_frame; // 32-bit DMA transfers
     const audio_i2s_config_t *config;
 } audio_i2s_t;
 
 int audio_i2s_init(audio_i2s_t *i2s);
+int audio_i2s_reconfigure(audio_i2s_t *i2s); // Applies changed sample rate and buffer geometry in place
 void audio_i2s_deinit(audio_i2s_t *i2s);
 void audio_i2s_enable(audio_i2s_t *i2s, bool enabled);
+void audio_i2s_enable_synced(audio_i2s_t *const *i2s, size_t count, bool enabled);
 
 void audio_i2s_clear_dma_irq(audio_i2s_t *i2s);
-int16_t *audio_i2s_get_next_buffer(audio_i2s_t *i2s);
+void *audio_i2s_get_next_buffer(audio_i2s_t *i2s);
+void *audio_i2s_get_current_buffer(audio_i2s_t *i2s);
+uint32_t audio_i2s_get_remaining_frames(audio_i2s_t *i2s);
@@ -1,29 +1,69 @@
 #include "a2dp.h"
 #include "avrcp.h"
 #include "bt_i2s.h"
+#include "reconnect.h"
+#include "profiler.h"
+#include "jitter_policy.h"
+#include "link_quality.h"
+#include "latency_probe.h"
+#include "playout_policy.h"
+#include "playout_stream.h"
+#include "sbc_volume.h"
+#include "flow_control.h"
+#include <hot_path.h>
+#include <debug_log.h>
+#include <audio_dsp.h>
 #include <btstack.h>
-#include <btstack_resample.h>
 #include <classic/a2dp_sink.h>
 #include <pico/cyw43_arch.h>
+#include <pico/time.h>
 
 #define BT_A2DP_SBC_HEADER_SIZE 12 // Without CRC
 #define BT_A2DP_MEDIA_HEADER_SIZE 12 // Without CRC
 
-#define BT_A2DP_RESAMPLING_FACTOR_NOMINAL 0x10000 // Fixed-point 2^16
-#define BT_A2DP_RESAMPLING_COMPENSATION 0x00100
-
 #define BT_A2DP_MAX_SBC_FRAME_SIZE 120
 
-#define BT_A2DP_SBC_FRAMES_COUNT_MIN 60
+#define BT_A2DP_SBC_FRAMES_COUNT_MIN 60 // Initial target, adapted to link quality within bounds below
 #define BT_A2DP_SBC_FRAMES_COUNT_MAX 120
 #define BT_A2DP_SBC_ADDITIONAL_FRAMES 30
 
+#define BT_A2DP_SBC_FRAMES_TARGET_LOW_BOUND 20
+#define BT_A2DP_SBC_FRAMES_TARGET_HIGH_BOUND 90
+#define BT_A2DP_SBC_FRAMES_WINDOW 60 // Compress samples only above target + window
+#define BT_A2DP_JITTER_UPDATE_INTERVAL_MS 1000
+
+#define BT_A2DP_FAST_START_ENABLED true // Begin playback with a short primer, then ramp up to target, see playout_policy.h
+
+/* Volume folded into SBC scale factors in 6 dB steps, instead of a multiply per output sample, see sbc_volume.h */
+#ifndef BT_A2DP_SUBBAND_VOLUME_ENABLED
+#define BT_A2DP_SUBBAND_VOLUME_ENABLED 0
+#endif
+
 #define BT_A2DP_SAMPLE_SIZE sizeof(int16_t) 
 #define BT_A2DP_CHANNELS_PER_FRAME 2
 #define BT_A2DP_BYTES_PER_FRAME (BT_A2DP_SAMPLE_SIZE * BT_A2DP_CHANNELS_PER_FRAME)
-#define BT_A2DP_AUDIO_STORAGE_FRAMES (128 + 16)
+#define BT_A2DP_RESAMPLED_FRAMES_MAX (128 + 16) // Single SBC frame after resampling
+
+/* Decode-ahead - keep a PCM lookahead topped up in small slices from run loop, so that DMA refill is mostly a copy.
+ * Can be turned off to compare refill and handler load with the profiler. */
+#ifndef BT_A2DP_DECODE_AHEAD_ENABLED
+#define BT_A2DP_DECODE_AHEAD_ENABLED 1
+#endif
+#define BT_A2DP_DECODE_AHEAD_FRAMES 1024 // One DMA period
+#define BT_A2DP_DECODE_AHEAD_INTERVAL_MS 2
+#define BT_A2DP_DECODE_AHEAD_BUDGET_US 500 // Per slice, leaves run loop time for radio processing
+
+#if BT_A2DP_DECODE_AHEAD_ENABLED
+#define BT_A2DP_AUDIO_STORAGE_FRAMES (BT_A2DP_DECODE_AHEAD_FRAMES + BT_A2DP_RESAMPLED_FRAMES_MAX)
+#else
+#define BT_A2DP_AUDIO_STORAGE_FRAMES BT_A2DP_RESAMPLED_FRAMES_MAX
+#endif
 
 #define BT_A2DP_SBC_FRAME_STORAGE_SIZE ((BT_A2DP_SBC_FRAMES_COUNT_MAX + BT_A2DP_SBC_ADDITIONAL_FRAMES) * BT_A2DP_MAX_SBC_FRAME_SIZE)
+
+#if BT_LATENCY_PROBE_PACKETS_MAX < (BT_A2DP_SBC_FRAMES_COUNT_MAX + BT_A2DP_SBC_ADDITIONAL_FRAMES)
+#error "Latency probe has to be able to track every packet the SBC frame ring holds"
+#endif
 #define BT_A2DP_DECODED_AUDIO_STORAGE_SIZE (BT_A2DP_AUDIO_STORAGE_FRAMES * BT_A2DP_BYTES_PER_FRAME)
 
 typedef struct 
@@ -49,12 +89,29 @@ typedef struct
     uint8_t sbc_frame_storage[BT_A2DP_SBC_FRAME_STORAGE_SIZE];
     btstack_ring_buffer_t decoded_audio_ring_buffer;
     uint8_t decoded_audio_storage[BT_A2DP_DECODED_AUDIO_STORAGE_SIZE];
-    btstack_resample_t resampler;
+    audio_dsp_resample_t resampler;
     btstack_sbc_decoder_state_t sbc_decoder;
+    btstack_timer_source_t decode_ahead_timer;
+    btstack_timer_source_t reconfigure_timer;
     int16_t *request_buffer;
     uint32_t request_frames;
-    bool stream_started;
+    bt_playout_stream_t stream;
     bool media_initialized;
+    bool reconfigure_pending; // Old stream fading out, retune once it has been played
+    bool voice_call_active;
+    bool resume_after_call;
+    bool subband_volume;
+    uint8_t pcm_volume_steps; // Subband volume fallback for the frame being decoded
+    uint32_t subband_volume_frames;
+    uint32_t pcm_volume_frames;
+    bt_jitter_policy_t jitter_policy;
+    bt_playout_policy_t playout_policy;
+    uint32_t frames_target;
+    uint32_t jitter_update_time_ms;
+    uint32_t first_packet_time_ms;
+    uint32_t start_latency_ms;
+    uint32_t reconfiguration_time_us;
+    uint32_t time_to_audio_ms;
 } bt_a2dp_ctx_t;
 
 static bt_a2dp_ctx_t ctx;
@@ -64,11 +121,16 @@ static const uint8_t sbc_capabilities[] = {
     0xFF, 0xFF, 2, 53
 };
 
-static void bt_a2dp_sbc_decoder_callback(int16_t *data, int num_frames, int num_channels, int sample_rate, void *context)
+static void HOT_PATH_FUNC(bt_a2dp_sbc_decoder_callback)(int16_t *data, int num_frames, int num_channels, int sample_rate, void *context)
 {
+    /* Frame subband volume couldn't be applied to - same power of two gain in PCM, SBC frames always have even sample count */
+    if (ctx.pcm_volume_steps > 0) {
+        audio_dsp_gain_stereo(data, (num_frames * num_channels) / 2, AUDIO_DSP_GAIN_UNITY >> ctx.pcm_volume_steps);
+    }
+
     /* Resample new frames */
-    uint8_t output_buffer[BT_A2DP_DECODED_AUDIO_STORAGE_SIZE];
-    const uint32_t resampled_frames = btstack_resample_block(&ctx.resampler, data, num_frames, (int16_t *)output_buffer);
+    uint8_t output_buffer[BT_A2DP_RESAMPLED_FRAMES_MAX * BT_A2DP_BYTES_PER_FRAME] __attribute__((aligned(4)));
+    const uint32_t resampled_frames = audio_dsp_resample_block(&ctx.resampler, data, num_frames, (int16_t *)output_buffer);
 
     /* Store resampled frames in pending request buffer */
     const uint32_t frames_to_copy = btstack_min(resampled_frames, ctx.request_frames);
@@ -87,13 +149,77 @@ static void bt_a2dp_sbc_decoder_callback(int16_t *data, int num_frames, int num_
     }
 }
 
-static void bt_a2dp_read_samples_callback(int16_t *buffer, uint16_t num_frames)
+static void bt_a2dp_latency_probe_reset(void)
 {
-    if (ctx.sbc_frame_size == 0) {
-        memset(buffer, 0, num_frames * BT_A2DP_CHANNELS_PER_FRAME);
+    bt_latency_probe_reset(ctx.sbc_config.sampling_frequency, ctx.sbc_config.block_length * ctx.sbc_config.subbands);
+}
+
+static void HOT_PATH_FUNC(bt_a2dp_subband_volume)(uint8_t *sbc_frame)
+{
+    ctx.pcm_volume_steps = 0;
+
+    /* Applied at decode time rather than on packet arrival, so that volume changes don't wait for the jitter buffer */
+    const uint8_t steps = ctx.subband_volume ? bt_i2s_get_volume_steps() : 0;
+    if (steps == 0) {
         return;
     }
 
+    if (bt_sbc_volume_apply(sbc_frame, ctx.sbc_frame_size, steps)) {
+        ctx.subband_volume_frames++;
+    }
+    else {
+        ctx.pcm_volume_steps = steps;
+        ctx.pcm_volume_frames++;
+    }
+}
+
+static void HOT_PATH_FUNC(bt_a2dp_decode_frame)(uint32_t output_offset_frames, uint32_t playback_delay_us)
+{
+    uint8_t sbc_frame[BT_A2DP_MAX_SBC_FRAME_SIZE];
+    uint32_t bytes_read;
+    btstack_ring_buffer_read(&ctx.sbc_frame_ring_buffer, sbc_frame, ctx.sbc_frame_size, &bytes_read);
+    bt_a2dp_subband_volume(sbc_frame);
+
+    bt_latency_probe_frame_decoded(output_offset_frames, playback_delay_us);
+    const uint32_t decode_start_us = time_us_32();
+    btstack_sbc_decoder_process_data(&ctx.sbc_decoder, 0, sbc_frame, ctx.sbc_frame_size);
+    bt_profiler_record_decode(time_us_32() - decode_start_us); // Includes resampling in decoder callback
+}
+
+static void HOT_PATH_FUNC(bt_a2dp_decode_ahead)(void)
+{
+    if (!bt_playout_stream_is_started(&ctx.stream) || (ctx.sbc_frame_size == 0)) {
+        return;
+    }
+
+    bt_profiler_enter(BT_PROFILER_HANDLER_DECODE_AHEAD);
+
+    /* No request pending, everything decoded goes to the lookahead ring buffer */
+    ctx.request_frames = 0;
+
+    const uint32_t start_us = time_us_32();
+    while (btstack_ring_buffer_bytes_available(&ctx.sbc_frame_ring_buffer) >= ctx.sbc_frame_size) {
+        const uint32_t decoded_frames = btstack_ring_buffer_bytes_available(&ctx.decoded_audio_ring_buffer) / BT_A2DP_BYTES_PER_FRAME;
+        if ((decoded_frames >= BT_A2DP_DECODE_AHEAD_FRAMES) || ((time_us_32() - start_us) >= BT_A2DP_DECODE_AHEAD_BUDGET_US)) {
+            break;
+        }
+        bt_a2dp_decode_frame(decoded_frames, bt_i2s_get_queued_delay_us());
+    }
+
+    bt_profiler_exit(BT_PROFILER_HANDLER_DECODE_AHEAD);
+}
+
+static void bt_a2dp_decode_ahead_task(btstack_timer_source_t *ts)
+{
+    bt_a2dp_decode_ahead();
+
+    /* Restart timer */
+    btstack_run_loop_set_timer(ts, BT_A2DP_DECODE_AHEAD_INTERVAL_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
+static uint32_t HOT_PATH_FUNC(bt_a2dp_fill_samples)(int16_t *buffer, uint32_t num_frames, void *context)
+{
     /* Fill from already decoded audio */
     const uint32_t bytes_to_read = num_frames * BT_A2DP_BYTES_PER_FRAME;
     uint32_t bytes_read;
@@ -105,11 +231,72 @@ static void bt_a2dp_read_samples_callback(int16_t *buffer, uint16_t num_frames)
     ctx.request_buffer = &buffer[samples_read];
     ctx.request_frames = num_frames - frames_read;
 
-    /* Start decoding new SBC frames, the remaining PCM frames from this request will be filled in SBC decoder callback */
-    uint8_t sbc_frame[BT_A2DP_MAX_SBC_FRAME_SIZE];
+    /* Decode new SBC frames if lookahead didn't suffice, the remaining PCM frames from this request will be filled in SBC decoder callback */
     while ((ctx.request_frames > 0) && (btstack_ring_buffer_bytes_available(&ctx.sbc_frame_ring_buffer) >= ctx.sbc_frame_size)) {
-        btstack_ring_buffer_read(&ctx.sbc_frame_ring_buffer, sbc_frame, ctx.sbc_frame_size, &bytes_read);
-        btstack_sbc_decoder_process_data(&ctx.sbc_decoder, 0, sbc_frame, ctx.sbc_frame_size);
+        bt_a2dp_decode_frame(num_frames - ctx.request_frames, bt_i2s_get_playback_delay_us());
+    }
+
+    /* Rest is silenced by the stream */
+    const uint32_t frames_filled = num_frames - ctx.request_frames;
+    ctx.request_frames = 0;
+    return frames_filled;
+}
+
+static void HOT_PATH_FUNC(bt_a2dp_read_samples_callback)(int16_t *buffer, uint16_t num_frames)
+{
+    /* Not configured yet, keep the output running on silence */
+    if (ctx.sbc_frame_size == 0) {
+        memset(buffer, 0, num_frames * BT_A2DP_BYTES_PER_FRAME);
+        return;
+    }
+
+    /* Stopped stream has been faded out - drop whatever is left, it would be stale on resume */
+    if (bt_playout_stream_read(&ctx.stream, buffer, num_frames, bt_a2dp_fill_samples, NULL)) {
+        btstack_ring_buffer_reset(&ctx.decoded_audio_ring_buffer);
+        btstack_ring_buffer_reset(&ctx.sbc_frame_ring_buffer);
+        bt_a2dp_latency_probe_reset();
+    }
+}
+
+static void bt_a2dp_jitter_target_init(void)
+{
+    bt_jitter_policy_init(&ctx.jitter_policy, BT_A2DP_SBC_FRAMES_TARGET_LOW_BOUND, BT_A2DP_SBC_FRAMES_TARGET_HIGH_BOUND, BT_A2DP_SBC_FRAMES_COUNT_MIN);
+    ctx.frames_target = BT_A2DP_SBC_FRAMES_COUNT_MIN;
+    ctx.jitter_update_time_ms = btstack_run_loop_get_time_ms();
+}
+
+static void bt_a2dp_jitter_target_update(uint16_t sequence_number)
+{
+    const uint32_t now_ms = btstack_run_loop_get_time_ms();
+    bt_jitter_policy_packet_arrived(&ctx.jitter_policy, now_ms, sequence_number);
+
+    if ((now_ms - ctx.jitter_update_time_ms) < BT_A2DP_JITTER_UPDATE_INTERVAL_MS) {
+        return;
+    }
+    ctx.jitter_update_time_ms = now_ms;
+
+    bt_jitter_policy_set_rssi(&ctx.jitter_policy, bt_link_quality_get_rssi());
+    const uint32_t frames_per_second = ctx.sbc_config.sampling_frequency / (ctx.sbc_config.block_length * ctx.sbc_config.subbands);
+    const uint32_t frames_target = bt_jitter_policy_update(&ctx.jitter_policy, frames_per_second);
+    if (frames_target != ctx.frames_target) {
+        DEBUG_LOG("A2DP: jitter buffer target %lu frames\n", (unsigned long)frames_target);
+        ctx.frames_target = frames_target;
+    }
+}
+
+static void bt_a2dp_sink_initialized(const sbc_configuration_t *config)
+{
+    /* Primer depends on sink DMA period */
+    const uint32_t samples_per_sbc_frame = config->block_length * config->subbands;
+    bt_playout_policy_init(&ctx.playout_policy, config->sampling_frequency, samples_per_sbc_frame, bt_i2s_get_period_frames());
+
+    /* Sink init takes volume back, it is handed over again for each stream */
+    ctx.subband_volume = BT_A2DP_SUBBAND_VOLUME_ENABLED && bt_i2s_offload_volume();
+    ctx.pcm_volume_steps = 0;
+    ctx.subband_volume_frames = 0;
+    ctx.pcm_volume_frames = 0;
+    if (BT_A2DP_SUBBAND_VOLUME_ENABLED && !ctx.subband_volume) {
+        DEBUG_LOG("A2DP: subband volume not available with AGC, volume applied by sink\n");
     }
 }
 
@@ -121,30 +308,106 @@ static void bt_a2dp_media_processing_init(const sbc_configuration_t *config)
 
     btstack_sbc_decoder_init(&ctx.sbc_decoder, SBC_MODE_STANDARD, bt_a2dp_sbc_decoder_callback, NULL);
     btstack_ring_buffer_init(&ctx.sbc_frame_ring_buffer, ctx.sbc_frame_storage, sizeof(ctx.sbc_frame_storage));
+    bt_a2dp_latency_probe_reset();
     btstack_ring_buffer_init(&ctx.decoded_audio_ring_buffer, ctx.decoded_audio_storage, sizeof(ctx.decoded_audio_storage));
-    btstack_resample_init(&ctx.resampler, config->num_channels);
+    audio_dsp_resample_init(&ctx.resampler, config->num_channels);
+    bt_a2dp_jitter_target_init();
 
     const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
     if (audio != NULL) {
         audio->init(config->num_channels, config->sampling_frequency, bt_a2dp_read_samples_callback);
     } 
+    bt_a2dp_sink_initialized(config);
+
+    if (BT_A2DP_DECODE_AHEAD_ENABLED) {
+        btstack_run_loop_set_timer_handler(&ctx.decode_ahead_timer, bt_a2dp_decode_ahead_task);
+        btstack_run_loop_set_timer(&ctx.decode_ahead_timer, BT_A2DP_DECODE_AHEAD_INTERVAL_MS);
+        btstack_run_loop_add_timer(&ctx.decode_ahead_timer);
+    }
 
-    ctx.stream_started = false;
+    bt_playout_stream_init(&ctx.stream);
     ctx.media_initialized = true;
 }
 
+static void bt_a2dp_media_processing_retune(const sbc_configuration_t *config)
+{
+    const uint32_t start_time_us = time_us_32();
+
+    /* Previous stream has been faded out, the new one will fade in on start */
+    ctx.reconfigure_pending = false;
+    bt_playout_stream_init(&ctx.stream);
+    ctx.sbc_frame_size = 0;
+
+    btstack_sbc_decoder_init(&ctx.sbc_decoder, SBC_MODE_STANDARD, bt_a2dp_sbc_decoder_callback, NULL);
+    btstack_ring_buffer_reset(&ctx.sbc_frame_ring_buffer);
+    btstack_ring_buffer_reset(&ctx.decoded_audio_ring_buffer);
+    bt_a2dp_latency_probe_reset();
+    audio_dsp_resample_init(&ctx.resampler, config->num_channels);
+    bt_a2dp_jitter_target_init();
+
+    /* Sink is already initialized, so this only retunes it without tearing the output down */
+    const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
+    if (audio != NULL) {
+        audio->init(config->num_channels, config->sampling_frequency, bt_a2dp_read_samples_callback);
+    }
+    bt_a2dp_sink_initialized(config);
+
+    ctx.reconfiguration_time_us = time_us_32() - start_time_us;
+    DEBUG_LOG("A2DP: reconfigured to %u Hz in %lu us\n", config->sampling_frequency, (unsigned long)ctx.reconfiguration_time_us);
+}
+
+static void bt_a2dp_reconfigure_task(btstack_timer_source_t *ts)
+{
+    bt_a2dp_media_processing_retune(&ctx.sbc_config);
+}
+
+static void bt_a2dp_media_processing_reconfigure(const sbc_configuration_t *config)
+{
+    if (!ctx.media_initialized) {
+        bt_a2dp_media_processing_init(config);
+        return;
+    }
+
+    /* Suspended and already faded out, nothing of the old stream is left in the output */
+    if (bt_playout_stream_is_idle(&ctx.stream)) {
+        bt_a2dp_media_processing_retune(config);
+        return;
+    }
+
+    /* Reconfigured without suspend - the clock change would cut the old stream mid-period and play its tail at
+     * the new rate. Fade it out in the queued buffer now and retune only after that has been played. Both
+     * streams can't be mixed instead, output runs at one rate at a time. */
+    bt_playout_stream_stop(&ctx.stream);
+    ctx.reconfigure_pending = true;
+    bt_i2s_refill_queued_buffer();
+
+    btstack_run_loop_set_timer_handler(&ctx.reconfigure_timer, bt_a2dp_reconfigure_task);
+    btstack_run_loop_set_timer(&ctx.reconfigure_timer, (bt_i2s_get_queued_delay_us() / 1000) + 1);
+    btstack_run_loop_add_timer(&ctx.reconfigure_timer);
+}
+
 static void bt_a2dp_media_processing_start(void)
 {
     if (!ctx.media_initialized) {
         return;
     }
 
+    /* Set before starting the sink, as it pulls the first buffers right away */
+    bt_playout_stream_start(&ctx.stream);
+
     const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
     if (audio != NULL) {
         audio->start_stream();
     }
 
-    ctx.stream_started = true;
+    ctx.start_latency_ms = btstack_run_loop_get_time_ms() - ctx.first_packet_time_ms;
+    DEBUG_LOG("A2DP: first packet to audio %lu ms\n", (unsigned long)ctx.start_latency_ms);
+
+    /* Track startup latency, measured from power-on */
+    if (ctx.time_to_audio_ms == 0) {
+        ctx.time_to_audio_ms = btstack_run_loop_get_time_ms();
+        DEBUG_LOG("A2DP: time to audio %lu ms\n", (unsigned long)ctx.time_to_audio_ms);
+    }
 }
 
 static void bt_a2dp_media_processing_pause(void)
@@ -153,15 +416,20 @@ static void bt_a2dp_media_processing_pause(void)
         return;
     }
 
-    ctx.stream_started = false;
-    
-    const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
-    if (audio != NULL) {
-        audio->stop_stream();
+    if (ctx.subband_volume) {
+        DEBUG_LOG("A2DP: volume in subband domain for %lu frames, as PCM gain for %lu frames\n", (unsigned long)ctx.subband_volume_frames, (unsigned long)ctx.pcm_volume_frames);
     }
 
-    btstack_ring_buffer_reset(&ctx.decoded_audio_ring_buffer);
-    btstack_ring_buffer_reset(&ctx.sbc_frame_ring_buffer);
+    /* Gap across suspend says nothing about the link */
+    bt_jitter_policy_reset_arrivals(&ctx.jitter_policy);
+
+    /* Output keeps running, decoder and resampler stay warm - buffered audio is faded out in next period. Suspended
+     * while still prebuffering, nothing has been played yet and it is dropped right away. */
+    if (!bt_playout_stream_stop(&ctx.stream)) {
+        btstack_ring_buffer_reset(&ctx.decoded_audio_ring_buffer);
+        btstack_ring_buffer_reset(&ctx.sbc_frame_ring_buffer);
+        bt_a2dp_latency_probe_reset();
+    }
 }
 
 static void bt_a2dp_media_processing_close(void)
@@ -171,9 +439,13 @@ static void bt_a2dp_media_processing_close(void)
     }
 
     ctx.media_initialized = false;
-    ctx.stream_started = false;
+    bt_playout_stream_init(&ctx.stream);
+    ctx.reconfigure_pending = false;
     ctx.sbc_frame_size = 0;
 
+    btstack_run_loop_remove_timer(&ctx.decode_ahead_timer);
+    btstack_run_loop_remove_timer(&ctx.reconfigure_timer);
+
     const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
     if (audio != NULL) {
         audio->close();
@@ -209,6 +481,7 @@ static void bt_a2dp_packet_handler(uint8_t packet_type, uint16_t channel, uint8_
     uint8_t allocation_method;
     uint8_t channel_mode;
     uint8_t status;
+    bd_addr_t addr;
 
     const uint8_t event = hci_event_a2dp_meta_get_subevent_code(packet);
     switch (event) {
@@ -231,27 +504,38 @@ static void bt_a2dp_packet_handler(uint8_t packet_type, uint16_t channel, uint8_
         
         case A2DP_SUBEVENT_STREAM_ESTABLISHED:
             status = a2dp_subevent_stream_established_get_status(packet);
+            a2dp_subevent_stream_established_get_bd_addr(packet, addr);
             if (status != ERROR_CODE_SUCCESS) {
+                bt_reconnect_stream_failed(addr);
                 break;
             }
 
             ctx.seid = a2dp_subevent_stream_established_get_local_seid(packet);
+            bt_reconnect_source_connected(addr);
             cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, true); // Indicate that the stream has been established
 
             break;
 
         case A2DP_SUBEVENT_STREAM_STARTED:
+            /* Output belongs to the voice path until the call audio is released */
+            if (ctx.voice_call_active) {
+                ctx.resume_after_call = true;
+                break;
+            }
             if (ctx.sbc_config.reconfigure) {
-                bt_a2dp_media_processing_close();
+                bt_a2dp_media_processing_reconfigure(&ctx.sbc_config);
+                ctx.sbc_config.reconfigure = 0;
             }
             bt_a2dp_media_processing_init(&ctx.sbc_config);
             break;
 
         case A2DP_SUBEVENT_STREAM_SUSPENDED:
             bt_a2dp_media_processing_pause();
+            bt_flow_control_stream_suspended();
             break;
 
         case A2DP_SUBEVENT_STREAM_RELEASED:
+            ctx.resume_after_call = false;
             bt_a2dp_media_processing_close();
             cyw43_arch_gpio_put(CYW43_WL_GPIO_LED_PIN, false); // Indicate that the stream has been released
             break;
@@ -314,6 +598,11 @@ static bool bt_a2dp_read_media_header(uint8_t *packet, uint16_t size, uint32_t *
 
 static void bt_a2dp_media_handler(uint8_t seid, uint8_t *packet, uint16_t size)
 {
+    /* Source may keep streaming during a call, output is not ours then. New stream waits until the old one has faded out. */
+    if (!ctx.media_initialized || ctx.reconfigure_pending) {
+        return;
+    }
+
     uint32_t offset = 0;
 
     avdtp_media_packet_header_t media_header;
@@ -326,40 +615,102 @@ static void bt_a2dp_media_handler(uint8_t seid, uint8_t *packet, uint16_t size)
         return;
     }
 
+    if (!bt_playout_stream_is_started(&ctx.stream) && (btstack_ring_buffer_bytes_available(&ctx.sbc_frame_ring_buffer) == 0)) {
+        ctx.first_packet_time_ms = btstack_run_loop_get_time_ms();
+    }
+
+    bt_a2dp_jitter_target_update(media_header.sequence_number);
+
     const uint32_t packet_length = size - offset;
     ctx.sbc_frame_size = packet_length / sbc_header.num_frames;
-    btstack_ring_buffer_write(&ctx.sbc_frame_ring_buffer, &packet[offset], packet_length);
-  
-    const uint32_t frames_in_buffer = btstack_ring_buffer_bytes_available(&ctx.sbc_frame_ring_buffer) / ctx.sbc_frame_size;
-
-    /* Decide on audio sync drift based on number of SBC frames in queue */
-    uint32_t resampling_factor = BT_A2DP_RESAMPLING_FACTOR_NOMINAL;
-    if (frames_in_buffer < BT_A2DP_SBC_FRAMES_COUNT_MIN) {
-        resampling_factor -= BT_A2DP_RESAMPLING_COMPENSATION; // Stretch samples
+    /* Full ring drops the whole packet, probe must not count its frames then */
+    if (btstack_ring_buffer_write(&ctx.sbc_frame_ring_buffer, &packet[offset], packet_length) == ERROR_CODE_SUCCESS) {
+        bt_latency_probe_packet_received(media_header.timestamp, sbc_header.num_frames);
     }
-    else if (frames_in_buffer > BT_A2DP_SBC_FRAMES_COUNT_MAX) {
-        resampling_factor += BT_A2DP_RESAMPLING_COMPENSATION; // Compress samples
+  
+    /* Count decoded lookahead in as well, in SBC frames */
+    const uint32_t samples_per_sbc_frame = ctx.sbc_config.block_length * ctx.sbc_config.subbands;
+    const uint32_t decoded_frames = btstack_ring_buffer_bytes_available(&ctx.decoded_audio_ring_buffer) / BT_A2DP_BYTES_PER_FRAME;
+    const uint32_t frames_in_buffer = (btstack_ring_buffer_bytes_available(&ctx.sbc_frame_ring_buffer) / ctx.sbc_frame_size) + (decoded_frames / samples_per_sbc_frame);
+
+    const uint32_t frames_high = btstack_min(ctx.frames_target + BT_A2DP_SBC_FRAMES_WINDOW, BT_A2DP_SBC_FRAMES_COUNT_MAX);
+    audio_dsp_resample_set_factor(&ctx.resampler, bt_playout_policy_update(&ctx.playout_policy, frames_in_buffer, ctx.frames_target, frames_high));
+
+    /* Start stream if not started yet and enough frames buffered. On resume the output is still running and
+     * only the queued buffer has to be refilled, so less is needed */
+    const uint32_t frames_to_start = BT_A2DP_FAST_START_ENABLED ? bt_playout_policy_frames_to_start(&ctx.playout_policy, bt_i2s_is_running()) : ctx.frames_target;
+    if (!bt_playout_stream_is_started(&ctx.stream) && (frames_in_buffer >= frames_to_start)) {
+        if (BT_A2DP_FAST_START_ENABLED) {
+            bt_playout_policy_started(&ctx.playout_policy);
+        }
+        bt_a2dp_media_processing_start();
     }
-    btstack_resample_set_factor(&ctx.resampler, resampling_factor);
 
-    /* Start stream if not started yet and enough frames buffered */
-    if (!ctx.stream_started && (frames_in_buffer >= BT_A2DP_SBC_FRAMES_COUNT_MIN)) {
-        bt_a2dp_media_processing_start();
+    /* Decoder is likely idle right after a packet, use it to top up lookahead */
+    if (BT_A2DP_DECODE_AHEAD_ENABLED) {
+        bt_a2dp_decode_ahead();
     }
 }
 
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_A2DP, bt_a2dp_packet_handler)
+
+static void bt_a2dp_media_handler_profiled(uint8_t seid, uint8_t *packet, uint16_t size)
+{
+    /* Media packets are nearly all ACL traffic while streaming, their host buffer is returned once this returns */
+    bt_flow_control_acl_received(size);
+    bt_profiler_enter(BT_PROFILER_HANDLER_A2DP_MEDIA);
+    bt_a2dp_media_handler(seid, packet, size);
+    bt_profiler_exit(BT_PROFILER_HANDLER_A2DP_MEDIA);
+    bt_flow_control_acl_processed();
+}
+
 void bt_a2dp_init(void)
 {
     const btstack_audio_sink_t *inst = bt_i2s_get_instance();
     btstack_audio_sink_set_instance(inst);
 
+    bt_latency_probe_init();
     a2dp_sink_init();
 
-    a2dp_sink_register_packet_handler(bt_a2dp_packet_handler);
-    a2dp_sink_register_media_handler(bt_a2dp_media_handler);
+    a2dp_sink_register_packet_handler(bt_a2dp_packet_handler_profiled);
+    a2dp_sink_register_media_handler(bt_a2dp_media_handler_profiled);
     
     avdtp_stream_endpoint_t *ep = a2dp_sink_create_stream_endpoint(AVDTP_AUDIO, AVDTP_CODEC_SBC, 
                                                                    sbc_capabilities, sizeof(sbc_capabilities), 
                                                                    ctx.codec_config, sizeof(ctx.codec_config));
     ctx.seid = avdtp_local_seid(ep);
 }
+
+void bt_a2dp_voice_call_started(void)
+{
+    ctx.voice_call_active = true;
+    ctx.resume_after_call = ctx.media_initialized;
+    bt_a2dp_media_processing_close();
+}
+
+void bt_a2dp_voice_call_ended(void)
+{
+    ctx.voice_call_active = false;
+
+    /* Set up from scratch, playback starts again once enough packets are buffered */
+    if (ctx.resume_after_call) {
+        ctx.resume_after_call = false;
+        ctx.sbc_config.reconfigure = 0;
+        bt_a2dp_media_processing_init(&ctx.sbc_config);
+    }
+}
+
+uint32_t bt_a2dp_get_reconfiguration_time_us(void)
+{
+    return ctx.reconfiguration_time_us;
+}
+
+uint32_t bt_a2dp_get_start_latency_ms(void)
+{
+    return ctx.start_latency_ms;
+}
+
+uint32_t bt_a2dp_get_time_to_audio_ms(void)
+{
+    return ctx.time_to_audio_ms;
+}
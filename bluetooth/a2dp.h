@@ -1,3 +1,10 @@
 #pragma once
 
+#include <stdint.h>
+
 void bt_a2dp_init(void);
+void bt_a2dp_voice_call_started(void); // Releases audio output to HFP
+void bt_a2dp_voice_call_ended(void);
+uint32_t bt_a2dp_get_reconfiguration_time_us(void);
+uint32_t bt_a2dp_get_start_latency_ms(void);
+uint32_t bt_a2dp_get_time_to_audio_ms(void);
@@ -1,4 +1,5 @@
 #include "avrcp.h"
+#include "profiler.h"
 #include <btstack.h>
 
 typedef struct
@@ -42,8 +43,9 @@ static void bt_avrcp_packet_handler(uint8_t packet_type, uint16_t channel, uint8
             avrcp_target_battery_status_changed(ctx.cid, AVRCP_BATTERY_STATUS_EXTERNAL); // TODO send real status when battery powered
 
             /* Set default volume */
-            avrcp_target_volume_changed(ctx.cid, BT_AVRCP_DEFAULT_VOLUME);
-            bt_avrcp_volume_change_callback(BT_AVRCP_DEFAULT_VOLUME);
+            ctx.volume = BT_AVRCP_DEFAULT_VOLUME;
+            avrcp_target_volume_changed(ctx.cid, ctx.volume);
+            bt_avrcp_volume_change_callback(ctx.volume);
 
             avrcp_controller_get_supported_events(ctx.cid);
             break;
@@ -102,13 +104,22 @@ static void bt_avrcp_target_packet_handler(uint8_t packet_type, uint16_t channel
     }
 }
 
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_AVRCP, bt_avrcp_packet_handler)
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_AVRCP_CONTROLLER, bt_avrcp_controller_packet_handler)
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_AVRCP_TARGET, bt_avrcp_target_packet_handler)
+
 void bt_avrcp_init(void)
 {
     avrcp_init();
     avrcp_controller_init();
     avrcp_target_init();
 
-    avrcp_register_packet_handler(bt_avrcp_packet_handler);
-    avrcp_controller_register_packet_handler(bt_avrcp_controller_packet_handler);
-    avrcp_target_register_packet_handler(bt_avrcp_target_packet_handler);
+    avrcp_register_packet_handler(bt_avrcp_packet_handler_profiled);
+    avrcp_controller_register_packet_handler(bt_avrcp_controller_packet_handler_profiled);
+    avrcp_target_register_packet_handler(bt_avrcp_target_packet_handler_profiled);
+}
+
+uint8_t bt_avrcp_get_volume(void)
+{
+    return ctx.volume;
 }
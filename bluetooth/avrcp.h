@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdint.h>
+
 #define BT_AVRCP_DEFAULT_VOLUME 64
 
 void bt_avrcp_init(void);
+uint8_t bt_avrcp_get_volume(void);
@@ -2,6 +2,11 @@
 #include "avrcp.h"
 #include "sdp.h"
 #include "a2dp.h"
+#include "hfp.h"
+#include "reconnect.h"
+#include "link_quality.h"
+#include "flow_control.h"
+#include "profiler.h"
 #include <errno.h>
 #include <hci.h>
 #include <l2cap.h>
@@ -34,6 +39,7 @@ static void bt_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
                 break;
             }
             gap_local_bd_addr(ctx.local_addr);
+            bt_reconnect_start();
             if (ctx.init_done_callback != NULL) {
                 ctx.init_done_callback(ctx.init_done_arg);
             }
@@ -49,6 +55,8 @@ static void bt_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *pa
     }
 }
 
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_HCI, bt_packet_handler)
+
 int bt_init(const char *name, const char *pin, bt_init_done_callback_t init_done_callback, void *init_done_arg)
 {
     if ((name == NULL) || (pin == NULL)) {
@@ -59,11 +67,17 @@ int bt_init(const char *name, const char *pin, bt_init_done_callback_t init_done
     ctx.init_done_callback = init_done_callback;
     ctx.init_done_arg = init_done_arg;
 
+    bt_profiler_init();
+    bt_flow_control_init();
+
     l2cap_init();
 
     bt_sdp_init();
     bt_a2dp_init();
     bt_avrcp_init();
+    bt_hfp_init();
+    bt_reconnect_init();
+    bt_link_quality_init();
 
     gap_set_local_name(name);
     gap_discoverable_control(1); // Allow to show up in Bluetooth inquiry
@@ -71,7 +85,7 @@ int bt_init(const char *name, const char *pin, bt_init_done_callback_t init_done
     gap_set_default_link_policy_settings(LM_LINK_POLICY_ENABLE_ROLE_SWITCH | LM_LINK_POLICY_ENABLE_SNIFF_MODE); // Allow for role switch in general and sniff mode
     gap_set_allow_role_switch(true); // Allow for role switch on outgoing connections
 
-    ctx.hci_registration.callback = bt_packet_handler;
+    ctx.hci_registration.callback = bt_packet_handler_profiled;
     hci_add_event_handler(&ctx.hci_registration);
 
     return 0;
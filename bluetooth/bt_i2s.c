@@ -1,13 +1,63 @@
 #include "bt_i2s.h"
+#include "profiler.h"
+#include <hot_path.h>
+#include <debug_log.h>
 #include <audio_i2s.h>
+#include <audio_dsp.h>
+#include <errno.h>
 #include <math.h>
+#include <string.h>
 #include <btstack.h>
 
 #define BT_I2S_VOLUME_MAX 127 // Max value according to AVRCP spec
+#define BT_I2S_VOLUME_STEPS_MAX 15
 
 #define BT_I2S_TASK_INTERVAL_MS 5
 #define BT_I2S_FRAMES_PER_BUFFER 1024
 
+/* Voice rates get short periods, so that DMA doesn't dominate HFP latency budget */
+#define BT_I2S_VOICE_SAMPLE_RATE_MAX 16000
+#define BT_I2S_VOICE_PERIOD_MS 4
+#define BT_I2S_VOICE_TASK_INTERVAL_MS 1
+
+#define BT_I2S_DATA_PIN 28
+#define BT_I2S_CLOCK_PIN_BASE 26
+
+/* Bi-amp mode - low band goes to the output above, high band to the second one */
+#ifndef BT_I2S_CROSSOVER_ENABLED
+#define BT_I2S_CROSSOVER_ENABLED 0
+#endif
+#define BT_I2S_CROSSOVER_FREQ_HZ 2000
+#define BT_I2S_TWEETER_DATA_PIN 22
+#define BT_I2S_TWEETER_CLOCK_PIN_BASE 20
+
+/* Output slot width - above 16 bits, volume and AGC write full precision int32_t samples to DMA buffers */
+#ifndef BT_I2S_SAMPLE_BITS
+#define BT_I2S_SAMPLE_BITS 16 // 16, 24 or 32
+#endif
+#ifndef BT_I2S_FORMAT
+#define BT_I2S_FORMAT AUDIO_I2S_FORMAT_I2S
+#endif
+#define BT_I2S_WIDE_SAMPLES (BT_I2S_SAMPLE_BITS > 16)
+
+#if BT_I2S_WIDE_SAMPLES && BT_I2S_CROSSOVER_ENABLED
+#error "Crossover works on 16-bit samples only"
+#endif
+
+/* Levels sources out and limits after volume, instead of plain volume scaling. Delays output by the limiter lookahead. */
+#ifndef BT_I2S_AGC_ENABLED
+#define BT_I2S_AGC_ENABLED 0
+#endif
+
+#if BT_I2S_AGC_ENABLED
+#define BT_I2S_AGC_DELAY_FRAMES AUDIO_DSP_AGC_LOOKAHEAD_FRAMES
+#if ((BT_I2S_FRAMES_PER_BUFFER % AUDIO_DSP_AGC_LOOKAHEAD_FRAMES) != 0) || (((8000 * BT_I2S_VOICE_PERIOD_MS / 1000) % AUDIO_DSP_AGC_LOOKAHEAD_FRAMES) != 0)
+#error "AGC needs DMA periods in multiples of its lookahead"
+#endif
+#else
+#define BT_I2S_AGC_DELAY_FRAMES 0
+#endif
+
 #define BT_I2S_CLAMP(val, min, max) MIN(max, MAX(val, min))
 
 typedef void (*bt_i2s_samples_callback_t)(int16_t *buffer, uint16_t samples_count);
@@ -15,107 +65,318 @@ typedef void (*bt_i2s_samples_callback_t)(int16_t *buffer, uint16_t samples_coun
 typedef struct 
 {
     bt_i2s_samples_callback_t samples_callback;
+    uint8_t channels;
+    uint32_t frames_per_buffer;
+    uint32_t task_interval_ms;
     audio_i2s_t i2s;
     audio_i2s_config_t i2s_config;
-    float volume;
+#if BT_I2S_CROSSOVER_ENABLED
+    audio_i2s_t i2s_tweeter;
+    audio_i2s_config_t i2s_tweeter_config;
+    audio_dsp_crossover_t crossover;
+#endif
+#if BT_I2S_AGC_ENABLED
+    audio_dsp_agc_t agc;
+#endif
+#if BT_I2S_WIDE_SAMPLES
+    int16_t pcm_buffer[BT_I2S_FRAMES_PER_BUFFER * 2]; // Decoded samples, before volume widens them
+#endif
+    int32_t gain;
+    uint8_t volume_steps;
+    bool volume_offloaded;
     volatile bool buffer_request;
+    uint32_t buffer_period_us;
+    uint32_t playback_delay_us; // Until the buffer being filled starts playing
+    bool running;
+    bool initialized;
     btstack_timer_source_t task_timer;
 } bt_i2s_ctx_t;
 
 static bt_i2s_ctx_t ctx;
 
-static void bt_i2s_dma_callback(void)
+static void bt_i2s_close(void);
+
+static void bt_i2s_print_format(void)
+{
+    /* DMA load of the chosen format, CPU cost of the conversion shows in bt_i2s_task profiler stats */
+    DEBUG_LOG("I2S: %lu Hz, %u-bit slots, %u DMA words per frame, %lu DMA words/s\n", (unsigned long)ctx.i2s_config.sample_rate,
+           ctx.i2s.slot_bits, ctx.i2s.words_per_frame, (unsigned long)(ctx.i2s_config.sample_rate * ctx.i2s.words_per_frame));
+}
+
+static void HOT_PATH_FUNC(bt_i2s_dma_callback)(void)
 {
     ctx.buffer_request = true;
+    bt_profiler_dma_irq();
     audio_i2s_clear_dma_irq(&ctx.i2s);
 }
 
-static void bt_i2s_scale_volume(int16_t *buffer, size_t frames_count)
+static void HOT_PATH_FUNC(bt_i2s_scale_volume)(int16_t *buffer, size_t frames_count)
+{
+#if BT_I2S_AGC_ENABLED
+    /* Volume is applied inside, before the limiter. Mute too, so that it ramps and the lookahead stays in step. */
+    audio_dsp_agc_process(&ctx.agc, buffer, frames_count, ctx.gain);
+#else
+    /* Muted is just a memset */
+    if (ctx.gain == 0) {
+        memset(buffer, 0, frames_count * 2 * sizeof(int16_t));
+        return;
+    }
+
+    /* Full volume, or volume already applied by the source, costs nothing */
+    if ((ctx.gain == AUDIO_DSP_GAIN_UNITY) || ctx.volume_offloaded) {
+        return;
+    }
+
+    /* Integer multiply only, M0+ has no FPU */
+    audio_dsp_gain_stereo(buffer, frames_count, ctx.gain);
+#endif
+}
+
+static void HOT_PATH_FUNC(bt_i2s_scale_volume_32)(const int16_t *pcm, int32_t *buffer, size_t frames_count)
+{
+#if BT_I2S_AGC_ENABLED
+    audio_dsp_agc_process_32(&ctx.agc, pcm, buffer, frames_count, ctx.gain);
+#else
+    if (ctx.gain == 0) {
+        memset(buffer, 0, frames_count * 2 * sizeof(int32_t));
+        return;
+    }
+
+    audio_dsp_gain_stereo_32(pcm, buffer, frames_count, ctx.volume_offloaded ? AUDIO_DSP_GAIN_UNITY : ctx.gain);
+#endif
+}
+
+static void HOT_PATH_FUNC(bt_i2s_mono_to_stereo)(int16_t *buffer, size_t frames_count)
 {
-    for (size_t i = 0; i < frames_count; ++i) {
-        buffer[2 * i] *= ctx.volume;
-        buffer[2 * i + 1] *= ctx.volume;
+    /* In place, from the end so that no sample is overwritten before it is copied */
+    for (size_t i = frames_count; i > 0; --i) {
+        const int16_t sample = buffer[i - 1];
+        buffer[2 * i - 1] = sample;
+        buffer[2 * i - 2] = sample;
     }
 }
 
-static void bt_i2s_fill_next_buffer(void)
+static void HOT_PATH_FUNC(bt_i2s_fill_buffer)(void *buffer, void *tweeter_buffer)
 {
-    int16_t *buffer = audio_i2s_get_next_buffer(&ctx.i2s);
-    ctx.samples_callback(buffer, BT_I2S_FRAMES_PER_BUFFER);
+#if BT_I2S_WIDE_SAMPLES
+    int16_t *pcm = ctx.pcm_buffer;
+#else
+    int16_t *pcm = buffer;
+#endif
 
-    // TODO duplicate samples for mono
+    ctx.samples_callback(pcm, ctx.frames_per_buffer);
 
-    bt_i2s_scale_volume(buffer, BT_I2S_FRAMES_PER_BUFFER);
+    if (ctx.channels == 1) {
+        bt_i2s_mono_to_stereo(pcm, ctx.frames_per_buffer);
+    }
+
+#if BT_I2S_WIDE_SAMPLES
+    bt_i2s_scale_volume_32(pcm, buffer, ctx.frames_per_buffer);
+#else
+    bt_i2s_scale_volume(pcm, ctx.frames_per_buffer);
+#endif
+
+#if BT_I2S_CROSSOVER_ENABLED
+    /* Split in place, woofer gets low band in the original buffer */
+    audio_dsp_crossover_process(&ctx.crossover, buffer, buffer, tweeter_buffer, ctx.frames_per_buffer);
+#else
+    (void)tweeter_buffer;
+#endif
 }
 
-static void bt_i2s_task(btstack_timer_source_t *ts)
+static void HOT_PATH_FUNC(bt_i2s_fill_next_buffer)(void)
 {
+    ctx.playback_delay_us = ((uint64_t)(audio_i2s_get_remaining_frames(&ctx.i2s) + BT_I2S_AGC_DELAY_FRAMES) * 1000000U) / ctx.i2s_config.sample_rate;
+
+#if BT_I2S_CROSSOVER_ENABLED
+    bt_i2s_fill_buffer(audio_i2s_get_next_buffer(&ctx.i2s), audio_i2s_get_next_buffer(&ctx.i2s_tweeter));
+#else
+    bt_i2s_fill_buffer(audio_i2s_get_next_buffer(&ctx.i2s), NULL);
+#endif
+}
+
+static void bt_i2s_fill_current_buffer(void)
+{
+    ctx.playback_delay_us = ((uint64_t)BT_I2S_AGC_DELAY_FRAMES * 1000000U) / ctx.i2s_config.sample_rate;
+
+#if BT_I2S_CROSSOVER_ENABLED
+    bt_i2s_fill_buffer(audio_i2s_get_current_buffer(&ctx.i2s), audio_i2s_get_current_buffer(&ctx.i2s_tweeter));
+#else
+    bt_i2s_fill_buffer(audio_i2s_get_current_buffer(&ctx.i2s), NULL);
+#endif
+}
+
+static void bt_i2s_enable(bool enabled)
+{
+#if BT_I2S_CROSSOVER_ENABLED
+    /* Both state machines share a PIO block and divider, start them in the same cycle */
+    audio_i2s_t *const outputs[] = {&ctx.i2s, &ctx.i2s_tweeter};
+    audio_i2s_enable_synced(outputs, count_of(outputs), enabled);
+#else
+    audio_i2s_enable(&ctx.i2s, enabled);
+#endif
+}
+
+static void HOT_PATH_FUNC(bt_i2s_task)(btstack_timer_source_t *ts)
+{
+    bt_profiler_enter(BT_PROFILER_HANDLER_I2S_TASK);
+
     if (ctx.buffer_request) {
         bt_i2s_fill_next_buffer();
         ctx.buffer_request = false;
+        bt_profiler_refill_done(ctx.buffer_period_us); // Refill has to be done before the other buffer runs out
     }
 
+    bt_profiler_exit(BT_PROFILER_HANDLER_I2S_TASK);
+
     /* Restart timer */
-    btstack_run_loop_set_timer(ts, BT_I2S_TASK_INTERVAL_MS);
+    btstack_run_loop_set_timer(ts, ctx.task_interval_ms);
     btstack_run_loop_add_timer(ts);
 }
 
 static int bt_i2s_audio_init(uint8_t channels, uint32_t sample_rate, bt_i2s_samples_callback_t samples_callback)
 {
     ctx.samples_callback = samples_callback;
+    ctx.channels = channels;
     ctx.buffer_request = false;
+    ctx.volume_offloaded = false;
+
+    if (sample_rate <= BT_I2S_VOICE_SAMPLE_RATE_MAX) {
+        ctx.frames_per_buffer = (sample_rate * BT_I2S_VOICE_PERIOD_MS) / 1000;
+        ctx.task_interval_ms = BT_I2S_VOICE_TASK_INTERVAL_MS;
+    }
+    else {
+        ctx.frames_per_buffer = BT_I2S_FRAMES_PER_BUFFER;
+        ctx.task_interval_ms = BT_I2S_TASK_INTERVAL_MS;
+    }
     
     ctx.i2s_config.pio = pio0;
-    ctx.i2s_config.data_pin = 28;
-    ctx.i2s_config.clock_pin_base = 26;
-    ctx.i2s_config.sample_size = sizeof(int16_t);
-    ctx.i2s_config.buffer_frames_count = BT_I2S_FRAMES_PER_BUFFER;
+    ctx.i2s_config.data_pin = BT_I2S_DATA_PIN;
+    ctx.i2s_config.clock_pin_base = BT_I2S_CLOCK_PIN_BASE;
+    ctx.i2s_config.sample_size = BT_I2S_WIDE_SAMPLES ? sizeof(int32_t) : sizeof(int16_t);
+    ctx.i2s_config.slot_bits = BT_I2S_SAMPLE_BITS;
+    ctx.i2s_config.format = BT_I2S_FORMAT;
+    ctx.i2s_config.buffer_frames_count = ctx.frames_per_buffer;
     ctx.i2s_config.dma_handler = bt_i2s_dma_callback;
     ctx.i2s_config.sample_rate = sample_rate;
+    ctx.buffer_period_us = ((uint64_t)ctx.frames_per_buffer * 1000000U) / sample_rate;
+
+#if BT_I2S_AGC_ENABLED
+    /* Envelope is tracked per DMA period */
+    audio_dsp_agc_init(&ctx.agc, sample_rate, ctx.frames_per_buffer);
+#endif
+
+#if BT_I2S_CROSSOVER_ENABLED
+    /* Same clock and geometry, refilled from the woofer output DMA interrupt */
+    ctx.i2s_tweeter_config = ctx.i2s_config;
+    ctx.i2s_tweeter_config.data_pin = BT_I2S_TWEETER_DATA_PIN;
+    ctx.i2s_tweeter_config.clock_pin_base = BT_I2S_TWEETER_CLOCK_PIN_BASE;
+    ctx.i2s_tweeter_config.dma_handler = NULL;
+    ctx.i2s_tweeter_config.program_owner = &ctx.i2s; // Same program at the same offset, only a second state machine
+    audio_dsp_crossover_init(&ctx.crossover, sample_rate, BT_I2S_CROSSOVER_FREQ_HZ);
+#endif
+
+    /* Already set up - only retune clock and buffers, PIO program and DMA channels stay in place */
+    int err;
+    if (ctx.initialized) {
+        err = audio_i2s_reconfigure(&ctx.i2s);
+#if BT_I2S_CROSSOVER_ENABLED
+        if (!err) {
+            err = audio_i2s_reconfigure(&ctx.i2s_tweeter);
+        }
+#endif
+        if (!err) {
+            bt_i2s_print_format();
+        }
+        if (err != -ENOMEM) {
+            return err;
+        }
+
+        /* Periods grew past the buffers allocated before (voice to music), set up from scratch */
+        bt_i2s_close();
+    }
 
     ctx.i2s.config = &ctx.i2s_config;
-    audio_i2s_init(&ctx.i2s);
+    err = audio_i2s_init(&ctx.i2s);
+    if (err) {
+        return err;
+    }
+
+#if BT_I2S_CROSSOVER_ENABLED
+    ctx.i2s_tweeter.config = &ctx.i2s_tweeter_config;
+    err = audio_i2s_init(&ctx.i2s_tweeter);
+    if (err) {
+        audio_i2s_deinit(&ctx.i2s);
+        return err;
+    }
+#endif
 
+    ctx.initialized = true;
+    bt_i2s_print_format();
     return 0;
 }
 
 static void bt_i2s_start_stream(void)
 {
+    /* Resume - queued buffer holds silence, refill it right away so audio begins when the current period ends */
+    if (ctx.running) {
+        bt_i2s_refill_queued_buffer();
+        return;
+    }
+
+    /* Fill the buffer already queued to PIO as well, so that playback doesn't begin with a period of silence */
+    bt_i2s_fill_current_buffer();
     bt_i2s_fill_next_buffer();
 
     /* Create timer that will repeatedly call I2S task function */
     btstack_run_loop_set_timer_handler(&ctx.task_timer, bt_i2s_task);
-    btstack_run_loop_set_timer(&ctx.task_timer, BT_I2S_TASK_INTERVAL_MS);
+    btstack_run_loop_set_timer(&ctx.task_timer, ctx.task_interval_ms);
     btstack_run_loop_add_timer(&ctx.task_timer);
 
     /* Start playback */
-    audio_i2s_enable(&ctx.i2s, true);
+    bt_i2s_enable(true);
+    ctx.running = true;
 }
 
 static void bt_i2s_stop_stream(void)
 {
-    audio_i2s_enable(&ctx.i2s, false);
+    bt_i2s_enable(false);
     btstack_run_loop_remove_timer(&ctx.task_timer);
+    ctx.running = false;
 }
 
 static void bt_i2s_close(void)
 {
+    if (!ctx.initialized) {
+        return;
+    }
+
     bt_i2s_stop_stream();
+#if BT_I2S_CROSSOVER_ENABLED
+    /* Runs program owned by the woofer output, goes first */
+    audio_i2s_deinit(&ctx.i2s_tweeter);
+#endif
     audio_i2s_deinit(&ctx.i2s);
+    ctx.initialized = false;
 }
 
 static void bt_i2s_audio_set_volume(uint8_t volume)
 {
     if (volume == 0) {
-        ctx.volume = 0.0f;
+        ctx.gain = 0;
         return;
     }
 
+    /* Float math only here, on volume change. Gain is stored in Q15, so at the lowest
+     * volume steps (gain ~0.001, i.e. ~34 in Q15) the step is quantized with up to ~3% error */
     const float volume_normalized = volume / (float)BT_I2S_VOLUME_MAX;
     const float a = 1e-3f;
     const float b = 6.908f;
-    ctx.volume = a * expf(b * volume_normalized);
-	ctx.volume = BT_I2S_CLAMP(ctx.volume, 0.0f, 1.0f);
+    float volume_linear = a * expf(b * volume_normalized);
+    volume_linear = BT_I2S_CLAMP(volume_linear, 0.0f, 1.0f);
+    ctx.gain = (int32_t)(volume_linear * AUDIO_DSP_GAIN_UNITY + 0.5f);
+    /* Mute is handled by gain alone */
+    ctx.volume_steps = (volume_linear > 0.0f) ? (uint8_t)BT_I2S_CLAMP(lroundf(-log2f(volume_linear)), 0, BT_I2S_VOLUME_STEPS_MAX) : BT_I2S_VOLUME_STEPS_MAX;
 }
 
 static const btstack_audio_sink_t bt_i2s_sink = {
@@ -126,6 +387,54 @@ static const btstack_audio_sink_t bt_i2s_sink = {
     .set_volume = bt_i2s_audio_set_volume
 };
 
+uint32_t HOT_PATH_FUNC(bt_i2s_get_playback_delay_us)(void)
+{
+    return ctx.playback_delay_us;
+}
+
+uint32_t HOT_PATH_FUNC(bt_i2s_get_queued_delay_us)(void)
+{
+    /* Rest of the buffer being played, plus the next one unless it is waiting for refill */
+    uint32_t frames = audio_i2s_get_remaining_frames(&ctx.i2s) + BT_I2S_AGC_DELAY_FRAMES;
+    if (!ctx.buffer_request) {
+        frames += ctx.frames_per_buffer;
+    }
+    return ((uint64_t)frames * 1000000U) / ctx.i2s_config.sample_rate;
+}
+
+uint32_t bt_i2s_get_period_frames(void)
+{
+    return ctx.frames_per_buffer;
+}
+
+void bt_i2s_refill_queued_buffer(void)
+{
+    /* Not being sent yet, so it can be overwritten with fresher samples */
+    ctx.buffer_request = false;
+    bt_i2s_fill_next_buffer();
+}
+
+bool bt_i2s_offload_volume(void)
+{
+#if BT_I2S_AGC_ENABLED
+    /* AGC has to see the signal before volume, so volume stays in it */
+    return false;
+#else
+    ctx.volume_offloaded = true;
+    return true;
+#endif
+}
+
+uint8_t HOT_PATH_FUNC(bt_i2s_get_volume_steps)(void)
+{
+    return ctx.volume_steps;
+}
+
+bool bt_i2s_is_running(void)
+{
+    return ctx.running;
+}
+
 const btstack_audio_sink_t *bt_i2s_get_instance(void)
 {
     return &bt_i2s_sink;
@@ -3,3 +3,12 @@
 #include <btstack_audio.h>
 
 const btstack_audio_sink_t *bt_i2s_get_instance(void);
+uint32_t bt_i2s_get_playback_delay_us(void);
+uint32_t bt_i2s_get_queued_delay_us(void);
+uint32_t bt_i2s_get_period_frames(void);
+bool bt_i2s_is_running(void);
+void bt_i2s_refill_queued_buffer(void);
+/* Source takes over volume scaling (except mute), e.g. in SBC subband domain. Reset on init, refused with AGC. */
+bool bt_i2s_offload_volume(void);
+/* Volume rounded to whole 6 dB steps of attenuation */
+uint8_t bt_i2s_get_volume_steps(void);
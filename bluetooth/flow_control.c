@@ -0,0 +1,223 @@
+#include "flow_control.h"
+#include <btstack.h>
+#include <btstack_tlv.h>
+#include <pico/time.h>
+#include <debug_log.h>
+
+#define BT_FLOW_CONTROL_TLV_TAG (((uint32_t)'H' << 24) | ((uint32_t)'F' << 16) | ((uint32_t)'C' << 8) | '0')
+#define BT_FLOW_CONTROL_WINDOW_MS 2000
+#define BT_FLOW_CONTROL_LINK_TYPE_ACL 0x01 // Connection Complete link type, SCO is 0x00
+
+#if HCI_HOST_ACL_PACKET_NUM != BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX
+#error "Pool can't grow beyond what BTstack tells the controller on init, see flow_control.h"
+#endif
+
+typedef enum
+{
+    BT_FLOW_CONTROL_APPLY_IDLE = 0,
+    BT_FLOW_CONTROL_APPLY_PENDING, // Waits for all ACL links to go down and a free command slot
+    BT_FLOW_CONTROL_APPLY_W4_COMPLETE
+} bt_flow_control_apply_t;
+
+typedef struct
+{
+    btstack_packet_callback_registration_t hci_registration;
+    const btstack_tlv_t *tlv_impl;
+    void *tlv_context;
+    btstack_timer_source_t window_timer;
+    bt_flow_policy_t policy;
+    bt_flow_policy_stats_t stats;
+    hci_con_handle_t acl_handles[MAX_NR_HCI_CONNECTIONS];
+    uint16_t packet_num; // Controller has been told about
+    uint16_t wanted_packet_num; // Stored, applied when possible
+    uint16_t sent_packet_num; // Waiting for command complete
+    uint16_t stored_packet_num;
+    bt_flow_control_apply_t apply;
+} bt_flow_control_ctx_t;
+
+static bt_flow_control_ctx_t ctx;
+
+static bool bt_flow_control_acl_links_down(void)
+{
+    for (uint8_t i = 0; i < MAX_NR_HCI_CONNECTIONS; ++i) {
+        if (ctx.acl_handles[i] != HCI_CON_HANDLE_INVALID) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void bt_flow_control_track_link(hci_con_handle_t old_handle, hci_con_handle_t new_handle)
+{
+    for (uint8_t i = 0; i < MAX_NR_HCI_CONNECTIONS; ++i) {
+        if (ctx.acl_handles[i] == old_handle) {
+            ctx.acl_handles[i] = new_handle;
+            return;
+        }
+    }
+}
+
+/* Host_Buffer_Size is sent by BTstack only on init, with no link up the controller has nothing outstanding and
+ * can take a new pool size the same way */
+static void bt_flow_control_apply(void)
+{
+    if ((ctx.apply != BT_FLOW_CONTROL_APPLY_PENDING) || !bt_flow_control_acl_links_down() ||
+        (hci_get_state() != HCI_STATE_WORKING) || !hci_can_send_command_packet_now()) {
+        return;
+    }
+
+    if (hci_send_cmd(&hci_host_buffer_size, HCI_HOST_ACL_PACKET_LEN, HCI_HOST_SCO_PACKET_LEN, ctx.wanted_packet_num, HCI_HOST_SCO_PACKET_NUM) == ERROR_CODE_SUCCESS) {
+        ctx.sent_packet_num = ctx.wanted_packet_num;
+        ctx.apply = BT_FLOW_CONTROL_APPLY_W4_COMPLETE;
+    }
+}
+
+static void bt_flow_control_applied(const uint8_t *packet)
+{
+    const uint8_t status = hci_event_command_complete_get_return_parameters(packet)[0];
+    if (status == ERROR_CODE_SUCCESS) {
+        DEBUG_LOG("HCI: host ACL buffers %u -> %u\n", ctx.packet_num, ctx.sent_packet_num);
+        ctx.packet_num = ctx.sent_packet_num;
+        bt_flow_policy_set_packets(&ctx.policy, ctx.packet_num);
+    }
+    else if (ctx.wanted_packet_num == ctx.sent_packet_num) {
+        /* Controller keeps the old size, don't retry it with every event */
+        DEBUG_LOG("HCI: host ACL buffers %u rejected, status 0x%02x\n", ctx.sent_packet_num, status);
+        ctx.wanted_packet_num = ctx.packet_num;
+    }
+
+    /* Another size may have been concluded meanwhile */
+    ctx.apply = (ctx.wanted_packet_num != ctx.packet_num) ? BT_FLOW_CONTROL_APPLY_PENDING : BT_FLOW_CONTROL_APPLY_IDLE;
+}
+
+static void bt_flow_control_window_task(btstack_timer_source_t *ts)
+{
+    bt_flow_policy_update(&ctx.policy, time_us_32(), &ctx.stats);
+
+    if (ctx.stats.throughput_bps > 0) {
+        DEBUG_LOG("HCI: ACL %lu kbit/s, host buffer in use avg %lu.%02lu, burst max %u/%u, stall %lu ms, turnaround max %lu us, votes grow %u shrink %u of %u\n",
+               (unsigned long)(ctx.stats.throughput_bps / 1000),
+               (unsigned long)(ctx.stats.occupancy_avg_x100 / 100), (unsigned long)(ctx.stats.occupancy_avg_x100 % 100),
+               ctx.stats.burst_max, ctx.packet_num, (unsigned long)(ctx.stats.stall_us / 1000), (unsigned long)ctx.stats.turnaround_max_us,
+               ctx.stats.grow_votes, ctx.stats.shrink_votes, ctx.stats.windows);
+    }
+
+    /* Event driven otherwise, this retries a pending pool size on an idle stack */
+    bt_flow_control_apply();
+
+    /* Restart timer */
+    btstack_run_loop_set_timer(ts, BT_FLOW_CONTROL_WINDOW_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
+/* Once per connection or stream, flash write stalls XIP and with it the audio path - not something to do every window.
+ * Stored size is what the next power on starts with as well. */
+static void bt_flow_control_store(void)
+{
+    uint16_t packet_num;
+    if (!bt_flow_policy_conclude(&ctx.policy, &packet_num)) {
+        return;
+    }
+
+    ctx.wanted_packet_num = packet_num;
+    if (ctx.apply == BT_FLOW_CONTROL_APPLY_IDLE) {
+        ctx.apply = BT_FLOW_CONTROL_APPLY_PENDING;
+    }
+
+    if ((packet_num != ctx.stored_packet_num) && (ctx.tlv_impl != NULL)) {
+        ctx.stored_packet_num = packet_num;
+        ctx.tlv_impl->store_tag(ctx.tlv_context, BT_FLOW_CONTROL_TLV_TAG, (uint8_t *)&ctx.stored_packet_num, sizeof(ctx.stored_packet_num));
+    }
+    DEBUG_LOG("HCI: host ACL buffers %u -> %u once no link is up\n", ctx.packet_num, packet_num);
+}
+
+static void bt_flow_control_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size)
+{
+    if (packet_type != HCI_EVENT_PACKET) {
+        return;
+    }
+
+    switch (hci_event_packet_get_type(packet)) {
+        case BTSTACK_EVENT_STATE:
+            if (btstack_event_state_get_state(packet) != HCI_STATE_WORKING) {
+                break;
+            }
+            /* Just told HCI_HOST_ACL_PACKET_NUM by BTstack, stored size follows */
+            ctx.packet_num = HCI_HOST_ACL_PACKET_NUM;
+            bt_flow_policy_set_packets(&ctx.policy, ctx.packet_num);
+            ctx.apply = (ctx.wanted_packet_num != ctx.packet_num) ? BT_FLOW_CONTROL_APPLY_PENDING : BT_FLOW_CONTROL_APPLY_IDLE;
+            break;
+
+        case HCI_EVENT_CONNECTION_COMPLETE:
+            if ((hci_event_connection_complete_get_status(packet) == ERROR_CODE_SUCCESS) &&
+                (hci_event_connection_complete_get_link_type(packet) == BT_FLOW_CONTROL_LINK_TYPE_ACL)) {
+                bt_flow_control_track_link(HCI_CON_HANDLE_INVALID, hci_event_connection_complete_get_connection_handle(packet));
+            }
+            break;
+
+        case HCI_EVENT_DISCONNECTION_COMPLETE:
+            bt_flow_control_track_link(hci_event_disconnection_complete_get_connection_handle(packet), HCI_CON_HANDLE_INVALID);
+            bt_flow_control_store();
+            break;
+
+        case HCI_EVENT_COMMAND_COMPLETE:
+            if ((ctx.apply == BT_FLOW_CONTROL_APPLY_W4_COMPLETE) && (hci_event_command_complete_get_command_opcode(packet) == HCI_OPCODE_HCI_HOST_BUFFER_SIZE)) {
+                bt_flow_control_applied(packet);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    bt_flow_control_apply();
+}
+
+void bt_flow_control_init(void)
+{
+    uint16_t packet_num = HCI_HOST_ACL_PACKET_NUM;
+
+    btstack_tlv_get_instance(&ctx.tlv_impl, &ctx.tlv_context);
+    if (ctx.tlv_impl != NULL) {
+        uint16_t stored;
+        if (ctx.tlv_impl->get_tag(ctx.tlv_context, BT_FLOW_CONTROL_TLV_TAG, (uint8_t *)&stored, sizeof(stored)) == sizeof(stored)) {
+            packet_num = btstack_min(btstack_max(stored, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN), BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX);
+        }
+    }
+
+    for (uint8_t i = 0; i < MAX_NR_HCI_CONNECTIONS; ++i) {
+        ctx.acl_handles[i] = HCI_CON_HANDLE_INVALID;
+    }
+    ctx.packet_num = HCI_HOST_ACL_PACKET_NUM;
+    ctx.wanted_packet_num = packet_num;
+    ctx.stored_packet_num = packet_num;
+    ctx.apply = BT_FLOW_CONTROL_APPLY_IDLE;
+    bt_flow_policy_init(&ctx.policy, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, ctx.packet_num, time_us_32());
+
+    ctx.hci_registration.callback = bt_flow_control_packet_handler;
+    hci_add_event_handler(&ctx.hci_registration);
+
+    btstack_run_loop_set_timer_handler(&ctx.window_timer, bt_flow_control_window_task);
+    btstack_run_loop_set_timer(&ctx.window_timer, BT_FLOW_CONTROL_WINDOW_MS);
+    btstack_run_loop_add_timer(&ctx.window_timer);
+}
+
+void bt_flow_control_stream_suspended(void)
+{
+    bt_flow_control_store();
+}
+
+void bt_flow_control_acl_received(uint16_t size)
+{
+    bt_flow_policy_acl_received(&ctx.policy, time_us_32(), size);
+}
+
+void bt_flow_control_acl_processed(void)
+{
+    bt_flow_policy_packets_completed(&ctx.policy, time_us_32(), 1);
+}
+
+const bt_flow_policy_stats_t *bt_flow_control_get_stats(void)
+{
+    return &ctx.stats;
+}
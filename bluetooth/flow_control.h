@@ -0,0 +1,22 @@
+#pragma once
+
+#include "flow_policy.h"
+#include <stdint.h>
+
+/* Host ACL pool bounds. BTstack reads one packet at a time into its single incoming buffer, the rest of the pool
+ * waits on cyw43 side of the shared bus - upper limit is what btstack_config.h has always told the controller
+ * (HCI_HOST_ACL_PACKET_NUM) to avoid overrunning it, nothing shows more would fit. Lower limit keeps one packet
+ * queued while the other is processed. */
+#define BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN 2
+#define BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX 3
+
+/* Pool size is told to the controller by BTstack on HCI init, a different one measured before is applied right after.
+ * Later changes are applied once no ACL link is up, packets of an open one may still be outstanding. */
+void bt_flow_control_init(void);
+/* Concludes traffic measured since connection or last suspend, new pool size is stored and applied on disconnect */
+void bt_flow_control_stream_suspended(void);
+/* Around A2DP media packet handler - BTstack returns the ACL buffer to the controller (Host_Number_Of_Completed_Packets)
+ * as soon as the L2CAP handler it has been passed to returns */
+void bt_flow_control_acl_received(uint16_t size);
+void bt_flow_control_acl_processed(void);
+const bt_flow_policy_stats_t *bt_flow_control_get_stats(void);
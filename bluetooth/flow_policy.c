@@ -0,0 +1,157 @@
+#include "flow_policy.h"
+
+#define BT_FLOW_POLICY_BURST_GAP_US 1000 // Arrival that close to the previous completion was already waiting
+#define BT_FLOW_POLICY_STALL_GROW_PERMILLE 50 // Pool exhausted for 5% of the window
+#define BT_FLOW_POLICY_TURNAROUND_SHRINK_US 20000 // Host that slow lets data pile up on cyw43 shared bus
+#define BT_FLOW_POLICY_VOTES_MIN 3 // Windows that have to agree before pool size changes
+#define BT_FLOW_POLICY_VOTES_SHARE_PERCENT 25 // Of windows with traffic
+
+static void bt_flow_policy_advance(bt_flow_policy_t *policy, uint32_t now_us)
+{
+    /* Integrate occupancy and stall time up to now, state hasn't changed since the last event. Once a run of queued
+     * packets is as long as the pool, controller has likely run out of it and holds data back until the next return. */
+    const uint32_t elapsed_us = now_us - policy->last_event_us;
+    policy->in_flight_integral += (uint64_t)policy->in_flight * elapsed_us;
+    if ((policy->in_flight > 0) && (policy->burst >= policy->packets)) {
+        policy->stall_us += elapsed_us;
+    }
+    policy->last_event_us = now_us;
+}
+
+static void bt_flow_policy_reset_window(bt_flow_policy_t *policy, uint32_t now_us)
+{
+    policy->window_start_us = now_us;
+    policy->last_event_us = now_us;
+    policy->acl_bytes = 0;
+    policy->in_flight_max = policy->in_flight;
+    policy->in_flight_integral = 0;
+    policy->stall_us = 0;
+    policy->burst_max = 0;
+    policy->turnaround_max_us = 0;
+}
+
+static void bt_flow_policy_reset_votes(bt_flow_policy_t *policy)
+{
+    policy->windows = 0;
+    policy->grow_votes = 0;
+    policy->shrink_votes = 0;
+}
+
+/* A few windows are just noise - a vote carries only if it keeps coming up over the connection */
+static bool bt_flow_policy_carried(const bt_flow_policy_t *policy, uint16_t votes)
+{
+    return (votes >= BT_FLOW_POLICY_VOTES_MIN) && ((votes * 100U) >= (policy->windows * (uint32_t)BT_FLOW_POLICY_VOTES_SHARE_PERCENT));
+}
+
+/* Slow host first - more buffers would only let the controller push more into shared bus.
+ * One step from the pool size in effect, so that its effect is measured before the next step */
+static uint16_t bt_flow_policy_recommend(const bt_flow_policy_t *policy)
+{
+    if (bt_flow_policy_carried(policy, policy->shrink_votes)) {
+        return (policy->packets > policy->min_packets) ? (policy->packets - 1) : policy->packets;
+    }
+    if (bt_flow_policy_carried(policy, policy->grow_votes)) {
+        return (policy->packets < policy->max_packets) ? (policy->packets + 1) : policy->packets;
+    }
+    return policy->packets;
+}
+
+void bt_flow_policy_init(bt_flow_policy_t *policy, uint16_t min_packets, uint16_t max_packets, uint16_t packets, uint32_t now_us)
+{
+    policy->min_packets = min_packets;
+    policy->max_packets = (max_packets < BT_FLOW_POLICY_PACKETS_MAX) ? max_packets : BT_FLOW_POLICY_PACKETS_MAX;
+    policy->packets = packets;
+    policy->in_flight = 0;
+    policy->burst = 0;
+    policy->last_completed_us = now_us - BT_FLOW_POLICY_BURST_GAP_US;
+    policy->arrival_head = 0;
+    bt_flow_policy_reset_window(policy, now_us);
+    bt_flow_policy_reset_votes(policy);
+}
+
+void bt_flow_policy_acl_received(bt_flow_policy_t *policy, uint32_t now_us, uint16_t size)
+{
+    bt_flow_policy_advance(policy, now_us);
+
+    const bool queued = (policy->in_flight > 0) || ((now_us - policy->last_completed_us) < BT_FLOW_POLICY_BURST_GAP_US);
+    policy->burst = queued ? (policy->burst + 1) : 1;
+    if (policy->burst > policy->burst_max) {
+        policy->burst_max = policy->burst;
+    }
+
+    /* Controller never has more than pool size outstanding, guard against lost completion reports anyway */
+    if (policy->in_flight < BT_FLOW_POLICY_PACKETS_MAX) {
+        const uint8_t tail = (policy->arrival_head + policy->in_flight) % BT_FLOW_POLICY_PACKETS_MAX;
+        policy->arrival_us[tail] = now_us;
+        policy->in_flight++;
+    }
+    if (policy->in_flight > policy->in_flight_max) {
+        policy->in_flight_max = policy->in_flight;
+    }
+
+    policy->acl_bytes += size;
+}
+
+void bt_flow_policy_packets_completed(bt_flow_policy_t *policy, uint32_t now_us, uint16_t count)
+{
+    bt_flow_policy_advance(policy, now_us);
+
+    while ((count > 0) && (policy->in_flight > 0)) {
+        const uint32_t turnaround_us = now_us - policy->arrival_us[policy->arrival_head];
+        if (turnaround_us > policy->turnaround_max_us) {
+            policy->turnaround_max_us = turnaround_us;
+        }
+
+        policy->arrival_head = (policy->arrival_head + 1) % BT_FLOW_POLICY_PACKETS_MAX;
+        policy->in_flight--;
+        count--;
+    }
+    policy->last_completed_us = now_us;
+}
+
+uint16_t bt_flow_policy_update(bt_flow_policy_t *policy, uint32_t now_us, bt_flow_policy_stats_t *stats)
+{
+    bt_flow_policy_advance(policy, now_us);
+
+    const uint32_t window_us = now_us - policy->window_start_us;
+    if (window_us == 0) {
+        return bt_flow_policy_recommend(policy);
+    }
+
+    stats->throughput_bps = ((uint64_t)policy->acl_bytes * 8 * 1000000U) / window_us;
+    stats->occupancy_avg_x100 = (policy->in_flight_integral * 100) / window_us;
+    stats->occupancy_max = policy->in_flight_max;
+    stats->stall_us = policy->stall_us;
+    stats->burst_max = policy->burst_max;
+    stats->turnaround_max_us = policy->turnaround_max_us;
+
+    /* Idle windows don't vote. Slow window votes for shrinking, otherwise one where bursts keep running into the limit for growing. */
+    const uint32_t stall_permille = ((uint64_t)policy->stall_us * 1000) / window_us;
+    if (policy->acl_bytes > 0) {
+        policy->windows++;
+        if (policy->turnaround_max_us > BT_FLOW_POLICY_TURNAROUND_SHRINK_US) {
+            policy->shrink_votes++;
+        }
+        else if ((stall_permille >= BT_FLOW_POLICY_STALL_GROW_PERMILLE) && (policy->burst_max >= policy->packets)) {
+            policy->grow_votes++;
+        }
+    }
+    stats->windows = policy->windows;
+    stats->grow_votes = policy->grow_votes;
+    stats->shrink_votes = policy->shrink_votes;
+
+    bt_flow_policy_reset_window(policy, now_us);
+    return bt_flow_policy_recommend(policy);
+}
+
+bool bt_flow_policy_conclude(bt_flow_policy_t *policy, uint16_t *packets)
+{
+    *packets = bt_flow_policy_recommend(policy);
+    bt_flow_policy_reset_votes(policy);
+    return *packets != policy->packets;
+}
+
+void bt_flow_policy_set_packets(bt_flow_policy_t *policy, uint16_t packets)
+{
+    policy->packets = packets;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Sizes host ACL buffer pool for controller to host flow control from measured ACL traffic. Pure logic
+ * without BTstack or Pico dependencies, so it can be fed from a simulated controller transport on host as well.
+ * Host processes one packet at a time and returns its buffer when done, packets arriving right after the previous
+ * one was returned have been waiting in the transport - runs of those show the controller using up the pool.
+ * Every window with traffic votes for growing or shrinking the pool, votes are accumulated over a connection
+ * and concluded once, when it ends or the stream is suspended. */
+
+#define BT_FLOW_POLICY_PACKETS_MAX 8
+
+typedef struct
+{
+    uint32_t throughput_bps;
+    uint32_t occupancy_avg_x100; // Average host buffers in use, times 100
+    uint16_t occupancy_max;
+    uint32_t stall_us; // Estimated, host busy with a run of queued packets as long as the pool
+    uint16_t burst_max; // Packets arriving back to back, each right after the previous one was returned
+    uint32_t turnaround_max_us; // From packet arrival until its buffer is reported free
+    uint16_t windows; // With traffic, since the last conclusion
+    uint16_t grow_votes;
+    uint16_t shrink_votes;
+} bt_flow_policy_stats_t;
+
+typedef struct
+{
+    uint16_t min_packets;
+    uint16_t max_packets;
+    uint16_t packets; // Pool size the controller was told about
+    uint16_t windows;
+    uint16_t grow_votes;
+    uint16_t shrink_votes;
+    uint32_t window_start_us;
+    uint32_t last_event_us;
+    uint32_t acl_bytes;
+    uint16_t in_flight;
+    uint16_t in_flight_max;
+    uint64_t in_flight_integral; // Buffers in use times us
+    uint32_t stall_us;
+    uint16_t burst;
+    uint16_t burst_max;
+    uint32_t last_completed_us;
+    uint32_t turnaround_max_us;
+    uint32_t arrival_us[BT_FLOW_POLICY_PACKETS_MAX]; // FIFO of in-flight packets
+    uint8_t arrival_head;
+} bt_flow_policy_t;
+
+void bt_flow_policy_init(bt_flow_policy_t *policy, uint16_t min_packets, uint16_t max_packets, uint16_t packets, uint32_t now_us);
+void bt_flow_policy_acl_received(bt_flow_policy_t *policy, uint32_t now_us, uint16_t size);
+void bt_flow_policy_packets_completed(bt_flow_policy_t *policy, uint32_t now_us, uint16_t count);
+/* Closes current window, fills its stats and returns pool size the votes so far point to */
+uint16_t bt_flow_policy_update(bt_flow_policy_t *policy, uint32_t now_us, bt_flow_policy_stats_t *stats);
+/* Returns pool size the votes point to and starts over, false if they don't carry a change */
+bool bt_flow_policy_conclude(bt_flow_policy_t *policy, uint16_t *packets);
+/* Pool size the controller has accepted */
+void bt_flow_policy_set_packets(bt_flow_policy_t *policy, uint16_t packets);
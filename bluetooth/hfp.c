@@ -0,0 +1,218 @@
+#include "hfp.h"
+#include "a2dp.h"
+#include "avrcp.h"
+#include "bt_i2s.h"
+#include "profiler.h"
+#include "sco_pipeline.h"
+#include <btstack.h>
+#include <classic/hfp_hf.h>
+#include <pico/time.h>
+#include <debug_log.h>
+
+#define BT_HFP_SUPPORTED_FEATURES ((1 << HFP_HFSF_CODEC_NEGOTIATION) | \
+                                   (1 << HFP_HFSF_REMOTE_VOLUME_CONTROL) | \
+                                   (1 << HFP_HFSF_ESCO_S4))
+
+/* Voice latency budget, separate from the music path. Jitter buffer plus two DMA periods in bt_i2s - checked against
+ * buffered depth at runtime, decode time is not part of it */
+#define BT_HFP_PREFILL_MS 8
+#define BT_HFP_MAX_DEPTH_MS 16
+#define BT_HFP_LATENCY_BUDGET_MS 30
+
+#define BT_HFP_SPEAKER_GAIN_MAX 15 // Max value according to HFP spec
+#define BT_HFP_SPEAKER_GAIN_DEFAULT 9
+#define BT_HFP_VOLUME_MAX 127 // Volume scale used by bt_i2s sink
+
+typedef struct
+{
+    hci_con_handle_t acl_handle;
+    hci_con_handle_t sco_handle;
+    uint8_t speaker_gain;
+    bool audio_active;
+    bool stream_started;
+    bt_sco_pipeline_t pipeline;
+    uint32_t audio_established_time_ms;
+    uint32_t decode_max_us;
+    uint32_t latency_max_us;
+} bt_hfp_ctx_t;
+
+static bt_hfp_ctx_t ctx;
+
+static const uint8_t codecs[] = {HFP_CODEC_CVSD, HFP_CODEC_MSBC};
+
+static void bt_hfp_set_speaker_gain(uint8_t gain)
+{
+    const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
+    if (audio != NULL) {
+        audio->set_volume((gain * BT_HFP_VOLUME_MAX) / BT_HFP_SPEAKER_GAIN_MAX);
+    }
+}
+
+static void bt_hfp_read_samples_callback(int16_t *buffer, uint16_t num_frames)
+{
+    /* Mono, bt_i2s duplicates it to both channels */
+    bt_sco_pipeline_read(&ctx.pipeline, buffer, num_frames);
+}
+
+static void bt_hfp_audio_start(uint8_t codec)
+{
+    /* Take the output over from music, A2DP resumes it once the call audio is gone */
+    bt_a2dp_voice_call_started();
+
+    bt_sco_pipeline_init(&ctx.pipeline, codec, BT_HFP_PREFILL_MS, BT_HFP_MAX_DEPTH_MS);
+    ctx.decode_max_us = 0;
+    ctx.latency_max_us = 0;
+    ctx.stream_started = false;
+    ctx.audio_established_time_ms = btstack_run_loop_get_time_ms();
+
+    const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
+    if (audio != NULL) {
+        audio->init(1, ctx.pipeline.sample_rate, bt_hfp_read_samples_callback);
+    }
+    bt_hfp_set_speaker_gain(ctx.speaker_gain);
+
+    ctx.audio_active = true;
+    DEBUG_LOG("HFP: audio connection established, %s at %lu Hz\n", (codec == HFP_CODEC_MSBC) ? "mSBC" : "CVSD", (unsigned long)ctx.pipeline.sample_rate);
+}
+
+static void bt_hfp_audio_stop(void)
+{
+    if (!ctx.audio_active) {
+        return;
+    }
+
+    ctx.audio_active = false;
+    ctx.stream_started = false;
+
+    const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
+    if (audio != NULL) {
+        audio->close();
+    }
+
+    DEBUG_LOG("HFP: audio released - %lu packets, %lu bad, %lu underruns, %lu samples dropped, decode max %lu us, latency max %lu us\n",
+           (unsigned long)ctx.pipeline.packets, (unsigned long)ctx.pipeline.bad_packets, (unsigned long)ctx.pipeline.underruns,
+           (unsigned long)ctx.pipeline.dropped_samples, (unsigned long)ctx.decode_max_us, (unsigned long)ctx.latency_max_us);
+
+    bt_a2dp_voice_call_ended();
+    if (audio != NULL) {
+        audio->set_volume(bt_avrcp_get_volume());
+    }
+}
+
+static void bt_hfp_sco_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size)
+{
+    if ((packet_type != HCI_SCO_DATA_PACKET) || !ctx.audio_active) {
+        return;
+    }
+
+    const uint32_t decode_start_us = time_us_32();
+    bt_sco_pipeline_packet_received(&ctx.pipeline, packet, size);
+    ctx.decode_max_us = btstack_max(ctx.decode_max_us, time_us_32() - decode_start_us);
+
+    if (!ctx.stream_started) {
+        if (!bt_sco_pipeline_is_primed(&ctx.pipeline)) {
+            return;
+        }
+
+        ctx.stream_started = true;
+        const btstack_audio_sink_t *audio = btstack_audio_sink_get_instance();
+        if (audio != NULL) {
+            audio->start_stream();
+        }
+        DEBUG_LOG("HFP: audio connection to output %lu ms\n", (unsigned long)(btstack_run_loop_get_time_ms() - ctx.audio_established_time_ms));
+        return;
+    }
+
+    /* Newest sample in the queue plays after everything buffered here and in DMA */
+    const uint32_t latency_us = bt_sco_pipeline_get_depth_us(&ctx.pipeline) + bt_i2s_get_queued_delay_us();
+    if (latency_us > ctx.latency_max_us) {
+        ctx.latency_max_us = latency_us;
+        if (latency_us > (BT_HFP_LATENCY_BUDGET_MS * 1000)) {
+            DEBUG_LOG("HFP: voice latency %lu us over budget\n", (unsigned long)latency_us);
+        }
+    }
+}
+
+static void bt_hfp_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size)
+{
+    if ((packet_type != HCI_EVENT_PACKET) || (hci_event_packet_get_type(packet) != HCI_EVENT_HFP_META)) {
+        return;
+    }
+
+    const uint8_t subevent = hci_event_hfp_meta_get_subevent_code(packet);
+    uint8_t status;
+
+    switch (subevent) {
+        case HFP_SUBEVENT_SERVICE_LEVEL_CONNECTION_ESTABLISHED:
+            status = hfp_subevent_service_level_connection_established_get_status(packet);
+            if (status != ERROR_CODE_SUCCESS) {
+                break;
+            }
+            ctx.acl_handle = hfp_subevent_service_level_connection_established_get_acl_handle(packet);
+            DEBUG_LOG("HFP: service level connection established\n");
+            break;
+
+        case HFP_SUBEVENT_SERVICE_LEVEL_CONNECTION_RELEASED:
+            bt_hfp_audio_stop();
+            ctx.acl_handle = HCI_CON_HANDLE_INVALID;
+            break;
+
+        case HFP_SUBEVENT_AUDIO_CONNECTION_ESTABLISHED:
+            status = hfp_subevent_audio_connection_established_get_status(packet);
+            if (status != ERROR_CODE_SUCCESS) {
+                break;
+            }
+            ctx.sco_handle = hfp_subevent_audio_connection_established_get_sco_handle(packet);
+            bt_hfp_audio_start(hfp_subevent_audio_connection_established_get_negotiated_codec(packet));
+            break;
+
+        case HFP_SUBEVENT_AUDIO_CONNECTION_RELEASED:
+            ctx.sco_handle = HCI_CON_HANDLE_INVALID;
+            bt_hfp_audio_stop();
+            break;
+
+        case HFP_SUBEVENT_SPEAKER_VOLUME:
+            ctx.speaker_gain = hfp_subevent_speaker_volume_get_gain(packet);
+            if (ctx.audio_active) {
+                bt_hfp_set_speaker_gain(ctx.speaker_gain);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_HFP, bt_hfp_packet_handler)
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_HFP_SCO, bt_hfp_sco_packet_handler)
+
+void bt_hfp_init(void)
+{
+    ctx.acl_handle = HCI_CON_HANDLE_INVALID;
+    ctx.sco_handle = HCI_CON_HANDLE_INVALID;
+    ctx.speaker_gain = BT_HFP_SPEAKER_GAIN_DEFAULT;
+
+    rfcomm_init();
+
+    hfp_hf_init(BT_HFP_RFCOMM_CHANNEL);
+    hfp_hf_init_supported_features(BT_HFP_SUPPORTED_FEATURES);
+    hfp_hf_init_codecs(sizeof(codecs), codecs);
+    hfp_hf_register_packet_handler(bt_hfp_packet_handler_profiled);
+
+    hci_register_sco_packet_handler(bt_hfp_sco_packet_handler_profiled);
+}
+
+uint16_t bt_hfp_get_supported_features(void)
+{
+    return BT_HFP_SUPPORTED_FEATURES;
+}
+
+bool bt_hfp_is_audio_active(void)
+{
+    return ctx.audio_active;
+}
+
+uint32_t bt_hfp_get_latency_max_us(void)
+{
+    return ctx.latency_max_us;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BT_HFP_RFCOMM_CHANNEL 1
+
+void bt_hfp_init(void);
+uint16_t bt_hfp_get_supported_features(void);
+bool bt_hfp_is_audio_active(void);
+uint32_t bt_hfp_get_latency_max_us(void);
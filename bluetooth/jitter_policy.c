@@ -0,0 +1,83 @@
+#include "jitter_policy.h"
+
+#define BT_JITTER_POLICY_RSSI_WEAK -5 // dB below golden receive power range
+#define BT_JITTER_POLICY_RSSI_WEAK_FRAMES 10
+#define BT_JITTER_POLICY_LOSS_FRAMES 20
+#define BT_JITTER_POLICY_SEQUENCE_JUMP_MAX 0x100 // Larger jumps are a restarted stream or reordering, not loss
+#define BT_JITTER_POLICY_RELEASE_FRAMES 2 // Per window, target goes down much slower than up
+
+void bt_jitter_policy_init(bt_jitter_policy_t *policy, uint32_t min_frames, uint32_t max_frames, uint32_t initial_frames)
+{
+    policy->min_frames = min_frames;
+    policy->max_frames = max_frames;
+    policy->target_frames = initial_frames;
+    policy->rssi = 0;
+    policy->lost_packets = 0;
+    bt_jitter_policy_reset_arrivals(policy);
+}
+
+void bt_jitter_policy_reset_arrivals(bt_jitter_policy_t *policy)
+{
+    policy->has_arrival = false;
+    policy->max_gap_ms = 0;
+}
+
+void bt_jitter_policy_packet_arrived(bt_jitter_policy_t *policy, uint32_t time_ms, uint16_t sequence_number)
+{
+    if (policy->has_arrival) {
+        const uint32_t gap_ms = time_ms - policy->last_arrival_ms;
+        if (gap_ms > policy->max_gap_ms) {
+            policy->max_gap_ms = gap_ms;
+        }
+
+        /* Sequence numbers wrap at 16 bits */
+        const uint16_t skipped = sequence_number - policy->next_sequence_number;
+        if (skipped < BT_JITTER_POLICY_SEQUENCE_JUMP_MAX) {
+            policy->lost_packets += skipped;
+        }
+    }
+
+    policy->last_arrival_ms = time_ms;
+    policy->next_sequence_number = sequence_number + 1;
+    policy->has_arrival = true;
+}
+
+void bt_jitter_policy_set_rssi(bt_jitter_policy_t *policy, int8_t rssi)
+{
+    policy->rssi = rssi;
+}
+
+uint32_t bt_jitter_policy_update(bt_jitter_policy_t *policy, uint32_t frames_per_second)
+{
+    /* Buffer has to bridge the longest gap seen, with 50% margin */
+    const uint32_t gap_frames = (policy->max_gap_ms * frames_per_second) / 1000;
+    uint32_t needed_frames = gap_frames + gap_frames / 2;
+
+    /* Radio trouble usually precedes long gaps, prepare in advance */
+    if (policy->rssi < BT_JITTER_POLICY_RSSI_WEAK) {
+        needed_frames += BT_JITTER_POLICY_RSSI_WEAK_FRAMES;
+    }
+    if (policy->lost_packets > 0) {
+        needed_frames += BT_JITTER_POLICY_LOSS_FRAMES;
+    }
+
+    /* Fast attack, slow release */
+    if (needed_frames > policy->target_frames) {
+        policy->target_frames = needed_frames;
+    }
+    else {
+        const uint32_t excess = policy->target_frames - needed_frames;
+        policy->target_frames -= (excess < BT_JITTER_POLICY_RELEASE_FRAMES) ? excess : BT_JITTER_POLICY_RELEASE_FRAMES;
+    }
+
+    if (policy->target_frames < policy->min_frames) {
+        policy->target_frames = policy->min_frames;
+    }
+    if (policy->target_frames > policy->max_frames) {
+        policy->target_frames = policy->max_frames;
+    }
+
+    policy->max_gap_ms = 0; // Keep last arrival, so that gap spanning the windows boundary is not lost
+    policy->lost_packets = 0;
+    return policy->target_frames;
+}
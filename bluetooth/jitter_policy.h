@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Adapts jitter buffer target (in SBC frames) to link quality. Pure logic without BTstack or
+ * Pico dependencies, so it can be fed with recorded arrival traces on host as well.
+ * Link quality is judged from what a sink can actually observe - gaps between media packets,
+ * media packets lost (gaps in RTP sequence numbers, i.e. flushed by the source after failed
+ * retransmissions) and RSSI. */
+
+typedef struct
+{
+    uint32_t min_frames;
+    uint32_t max_frames;
+    uint32_t target_frames;
+    uint32_t last_arrival_ms;
+    uint32_t max_gap_ms; // Longest gap between media packets in current window
+    bool has_arrival;
+    uint16_t next_sequence_number;
+    uint32_t lost_packets; // In current window
+    int8_t rssi;
+} bt_jitter_policy_t;
+
+void bt_jitter_policy_init(bt_jitter_policy_t *policy, uint32_t min_frames, uint32_t max_frames, uint32_t initial_frames);
+void bt_jitter_policy_reset_arrivals(bt_jitter_policy_t *policy);
+void bt_jitter_policy_packet_arrived(bt_jitter_policy_t *policy, uint32_t time_ms, uint16_t sequence_number);
+void bt_jitter_policy_set_rssi(bt_jitter_policy_t *policy, int8_t rssi);
+/* Closes current window and returns new target, frames_per_second converts gaps to buffered frames */
+uint32_t bt_jitter_policy_update(bt_jitter_policy_t *policy, uint32_t frames_per_second);
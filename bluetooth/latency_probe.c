@@ -0,0 +1,154 @@
+#include "latency_probe.h"
+#include <hot_path.h>
+#include <hardware/gpio.h>
+#include <pico/time.h>
+#include <string.h>
+
+/* Toggled when a marker frame is clocked out, for checking the numbers with a scope */
+#ifndef BT_LATENCY_PROBE_MARKER_GPIO
+#define BT_LATENCY_PROBE_MARKER_GPIO -1
+#endif
+#define BT_LATENCY_PROBE_MARKER_INTERVAL_US 1000000
+
+typedef struct
+{
+    uint32_t rtp_timestamp;
+    uint64_t arrival_us;
+    uint8_t frames_left;
+    uint8_t frames_decoded;
+} bt_latency_probe_packet_t;
+
+typedef struct
+{
+    bt_latency_probe_stats_t stats;
+    bt_latency_probe_packet_t fifo[BT_LATENCY_PROBE_PACKETS_MAX];
+    uint32_t fifo_head;
+    uint32_t fifo_count;
+    uint32_t sample_rate;
+    uint32_t samples_per_frame;
+    bool has_reference;
+    uint32_t rtp_reference;
+    int64_t base_offset_us; // Smallest arrival time minus RTP time seen
+    uint64_t next_marker_us;
+} bt_latency_probe_ctx_t;
+
+static bt_latency_probe_ctx_t ctx;
+
+static uint64_t bt_latency_probe_rtp_to_us(uint32_t rtp_timestamp)
+{
+    return ((uint64_t)(rtp_timestamp - ctx.rtp_reference) * 1000000ULL) / ctx.sample_rate;
+}
+
+static void HOT_PATH_FUNC(bt_latency_probe_stage_update)(bt_latency_probe_stage_t *stage, uint32_t value_us)
+{
+    stage->last_us = value_us;
+    stage->min_us = (value_us < stage->min_us) ? value_us : stage->min_us;
+    stage->max_us = (value_us > stage->max_us) ? value_us : stage->max_us;
+    stage->total_us += value_us;
+}
+
+#if BT_LATENCY_PROBE_MARKER_GPIO >= 0
+static int64_t bt_latency_probe_marker_callback(alarm_id_t id, void *user_data)
+{
+    gpio_xor_mask(1U << BT_LATENCY_PROBE_MARKER_GPIO);
+    return 0; // Don't reschedule
+}
+#endif
+
+void bt_latency_probe_init(void)
+{
+#if BT_LATENCY_PROBE_MARKER_GPIO >= 0
+    gpio_init(BT_LATENCY_PROBE_MARKER_GPIO);
+    gpio_set_dir(BT_LATENCY_PROBE_MARKER_GPIO, GPIO_OUT);
+#endif
+}
+
+void bt_latency_probe_reset(uint32_t sample_rate, uint32_t samples_per_frame)
+{
+    memset(&ctx.stats, 0, sizeof(ctx.stats));
+    ctx.stats.queue.min_us = UINT32_MAX;
+    ctx.stats.output.min_us = UINT32_MAX;
+    ctx.stats.end_to_end.min_us = UINT32_MAX;
+    ctx.stats.valid = true;
+
+    ctx.fifo_head = 0;
+    ctx.fifo_count = 0;
+    ctx.sample_rate = sample_rate;
+    ctx.samples_per_frame = samples_per_frame;
+    ctx.has_reference = false;
+}
+
+void bt_latency_probe_packet_received(uint32_t rtp_timestamp, uint8_t num_frames)
+{
+    if (!ctx.stats.valid) {
+        return;
+    }
+
+    const uint64_t now_us = time_us_64();
+
+    if (!ctx.has_reference) {
+        ctx.rtp_reference = rtp_timestamp;
+        ctx.base_offset_us = INT64_MAX;
+        ctx.next_marker_us = 0;
+        ctx.has_reference = true;
+    }
+
+    /* Fastest packet defines zero transport latency */
+    const int64_t offset_us = (int64_t)now_us - (int64_t)bt_latency_probe_rtp_to_us(rtp_timestamp);
+    if (offset_us < ctx.base_offset_us) {
+        ctx.base_offset_us = offset_us;
+    }
+
+    /* Frames already queued would be matched with wrong packets from now on, stop until reset instead */
+    if (ctx.fifo_count == BT_LATENCY_PROBE_PACKETS_MAX) {
+        ctx.stats.fifo_overflows++;
+        ctx.stats.valid = false;
+        return;
+    }
+
+    bt_latency_probe_packet_t *packet = &ctx.fifo[(ctx.fifo_head + ctx.fifo_count) % BT_LATENCY_PROBE_PACKETS_MAX];
+    packet->rtp_timestamp = rtp_timestamp;
+    packet->arrival_us = now_us;
+    packet->frames_left = num_frames;
+    packet->frames_decoded = 0;
+    ctx.fifo_count++;
+}
+
+void HOT_PATH_FUNC(bt_latency_probe_frame_decoded)(uint32_t output_offset_frames, uint32_t playback_delay_us)
+{
+    if (!ctx.stats.valid || (ctx.fifo_count == 0) || (ctx.sample_rate == 0)) {
+        return;
+    }
+
+    /* Pop frame from the packet it came with */
+    bt_latency_probe_packet_t *packet = &ctx.fifo[ctx.fifo_head];
+    const uint32_t rtp_timestamp = packet->rtp_timestamp + packet->frames_decoded * ctx.samples_per_frame;
+    const uint64_t arrival_us = packet->arrival_us;
+    packet->frames_decoded++;
+    if (--packet->frames_left == 0) {
+        ctx.fifo_head = (ctx.fifo_head + 1) % BT_LATENCY_PROBE_PACKETS_MAX;
+        ctx.fifo_count--;
+    }
+
+    const uint64_t now_us = time_us_64();
+    const uint32_t output_delay_us = playback_delay_us + (uint32_t)(((uint64_t)output_offset_frames * 1000000ULL) / ctx.sample_rate);
+    const uint64_t rtp_us = bt_latency_probe_rtp_to_us(rtp_timestamp);
+    const int64_t source_us = (int64_t)rtp_us + ctx.base_offset_us;
+
+    ctx.stats.frames++;
+    bt_latency_probe_stage_update(&ctx.stats.queue, (uint32_t)(now_us - arrival_us));
+    bt_latency_probe_stage_update(&ctx.stats.output, output_delay_us);
+    bt_latency_probe_stage_update(&ctx.stats.end_to_end, (uint32_t)((int64_t)(now_us + output_delay_us) - source_us));
+
+#if BT_LATENCY_PROBE_MARKER_GPIO >= 0
+    if (rtp_us >= ctx.next_marker_us) {
+        ctx.next_marker_us = rtp_us + BT_LATENCY_PROBE_MARKER_INTERVAL_US;
+        add_alarm_in_us(output_delay_us, bt_latency_probe_marker_callback, NULL, true);
+    }
+#endif
+}
+
+const bt_latency_probe_stats_t *bt_latency_probe_get_stats(void)
+{
+    return &ctx.stats;
+}
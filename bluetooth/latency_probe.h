@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Follows RTP timestamps of SBC frames through decode into the DMA buffer, giving
+ * per-stage and end-to-end latency. End-to-end is measured against the fastest
+ * packet seen since reset, as the source clock is not known to the sink. */
+
+/* Packets tracked at once - has to cover everything the SBC frame ring can hold, one packet carries at least one frame */
+#define BT_LATENCY_PROBE_PACKETS_MAX 150
+
+typedef struct
+{
+    uint32_t last_us;
+    uint32_t min_us;
+    uint32_t max_us; // max - min is the jitter of the stage
+    uint64_t total_us;
+} bt_latency_probe_stage_t;
+
+typedef struct
+{
+    bool valid; // Cleared when packets couldn't be tracked, frames can't be matched to packets any more until reset
+    uint32_t frames;
+    uint32_t fifo_overflows;
+    bt_latency_probe_stage_t queue; // Packet arrival to decode
+    bt_latency_probe_stage_t output; // Decode to sample clocked out of PIO
+    bt_latency_probe_stage_t end_to_end; // RTP timestamp to sample clocked out of PIO
+} bt_latency_probe_stats_t;
+
+void bt_latency_probe_init(void);
+void bt_latency_probe_reset(uint32_t sample_rate, uint32_t samples_per_frame);
+/* Only for packets actually queued for decode */
+void bt_latency_probe_packet_received(uint32_t rtp_timestamp, uint8_t num_frames);
+/* Offset of frame's first sample in the buffer being filled, delay until that buffer starts playing */
+void bt_latency_probe_frame_decoded(uint32_t output_offset_frames, uint32_t playback_delay_us);
+const bt_latency_probe_stats_t *bt_latency_probe_get_stats(void);
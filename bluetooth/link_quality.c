@@ -0,0 +1,76 @@
+#include "link_quality.h"
+#include <btstack.h>
+
+#define BT_LINK_QUALITY_SAMPLE_INTERVAL_MS 500
+
+typedef struct
+{
+    btstack_packet_callback_registration_t hci_registration;
+    btstack_timer_source_t sample_timer;
+    hci_con_handle_t con_handle;
+    int8_t rssi;
+} bt_link_quality_ctx_t;
+
+static bt_link_quality_ctx_t ctx;
+
+static void bt_link_quality_sample_task(btstack_timer_source_t *ts)
+{
+    if (ctx.con_handle != HCI_CON_HANDLE_INVALID) {
+        gap_read_rssi(ctx.con_handle);
+    }
+
+    /* Restart timer */
+    btstack_run_loop_set_timer(ts, BT_LINK_QUALITY_SAMPLE_INTERVAL_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
+static void bt_link_quality_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size)
+{
+    if (packet_type != HCI_EVENT_PACKET) {
+        return;
+    }
+
+    const uint8_t type = hci_event_packet_get_type(packet);
+
+    switch (type) {
+        case HCI_EVENT_CONNECTION_COMPLETE:
+            if (hci_event_connection_complete_get_status(packet) != ERROR_CODE_SUCCESS) {
+                break;
+            }
+            ctx.con_handle = hci_event_connection_complete_get_connection_handle(packet);
+            ctx.rssi = 0;
+            break;
+
+        case HCI_EVENT_DISCONNECTION_COMPLETE:
+            if (hci_event_disconnection_complete_get_connection_handle(packet) == ctx.con_handle) {
+                ctx.con_handle = HCI_CON_HANDLE_INVALID;
+            }
+            break;
+
+        case GAP_EVENT_RSSI_MEASUREMENT:
+            if (gap_event_rssi_measurement_get_con_handle(packet) == ctx.con_handle) {
+                ctx.rssi = (int8_t)gap_event_rssi_measurement_get_rssi(packet);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void bt_link_quality_init(void)
+{
+    ctx.con_handle = HCI_CON_HANDLE_INVALID;
+
+    ctx.hci_registration.callback = bt_link_quality_packet_handler;
+    hci_add_event_handler(&ctx.hci_registration);
+
+    btstack_run_loop_set_timer_handler(&ctx.sample_timer, bt_link_quality_sample_task);
+    btstack_run_loop_set_timer(&ctx.sample_timer, BT_LINK_QUALITY_SAMPLE_INTERVAL_MS);
+    btstack_run_loop_add_timer(&ctx.sample_timer);
+}
+
+int8_t bt_link_quality_get_rssi(void)
+{
+    return ctx.rssi;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+void bt_link_quality_init(void);
+int8_t bt_link_quality_get_rssi(void);
@@ -0,0 +1,60 @@
+#include "playout_policy.h"
+
+#define BT_PLAYOUT_POLICY_MARGIN_MS 40 // Left in ring once both DMA buffers are primed, covers about two late packets
+#define BT_PLAYOUT_POLICY_COMPENSATION 0x100 // 0.4%, steady-state drift correction
+#define BT_PLAYOUT_POLICY_RAMP_COMPENSATION 0xC0 // 0.3%, while building depth up after start
+#define BT_PLAYOUT_POLICY_SLEW 0x20 // Per packet, compensation glides in over a few hundred ms instead of stepping pitch
+
+static uint32_t bt_playout_policy_div_ceil(uint32_t a, uint32_t b)
+{
+    return (a + b - 1) / b;
+}
+
+void bt_playout_policy_init(bt_playout_policy_t *policy, uint32_t sample_rate, uint32_t samples_per_frame, uint32_t period_frames)
+{
+    /* Start pulls two DMA periods at once, whatever is above that is what absorbs jitter until depth builds up */
+    const uint32_t margin_frames = bt_playout_policy_div_ceil((sample_rate * BT_PLAYOUT_POLICY_MARGIN_MS) / 1000, samples_per_frame);
+    policy->primer_frames = bt_playout_policy_div_ceil(2 * period_frames, samples_per_frame) + margin_frames;
+    policy->resume_frames = bt_playout_policy_div_ceil(period_frames, samples_per_frame) + margin_frames;
+    policy->ramp_up = false;
+    policy->compensation = 0;
+}
+
+uint32_t bt_playout_policy_frames_to_start(const bt_playout_policy_t *policy, bool output_running)
+{
+    return output_running ? policy->resume_frames : policy->primer_frames;
+}
+
+void bt_playout_policy_started(bt_playout_policy_t *policy)
+{
+    policy->ramp_up = true;
+}
+
+uint32_t bt_playout_policy_update(bt_playout_policy_t *policy, uint32_t frames_in_buffer, uint32_t frames_target, uint32_t frames_high)
+{
+    /* Decide on audio sync drift based on number of SBC frames in queue */
+    int32_t wanted = 0;
+    if (frames_in_buffer < frames_target) {
+        /* Stretch samples. Ramp up after start lasts tens of seconds, so it stays gentler than the short steady-state corrections. */
+        wanted = policy->ramp_up ? -BT_PLAYOUT_POLICY_RAMP_COMPENSATION : -BT_PLAYOUT_POLICY_COMPENSATION;
+    }
+    else {
+        policy->ramp_up = false; // Steady-state target reached
+        if (frames_in_buffer > frames_high) {
+            wanted = BT_PLAYOUT_POLICY_COMPENSATION; // Compress samples
+        }
+    }
+
+    /* Rate limited, so that pitch never jumps */
+    if (wanted > policy->compensation + BT_PLAYOUT_POLICY_SLEW) {
+        policy->compensation += BT_PLAYOUT_POLICY_SLEW;
+    }
+    else if (wanted < policy->compensation - BT_PLAYOUT_POLICY_SLEW) {
+        policy->compensation -= BT_PLAYOUT_POLICY_SLEW;
+    }
+    else {
+        policy->compensation = wanted;
+    }
+
+    return (uint32_t)(BT_PLAYOUT_POLICY_FACTOR_NOMINAL + policy->compensation);
+}
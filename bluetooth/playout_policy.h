@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Decides when there is enough buffered to start the output and how hard to time-stretch towards the
+ * jitter buffer target. Depths are in SBC frames, resampling factor is 16.16 fixed point like in
+ * audio_dsp_resample. Pure logic without BTstack or Pico dependencies, so it can be driven by a simulated
+ * source and DMA on host as well. */
+
+#define BT_PLAYOUT_POLICY_FACTOR_NOMINAL 0x10000
+
+typedef struct
+{
+    uint32_t primer_frames; // Both DMA buffers plus jitter margin
+    uint32_t resume_frames; // Queued DMA buffer plus jitter margin
+    bool ramp_up; // Building depth up to target after start
+    int32_t compensation; // Applied one, slewed towards the wanted one
+} bt_playout_policy_t;
+
+void bt_playout_policy_init(bt_playout_policy_t *policy, uint32_t sample_rate, uint32_t samples_per_frame, uint32_t period_frames);
+/* Stopped output primes both DMA buffers on start, running one (resume after suspend) only the queued one */
+uint32_t bt_playout_policy_frames_to_start(const bt_playout_policy_t *policy, bool output_running);
+void bt_playout_policy_started(bt_playout_policy_t *policy);
+/* Called per media packet, returns resampling factor for given depth */
+uint32_t bt_playout_policy_update(bt_playout_policy_t *policy, uint32_t frames_in_buffer, uint32_t frames_target, uint32_t frames_high);
@@ -0,0 +1,70 @@
+#include "playout_stream.h"
+#include <hot_path.h>
+#include <audio_dsp.h>
+#include <string.h>
+
+void bt_playout_stream_init(bt_playout_stream_t *stream)
+{
+    stream->started = false;
+    stream->draining = false;
+    stream->fade_in = false;
+    stream->underruns = 0;
+}
+
+void bt_playout_stream_start(bt_playout_stream_t *stream)
+{
+    stream->draining = false;
+    stream->fade_in = true;
+    stream->started = true;
+}
+
+bool bt_playout_stream_stop(bt_playout_stream_t *stream)
+{
+    if (!stream->started) {
+        return false;
+    }
+
+    /* Output keeps running, buffered audio is faded out in next read */
+    stream->started = false;
+    stream->draining = true;
+    return true;
+}
+
+bool bt_playout_stream_is_started(const bt_playout_stream_t *stream)
+{
+    return stream->started;
+}
+
+bool bt_playout_stream_is_idle(const bt_playout_stream_t *stream)
+{
+    return !stream->started && !stream->draining;
+}
+
+bool HOT_PATH_FUNC(bt_playout_stream_read)(bt_playout_stream_t *stream, int16_t *buffer, uint32_t frames, bt_playout_stream_fill_t fill, void *context)
+{
+    /* Suspended - silence keeps the output running, so that resume doesn't need to restart it */
+    if (bt_playout_stream_is_idle(stream)) {
+        memset(buffer, 0, frames * AUDIO_DSP_CHANNELS * sizeof(int16_t));
+        return false;
+    }
+
+    /* Underrun, output silence instead of stale samples */
+    const uint32_t frames_filled = fill(buffer, frames, context);
+    if (frames_filled < frames) {
+        memset(&buffer[frames_filled * AUDIO_DSP_CHANNELS], 0, (frames - frames_filled) * AUDIO_DSP_CHANNELS * sizeof(int16_t));
+        stream->underruns++;
+    }
+
+    /* Fade out the last period after stop, whatever is left would be stale on resume */
+    if (stream->draining) {
+        audio_dsp_fade_stereo(buffer, frames, false);
+        stream->draining = false;
+        return true;
+    }
+
+    if (stream->fade_in) {
+        audio_dsp_fade_stereo(buffer, frames, true);
+        stream->fade_in = false;
+    }
+    return false;
+}
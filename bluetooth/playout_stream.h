@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Stream side of playback - what the output reads while a stream plays, drains after suspend or waits for the next
+ * one. Output keeps running across suspend, so reads give silence while no stream plays, the last period of a stopped
+ * stream is faded out and the first one of a started stream faded in. Samples are interleaved stereo. Pure logic apart
+ * from audio_dsp fades, so that it can be driven by a simulated source and DMA on host as well. */
+
+/* Fills buffer from the stream, returns number of frames filled - fewer than asked for is an underrun */
+typedef uint32_t (*bt_playout_stream_fill_t)(int16_t *buffer, uint32_t frames, void *context);
+
+typedef struct
+{
+    bool started;
+    bool draining; // Stopped, last period not faded out yet
+    bool fade_in;
+    uint32_t underruns;
+} bt_playout_stream_t;
+
+void bt_playout_stream_init(bt_playout_stream_t *stream);
+void bt_playout_stream_start(bt_playout_stream_t *stream);
+/* Returns false if the stream hasn't been started, i.e. nothing of it has been played and there is nothing to fade out */
+bool bt_playout_stream_stop(bt_playout_stream_t *stream);
+bool bt_playout_stream_is_started(const bt_playout_stream_t *stream);
+/* Neither playing nor draining, nothing of the stream is left to be read */
+bool bt_playout_stream_is_idle(const bt_playout_stream_t *stream);
+/* Output read. Returns true once a stopped stream has been faded out - whatever is still buffered is stale then. */
+bool bt_playout_stream_read(bt_playout_stream_t *stream, int16_t *buffer, uint32_t frames, bt_playout_stream_fill_t fill, void *context);
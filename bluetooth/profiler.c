@@ -0,0 +1,169 @@
+#include "profiler.h"
+#include <hot_path.h>
+
+#if BT_PROFILER_ENABLED
+
+#include <btstack_run_loop.h>
+#include <btstack_util.h>
+#include <pico/time.h>
+#include <stdio.h>
+#include <string.h>
+
+#define BT_PROFILER_DUMP_INTERVAL_MS 5000
+
+typedef struct
+{
+    bt_profiler_stats_t stats;
+    uint32_t enter_time_us[BT_PROFILER_HANDLER_COUNT];
+    volatile uint32_t dma_irq_time_us;
+    volatile bool refill_pending;
+    uint32_t culprit_time_us; // Longest handler run since the last DMA IRQ
+    bt_profiler_handler_t culprit;
+    btstack_timer_source_t dump_timer;
+} bt_profiler_ctx_t;
+
+static bt_profiler_ctx_t ctx;
+
+static const char *const handler_names[BT_PROFILER_HANDLER_COUNT] = {
+    [BT_PROFILER_HANDLER_NONE] = "run loop",
+    [BT_PROFILER_HANDLER_HCI] = "bt_packet_handler",
+    [BT_PROFILER_HANDLER_RECONNECT] = "bt_reconnect_packet_handler",
+    [BT_PROFILER_HANDLER_A2DP] = "bt_a2dp_packet_handler",
+    [BT_PROFILER_HANDLER_A2DP_MEDIA] = "bt_a2dp_media_handler",
+    [BT_PROFILER_HANDLER_AVRCP] = "bt_avrcp_packet_handler",
+    [BT_PROFILER_HANDLER_AVRCP_CONTROLLER] = "bt_avrcp_controller_packet_handler",
+    [BT_PROFILER_HANDLER_AVRCP_TARGET] = "bt_avrcp_target_packet_handler",
+    [BT_PROFILER_HANDLER_I2S_TASK] = "bt_i2s_task",
+    [BT_PROFILER_HANDLER_DECODE_AHEAD] = "bt_a2dp_decode_ahead",
+    [BT_PROFILER_HANDLER_HFP] = "bt_hfp_packet_handler",
+    [BT_PROFILER_HANDLER_HFP_SCO] = "bt_hfp_sco_packet_handler"
+};
+
+static void bt_profiler_dump(void)
+{
+    const bt_profiler_stats_t *stats = &ctx.stats;
+
+    printf("Profiler: %lu refills, max latency %lu us, %lu deadline misses (last by %s)\n",
+           (unsigned long)stats->refills, (unsigned long)stats->refill_latency_max_us,
+           (unsigned long)stats->deadline_misses, handler_names[stats->last_miss_handler]);
+
+    for (uint32_t i = BT_PROFILER_HANDLER_NONE + 1; i < BT_PROFILER_HANDLER_COUNT; ++i) {
+        const bt_profiler_handler_stats_t *handler = &stats->handlers[i];
+        if (handler->calls == 0) {
+            continue;
+        }
+        const uint32_t avg_us = handler->total_us / handler->calls;
+        printf("  %s: %lu calls, avg %lu us, max %lu us, peak/avg %lu\n", handler_names[i], (unsigned long)handler->calls,
+               (unsigned long)avg_us, (unsigned long)handler->max_us, (unsigned long)(handler->max_us / btstack_max(avg_us, 1)));
+    }
+
+    if (stats->decoded_frames > 0) {
+        printf("  SBC decode from %s: %lu frames, avg %lu us, max %lu us\n", HOT_PATH_LOCATION, (unsigned long)stats->decoded_frames,
+               (unsigned long)(stats->decode_total_us / stats->decoded_frames), (unsigned long)stats->decode_max_us);
+    }
+
+    printf("  latency histogram [%u us buckets]:", BT_PROFILER_HISTOGRAM_BUCKET_US);
+    for (uint32_t i = 0; i < BT_PROFILER_HISTOGRAM_BUCKETS; ++i) {
+        printf(" %lu", (unsigned long)stats->refill_latency_histogram[i]);
+    }
+    printf("\n");
+}
+
+static void bt_profiler_dump_task(btstack_timer_source_t *ts)
+{
+    bt_profiler_dump();
+
+    /* Restart timer */
+    btstack_run_loop_set_timer(ts, BT_PROFILER_DUMP_INTERVAL_MS);
+    btstack_run_loop_add_timer(ts);
+}
+
+void bt_profiler_init(void)
+{
+    bt_profiler_reset();
+
+    btstack_run_loop_set_timer_handler(&ctx.dump_timer, bt_profiler_dump_task);
+    btstack_run_loop_set_timer(&ctx.dump_timer, BT_PROFILER_DUMP_INTERVAL_MS);
+    btstack_run_loop_add_timer(&ctx.dump_timer);
+}
+
+void HOT_PATH_FUNC(bt_profiler_enter)(bt_profiler_handler_t handler)
+{
+    ctx.enter_time_us[handler] = time_us_32();
+}
+
+void HOT_PATH_FUNC(bt_profiler_exit)(bt_profiler_handler_t handler)
+{
+    const uint32_t duration_us = time_us_32() - ctx.enter_time_us[handler];
+
+    bt_profiler_handler_stats_t *stats = &ctx.stats.handlers[handler];
+    stats->calls++;
+    stats->total_us += duration_us;
+    stats->max_us = btstack_max(stats->max_us, duration_us);
+
+    /* Remember who blocked the run loop the longest while refill was waiting */
+    if (ctx.refill_pending && (handler != BT_PROFILER_HANDLER_I2S_TASK) && (duration_us > ctx.culprit_time_us)) {
+        ctx.culprit_time_us = duration_us;
+        ctx.culprit = handler;
+    }
+}
+
+void HOT_PATH_FUNC(bt_profiler_dma_irq)(void)
+{
+    ctx.dma_irq_time_us = time_us_32();
+    ctx.refill_pending = true;
+}
+
+void HOT_PATH_FUNC(bt_profiler_refill_done)(uint32_t deadline_us)
+{
+    if (!ctx.refill_pending) {
+        return;
+    }
+
+    const uint32_t latency_us = time_us_32() - ctx.dma_irq_time_us;
+    ctx.refill_pending = false;
+
+    bt_profiler_stats_t *stats = &ctx.stats;
+    stats->refills++;
+    stats->refill_latency_max_us = btstack_max(stats->refill_latency_max_us, latency_us);
+    const uint32_t bucket = btstack_min(latency_us / BT_PROFILER_HISTOGRAM_BUCKET_US, BT_PROFILER_HISTOGRAM_BUCKETS - 1);
+    stats->refill_latency_histogram[bucket]++;
+
+    if (latency_us > deadline_us) {
+        stats->deadline_misses++;
+        stats->last_miss_handler = ctx.culprit;
+    }
+
+    ctx.culprit = BT_PROFILER_HANDLER_NONE;
+    ctx.culprit_time_us = 0;
+}
+
+void HOT_PATH_FUNC(bt_profiler_record_decode)(uint32_t duration_us)
+{
+    bt_profiler_stats_t *stats = &ctx.stats;
+    stats->decoded_frames++;
+    stats->decode_total_us += duration_us;
+    stats->decode_max_us = btstack_max(stats->decode_max_us, duration_us);
+}
+
+void bt_profiler_reset(void)
+{
+    memset(&ctx.stats, 0, sizeof(ctx.stats));
+    ctx.culprit = BT_PROFILER_HANDLER_NONE;
+    ctx.culprit_time_us = 0;
+}
+
+const bt_profiler_stats_t *bt_profiler_get_stats(void)
+{
+    return &ctx.stats;
+}
+
+const char *bt_profiler_get_handler_name(bt_profiler_handler_t handler)
+{
+    if (handler >= BT_PROFILER_HANDLER_COUNT) {
+        return "";
+    }
+    return handler_names[handler];
+}
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Run-loop handler timing and DMA refill deadline tracking, wraps every packet handler and the DMA IRQ.
+ * Off by default, configure with -DBT_PROFILER=ON - stats are then dumped over UART every 5 s. */
+#ifndef BT_PROFILER_ENABLED
+#define BT_PROFILER_ENABLED 0
+#endif
+
+#define BT_PROFILER_HISTOGRAM_BUCKETS 32
+#define BT_PROFILER_HISTOGRAM_BUCKET_US 1000
+
+typedef enum
+{
+    BT_PROFILER_HANDLER_NONE = 0, // Time not spent in any of our handlers - cyw43, HCI transport, BTstack internals
+    BT_PROFILER_HANDLER_HCI,
+    BT_PROFILER_HANDLER_RECONNECT,
+    BT_PROFILER_HANDLER_A2DP,
+    BT_PROFILER_HANDLER_A2DP_MEDIA,
+    BT_PROFILER_HANDLER_AVRCP,
+    BT_PROFILER_HANDLER_AVRCP_CONTROLLER,
+    BT_PROFILER_HANDLER_AVRCP_TARGET,
+    BT_PROFILER_HANDLER_I2S_TASK,
+    BT_PROFILER_HANDLER_DECODE_AHEAD,
+    BT_PROFILER_HANDLER_HFP,
+    BT_PROFILER_HANDLER_HFP_SCO,
+    BT_PROFILER_HANDLER_COUNT
+} bt_profiler_handler_t;
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t max_us;
+    uint64_t total_us;
+} bt_profiler_handler_stats_t;
+
+typedef struct
+{
+    bt_profiler_handler_stats_t handlers[BT_PROFILER_HANDLER_COUNT];
+    uint32_t refills;
+    uint32_t refill_latency_max_us; // From DMA IRQ to buffer refilled
+    uint32_t refill_latency_histogram[BT_PROFILER_HISTOGRAM_BUCKETS];
+    uint32_t deadline_misses;
+    bt_profiler_handler_t last_miss_handler;
+    uint32_t decoded_frames;
+    uint32_t decode_max_us; // Single SBC frame, compare builds with and without AUDIO_HOT_PATH_IN_RAM
+    uint64_t decode_total_us;
+} bt_profiler_stats_t;
+
+#if BT_PROFILER_ENABLED
+
+void bt_profiler_init(void);
+void bt_profiler_enter(bt_profiler_handler_t handler);
+void bt_profiler_exit(bt_profiler_handler_t handler);
+void bt_profiler_dma_irq(void); // Safe to call from IRQ context
+void bt_profiler_refill_done(uint32_t deadline_us);
+void bt_profiler_record_decode(uint32_t duration_us);
+void bt_profiler_reset(void);
+const bt_profiler_stats_t *bt_profiler_get_stats(void);
+const char *bt_profiler_get_handler_name(bt_profiler_handler_t handler);
+
+#else
+
+static inline void bt_profiler_init(void) {}
+static inline void bt_profiler_enter(bt_profiler_handler_t handler) { (void)handler; }
+static inline void bt_profiler_exit(bt_profiler_handler_t handler) { (void)handler; }
+static inline void bt_profiler_dma_irq(void) {}
+static inline void bt_profiler_refill_done(uint32_t deadline_us) { (void)deadline_us; }
+static inline void bt_profiler_record_decode(uint32_t duration_us) { (void)duration_us; }
+static inline void bt_profiler_reset(void) {}
+static inline const bt_profiler_stats_t *bt_profiler_get_stats(void) { return NULL; }
+static inline const char *bt_profiler_get_handler_name(bt_profiler_handler_t handler) { (void)handler; return ""; }
+
+#endif
+
+/* Defines <handler>_profiled, to be registered in place of BTstack packet handler */
+#define BT_PROFILER_PACKET_HANDLER(id, handler) \
+    static void handler##_profiled(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size) \
+    { \
+        bt_profiler_enter(id); \
+        handler(packet_type, channel, packet, size); \
+        bt_profiler_exit(id); \
+    }
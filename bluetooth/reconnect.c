@@ -0,0 +1,192 @@
+#include "reconnect.h"
+#include "profiler.h"
+#include <btstack.h>
+#include <btstack_tlv.h>
+#include <debug_log.h>
+
+#define BT_RECONNECT_MRU_SIZE 4
+#define BT_RECONNECT_MRU_TLV_TAG (((uint32_t)'M' << 24) | ((uint32_t)'R' << 16) | ((uint32_t)'U' << 8) | '0')
+
+#define BT_RECONNECT_PAGE_TIMEOUT 0x0C80 // 2s in 0.625ms slots, default is 5.12s
+
+typedef struct
+{
+    btstack_packet_callback_registration_t hci_registration;
+    const btstack_tlv_t *tlv_impl;
+    void *tlv_context;
+    bd_addr_t mru[BT_RECONNECT_MRU_SIZE];
+    uint8_t mru_count;
+    uint8_t next_candidate;
+    bd_addr_t current_addr;
+    hci_con_handle_t current_handle;
+    bool in_progress;
+    bool awaiting_stream; // Current candidate's ACL is up, A2DP stream not yet
+    bool reconnected;
+} bt_reconnect_ctx_t;
+
+static bt_reconnect_ctx_t ctx;
+
+static void bt_reconnect_mru_load(void)
+{
+    ctx.mru_count = 0;
+    if (ctx.tlv_impl == NULL) {
+        return;
+    }
+
+    const int size = ctx.tlv_impl->get_tag(ctx.tlv_context, BT_RECONNECT_MRU_TLV_TAG, (uint8_t *)ctx.mru, sizeof(ctx.mru));
+    if (size > 0) {
+        ctx.mru_count = size / sizeof(bd_addr_t);
+    }
+}
+
+static void bt_reconnect_mru_store(void)
+{
+    if (ctx.tlv_impl == NULL) {
+        return;
+    }
+
+    ctx.tlv_impl->store_tag(ctx.tlv_context, BT_RECONNECT_MRU_TLV_TAG, (uint8_t *)ctx.mru, ctx.mru_count * sizeof(bd_addr_t));
+}
+
+static void bt_reconnect_try_next(void)
+{
+    ctx.awaiting_stream = false;
+    ctx.reconnected = false;
+    while (ctx.next_candidate < ctx.mru_count) {
+        const uint8_t idx = ctx.next_candidate++;
+
+        /* Skip sources whose link key has been dropped, they would have to pair again anyway */
+        link_key_t link_key;
+        link_key_type_t link_key_type;
+        if (!gap_get_link_key_for_bd_addr(ctx.mru[idx], link_key, &link_key_type)) {
+            continue;
+        }
+
+        uint16_t avdtp_cid;
+        if (a2dp_sink_establish_stream(ctx.mru[idx], &avdtp_cid) == ERROR_CODE_SUCCESS) {
+            bd_addr_copy(ctx.current_addr, ctx.mru[idx]);
+            DEBUG_LOG("Reconnect: paging %s\n", bd_addr_to_str(ctx.current_addr));
+            return;
+        }
+    }
+
+    ctx.in_progress = false;
+    DEBUG_LOG("Reconnect: no known source reachable, waiting for incoming connection\n");
+}
+
+static void bt_reconnect_packet_handler(uint8_t packet_type, uint16_t channel, uint8_t *packet, uint16_t size)
+{
+    if ((packet_type != HCI_EVENT_PACKET) || !ctx.in_progress) {
+        return;
+    }
+
+    const uint8_t type = hci_event_packet_get_type(packet);
+    bd_addr_t addr;
+
+    switch (type) {
+        case HCI_EVENT_CONNECTION_REQUEST:
+            /* Source is connecting by itself, stop paging the rest of the list */
+            ctx.next_candidate = ctx.mru_count;
+            break;
+
+        case HCI_EVENT_CONNECTION_COMPLETE:
+            hci_event_connection_complete_get_bd_addr(packet, addr);
+            if (bd_addr_cmp(addr, ctx.current_addr) != 0) {
+                break;
+            }
+
+            /* Walk goes on until A2DP stream is up - source may still reject it, e.g. when playing to another sink */
+            if (hci_event_connection_complete_get_status(packet) == ERROR_CODE_SUCCESS) {
+                ctx.awaiting_stream = true;
+                ctx.reconnected = true;
+                ctx.current_handle = hci_event_connection_complete_get_connection_handle(packet);
+                DEBUG_LOG("Reconnect: %s connected at %lu ms\n", bd_addr_to_str(addr), (unsigned long)btstack_run_loop_get_time_ms());
+                break;
+            }
+
+            bt_reconnect_try_next();
+            break;
+
+        case HCI_EVENT_DISCONNECTION_COMPLETE:
+            if (ctx.awaiting_stream && (hci_event_disconnection_complete_get_connection_handle(packet) == ctx.current_handle)) {
+                bt_reconnect_try_next();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+BT_PROFILER_PACKET_HANDLER(BT_PROFILER_HANDLER_RECONNECT, bt_reconnect_packet_handler)
+
+void bt_reconnect_init(void)
+{
+    btstack_tlv_get_instance(&ctx.tlv_impl, &ctx.tlv_context);
+    bt_reconnect_mru_load();
+
+    /* Interlaced page scan shortens the time to get found by a new source */
+    gap_set_page_scan_type((ctx.mru_count == 0) ? PAGE_SCAN_MODE_INTERLACED : PAGE_SCAN_MODE_STANDARD);
+    gap_set_page_timeout(BT_RECONNECT_PAGE_TIMEOUT);
+
+    ctx.hci_registration.callback = bt_reconnect_packet_handler_profiled;
+    hci_add_event_handler(&ctx.hci_registration);
+}
+
+void bt_reconnect_start(void)
+{
+    DEBUG_LOG("Reconnect: HCI working at %lu ms, %u known sources\n", (unsigned long)btstack_run_loop_get_time_ms(), ctx.mru_count);
+
+    ctx.next_candidate = 0;
+    ctx.reconnected = false;
+    ctx.in_progress = true;
+    bt_reconnect_try_next();
+}
+
+void bt_reconnect_stream_failed(bd_addr_t addr)
+{
+    if (ctx.in_progress && ctx.awaiting_stream && (bd_addr_cmp(addr, ctx.current_addr) == 0)) {
+        DEBUG_LOG("Reconnect: %s refused stream\n", bd_addr_to_str(addr));
+        bt_reconnect_try_next();
+    }
+}
+
+void bt_reconnect_source_connected(bd_addr_t addr)
+{
+    /* Stream is up, from this candidate or a source that connected by itself */
+    ctx.in_progress = false;
+    ctx.awaiting_stream = false;
+
+    /* Sink initiated the connection, so AVRCP has to be opened by us as well */
+    if (ctx.reconnected && (bd_addr_cmp(addr, ctx.current_addr) == 0)) {
+        ctx.reconnected = false;
+        uint16_t avrcp_cid;
+        avrcp_connect(addr, &avrcp_cid);
+    }
+
+    /* Already the most recently used one, avoid needless flash write */
+    if ((ctx.mru_count > 0) && (bd_addr_cmp(addr, ctx.mru[0]) == 0)) {
+        return;
+    }
+
+    /* Find source in the list, drop the least recently used one if not present */
+    uint8_t idx;
+    for (idx = 0; idx < ctx.mru_count; ++idx) {
+        if (bd_addr_cmp(addr, ctx.mru[idx]) == 0) {
+            break;
+        }
+    }
+    if (idx == ctx.mru_count) {
+        if (ctx.mru_count < BT_RECONNECT_MRU_SIZE) {
+            ctx.mru_count++;
+        }
+        idx = ctx.mru_count - 1;
+    }
+
+    /* Move it to the front */
+    memmove(ctx.mru[1], ctx.mru[0], idx * sizeof(bd_addr_t));
+    bd_addr_copy(ctx.mru[0], addr);
+    bt_reconnect_mru_store();
+
+    gap_set_page_scan_type(PAGE_SCAN_MODE_STANDARD);
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <bluetooth.h>
+
+void bt_reconnect_init(void);
+void bt_reconnect_start(void);
+/* A2DP stream established, or failed to - the next known source is paged then */
+void bt_reconnect_source_connected(bd_addr_t addr);
+void bt_reconnect_stream_failed(bd_addr_t addr);
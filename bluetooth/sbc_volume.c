@@ -0,0 +1,106 @@
+#include "sbc_volume.h"
+
+#define BT_SBC_VOLUME_SYNCWORD 0x9C
+#define BT_SBC_VOLUME_HEADER_BITS 32 // Syncword, parameters, bitpool and CRC
+#define BT_SBC_VOLUME_CRC_INIT 0x0F
+#define BT_SBC_VOLUME_CRC_POLY 0x1D
+
+#define BT_SBC_VOLUME_MODE_MONO 0
+#define BT_SBC_VOLUME_MODE_JOINT_STEREO 3
+#define BT_SBC_VOLUME_ALLOCATION_LOUDNESS 0
+
+/* Loudness allocation offsets from A2DP spec, per sampling frequency */
+static const int8_t bt_sbc_volume_offset4[4][4] = {
+    {-1, 0, 0, 0},
+    {-2, 0, 0, 1},
+    {-2, 0, 0, 1},
+    {-2, 0, 0, 1}
+};
+
+static const int8_t bt_sbc_volume_offset8[4][8] = {
+    {-2, 0, 0, 0, 0, 0, 0, 1},
+    {-3, 0, 0, 0, 0, 0, 1, 2},
+    {-4, 0, 0, 0, 0, 0, 1, 2},
+    {-4, 0, 0, 0, 0, 0, 1, 2}
+};
+
+static uint8_t bt_sbc_volume_get_nibble(const uint8_t *frame, uint32_t index)
+{
+    const uint8_t byte = frame[index / 2];
+    return (index % 2) ? (byte & 0x0F) : (byte >> 4);
+}
+
+static void bt_sbc_volume_set_nibble(uint8_t *frame, uint32_t index, uint8_t value)
+{
+    uint8_t *byte = &frame[index / 2];
+    *byte = (index % 2) ? ((*byte & 0xF0) | value) : ((*byte & 0x0F) | (value << 4));
+}
+
+/* CRC-8 over parameters, bitpool, join flags and scale factors, bit by bit as they don't end on a byte boundary */
+static uint8_t bt_sbc_volume_crc(const uint8_t *frame, uint32_t bits)
+{
+    /* Syncword and CRC itself are not covered */
+    uint8_t crc = BT_SBC_VOLUME_CRC_INIT;
+    for (uint32_t bit = 8; bit < (bits + 16); ++bit) {
+        if ((bit >= 24) && (bit < 32)) {
+            continue;
+        }
+        const uint8_t data_bit = (frame[bit / 8] >> (7 - (bit % 8))) & 1;
+        const uint8_t feedback = (crc >> 7) ^ data_bit;
+        crc <<= 1;
+        if (feedback) {
+            crc ^= BT_SBC_VOLUME_CRC_POLY;
+        }
+    }
+    return crc;
+}
+
+bool bt_sbc_volume_apply(uint8_t *frame, uint32_t size, uint8_t steps)
+{
+    if ((steps == 0) || (steps > BT_SBC_VOLUME_STEPS_MAX) || (size < (BT_SBC_VOLUME_HEADER_BITS / 8)) || (frame[0] != BT_SBC_VOLUME_SYNCWORD)) {
+        return false;
+    }
+
+    const uint8_t sampling_frequency = frame[1] >> 6;
+    const uint8_t channel_mode = (frame[1] >> 2) & 0x03;
+    const uint8_t allocation_method = (frame[1] >> 1) & 0x01;
+    const uint8_t subbands = (frame[1] & 0x01) ? 8 : 4;
+    const uint8_t channels = (channel_mode == BT_SBC_VOLUME_MODE_MONO) ? 1 : 2;
+
+    /* Scale factors are nibble aligned, joint stereo flags take one bit per subband before them */
+    const uint32_t join_bits = (channel_mode == BT_SBC_VOLUME_MODE_JOINT_STEREO) ? subbands : 0;
+    const uint32_t first_nibble = (BT_SBC_VOLUME_HEADER_BITS + join_bits) / 4;
+    const uint32_t scale_factors_count = channels * subbands;
+    const uint32_t crc_bits = 16 + join_bits + 4 * scale_factors_count;
+    if (size < ((first_nibble + scale_factors_count + 1) / 2)) {
+        return false;
+    }
+
+    /* Corrupted frame has to stay detectable by the decoder */
+    if (bt_sbc_volume_crc(frame, crc_bits) != frame[3]) {
+        return false;
+    }
+
+    if ((allocation_method == BT_SBC_VOLUME_ALLOCATION_LOUDNESS) && (steps % 2)) {
+        return false;
+    }
+
+    const int8_t *offsets = (subbands == 8) ? bt_sbc_volume_offset8[sampling_frequency] : bt_sbc_volume_offset4[sampling_frequency];
+    for (uint32_t i = 0; i < scale_factors_count; ++i) {
+        const int32_t scale_factor = bt_sbc_volume_get_nibble(frame, first_nibble + i);
+        if (scale_factor < steps) {
+            return false;
+        }
+        /* Bit need stays at half the loudness only while the loudness is positive, zero scale factor is special cased too */
+        if ((allocation_method == BT_SBC_VOLUME_ALLOCATION_LOUDNESS) && (((scale_factor - steps) == 0) || ((scale_factor - offsets[i % subbands] - steps) <= 0))) {
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < scale_factors_count; ++i) {
+        bt_sbc_volume_set_nibble(frame, first_nibble + i, bt_sbc_volume_get_nibble(frame, first_nibble + i) - steps);
+    }
+    frame[3] = bt_sbc_volume_crc(frame, crc_bits);
+
+    return true;
+}
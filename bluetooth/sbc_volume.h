@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Volume folded into SBC scale factors - dequantization scales each subband by 2^(scale_factor + 1), so lowering
+ * all scale factors of a frame by n attenuates its output by exactly 6.02 dB * n without any per-sample work.
+ * Only done when the decoder's bit allocation is provably left unchanged, i.e. the rest of the frame is still
+ * read the same way:
+ *  - SNR allocation depends on scale factors only relatively, any n up to the smallest scale factor works
+ *  - loudness allocation halves positive loudness values, so only even n keeping all of them positive work
+ * Pure logic without BTstack or Pico dependencies. */
+
+#define BT_SBC_VOLUME_STEPS_MAX 15 // Scale factors are 4 bits
+
+/* Returns false and leaves the frame untouched if it can't be done (or frame CRC is already wrong),
+ * caller falls back to PCM gain of 2^-steps then */
+bool bt_sbc_volume_apply(uint8_t *frame, uint32_t size, uint8_t steps);
@@ -0,0 +1,132 @@
+#include "sco_pipeline.h"
+#include <btstack_util.h>
+#include <classic/hfp.h>
+#include <string.h>
+
+#define BT_SCO_PIPELINE_HEADER_SIZE 3
+#define BT_SCO_PIPELINE_CVSD_MAX_SAMPLES 60 // HCI_HOST_SCO_PACKET_LEN / 2
+
+static uint32_t bt_sco_pipeline_buffered_samples(bt_sco_pipeline_t *pipeline)
+{
+    return btstack_ring_buffer_bytes_available(&pipeline->pcm_ring_buffer) / sizeof(int16_t);
+}
+
+static void bt_sco_pipeline_store(bt_sco_pipeline_t *pipeline, const int16_t *samples, uint32_t num_samples)
+{
+    /* Keep latency bounded - drop the oldest samples rather than let the queue grow */
+    const uint32_t buffered = bt_sco_pipeline_buffered_samples(pipeline);
+    if ((buffered + num_samples) > pipeline->max_depth_samples) {
+        const uint32_t drop = btstack_min(buffered + num_samples - pipeline->max_depth_samples, buffered);
+        uint8_t scratch[32];
+        uint32_t to_skip = drop * sizeof(int16_t);
+        while (to_skip > 0) {
+            uint32_t bytes_read;
+            btstack_ring_buffer_read(&pipeline->pcm_ring_buffer, scratch, btstack_min(to_skip, sizeof(scratch)), &bytes_read);
+            to_skip -= bytes_read;
+        }
+        pipeline->dropped_samples += drop;
+    }
+
+    btstack_ring_buffer_write(&pipeline->pcm_ring_buffer, (uint8_t *)samples, num_samples * sizeof(int16_t));
+
+    const uint32_t depth = bt_sco_pipeline_buffered_samples(pipeline);
+    pipeline->max_depth_seen = btstack_max(pipeline->max_depth_seen, depth);
+    if (!pipeline->primed && (depth >= pipeline->prefill_samples)) {
+        pipeline->primed = true;
+    }
+}
+
+static void bt_sco_pipeline_msbc_callback(int16_t *data, int num_samples, int num_channels, int sample_rate, void *context)
+{
+    (void)num_channels;
+    (void)sample_rate;
+
+    bt_sco_pipeline_store((bt_sco_pipeline_t *)context, data, num_samples);
+}
+
+static void bt_sco_pipeline_cvsd_process(bt_sco_pipeline_t *pipeline, bool bad_frame, const uint8_t *data, uint16_t size)
+{
+    int16_t samples[BT_SCO_PIPELINE_CVSD_MAX_SAMPLES];
+    int16_t output[BT_SCO_PIPELINE_CVSD_MAX_SAMPLES];
+
+    /* Payload is not halfword aligned, M0+ can't read it as int16_t directly */
+    const uint16_t num_samples = btstack_min(size / sizeof(int16_t), BT_SCO_PIPELINE_CVSD_MAX_SAMPLES);
+    for (uint16_t i = 0; i < num_samples; ++i) {
+        samples[i] = (int16_t)little_endian_read_16(data, i * sizeof(int16_t));
+    }
+
+    btstack_cvsd_plc_process_data(&pipeline->cvsd_plc, bad_frame, samples, num_samples, output);
+    bt_sco_pipeline_store(pipeline, output, num_samples);
+}
+
+void bt_sco_pipeline_init(bt_sco_pipeline_t *pipeline, uint8_t codec, uint32_t prefill_ms, uint32_t max_depth_ms)
+{
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->codec = codec;
+
+    if (codec == HFP_CODEC_MSBC) {
+        pipeline->sample_rate = BT_SCO_PIPELINE_SAMPLE_RATE_MSBC;
+        btstack_sbc_decoder_init(&pipeline->msbc_decoder, SBC_MODE_mSBC, bt_sco_pipeline_msbc_callback, pipeline);
+    }
+    else {
+        pipeline->sample_rate = BT_SCO_PIPELINE_SAMPLE_RATE_CVSD;
+        btstack_cvsd_plc_init(&pipeline->cvsd_plc);
+    }
+
+    pipeline->prefill_samples = (prefill_ms * pipeline->sample_rate) / 1000;
+    pipeline->max_depth_samples = btstack_min((max_depth_ms * pipeline->sample_rate) / 1000, BT_SCO_PIPELINE_STORAGE_SAMPLES);
+    btstack_ring_buffer_init(&pipeline->pcm_ring_buffer, pipeline->pcm_storage, sizeof(pipeline->pcm_storage));
+}
+
+void bt_sco_pipeline_packet_received(bt_sco_pipeline_t *pipeline, const uint8_t *packet, uint16_t size)
+{
+    if (size < BT_SCO_PIPELINE_HEADER_SIZE) {
+        return;
+    }
+
+    /* Packet status flag - 0 is correctly received data, anything else is lost or partially lost */
+    const uint8_t packet_status = (packet[1] >> 4) & 0x03;
+    const uint16_t data_size = btstack_min(packet[2], size - BT_SCO_PIPELINE_HEADER_SIZE);
+    const uint8_t *data = &packet[BT_SCO_PIPELINE_HEADER_SIZE];
+
+    pipeline->packets++;
+    if (packet_status != 0) {
+        pipeline->bad_packets++;
+    }
+
+    if (pipeline->codec == HFP_CODEC_MSBC) {
+        /* Decoder finds H2 sync itself and conceals lost frames */
+        btstack_sbc_decoder_process_data(&pipeline->msbc_decoder, packet_status, (uint8_t *)data, data_size);
+    }
+    else {
+        bt_sco_pipeline_cvsd_process(pipeline, packet_status != 0, data, data_size);
+    }
+}
+
+void bt_sco_pipeline_read(bt_sco_pipeline_t *pipeline, int16_t *buffer, uint32_t num_samples)
+{
+    uint32_t bytes_read = 0;
+    if (pipeline->primed) {
+        btstack_ring_buffer_read(&pipeline->pcm_ring_buffer, (uint8_t *)buffer, num_samples * sizeof(int16_t), &bytes_read);
+    }
+
+    /* Underrun, play silence and build up prefill again */
+    const uint32_t samples_read = bytes_read / sizeof(int16_t);
+    if (samples_read < num_samples) {
+        memset(&buffer[samples_read], 0, (num_samples - samples_read) * sizeof(int16_t));
+        if (pipeline->primed) {
+            pipeline->underruns++;
+            pipeline->primed = false;
+        }
+    }
+}
+
+bool bt_sco_pipeline_is_primed(const bt_sco_pipeline_t *pipeline)
+{
+    return pipeline->primed;
+}
+
+uint32_t bt_sco_pipeline_get_depth_us(bt_sco_pipeline_t *pipeline)
+{
+    return ((uint64_t)bt_sco_pipeline_buffered_samples(pipeline) * 1000000U) / pipeline->sample_rate;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <btstack_cvsd_plc.h>
+#include <btstack_ring_buffer.h>
+#include <btstack_sbc.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* SCO packets to mono PCM for the hands-free voice path. Depends only on portable BTstack parts
+ * (SBC decoder, CVSD PLC, ring buffer), so that packet handling and buffering can be driven on host. */
+
+#define BT_SCO_PIPELINE_SAMPLE_RATE_CVSD 8000
+#define BT_SCO_PIPELINE_SAMPLE_RATE_MSBC 16000
+#define BT_SCO_PIPELINE_STORAGE_SAMPLES 512 // 32ms at 16kHz, has to hold max depth plus one mSBC frame
+
+typedef struct
+{
+    uint8_t codec; // HFP_CODEC_CVSD or HFP_CODEC_MSBC
+    uint32_t sample_rate;
+    uint32_t prefill_samples;
+    uint32_t max_depth_samples;
+    btstack_sbc_decoder_state_t msbc_decoder;
+    btstack_cvsd_plc_state_t cvsd_plc;
+    btstack_ring_buffer_t pcm_ring_buffer;
+    uint8_t pcm_storage[BT_SCO_PIPELINE_STORAGE_SAMPLES * sizeof(int16_t)];
+    bool primed;
+    uint32_t packets;
+    uint32_t bad_packets;
+    uint32_t underruns;
+    uint32_t dropped_samples;
+    uint32_t max_depth_seen;
+} bt_sco_pipeline_t;
+
+/* Depths are in ms, prefill is buffered before the first read returns audio */
+void bt_sco_pipeline_init(bt_sco_pipeline_t *pipeline, uint8_t codec, uint32_t prefill_ms, uint32_t max_depth_ms);
+/* Takes a whole HCI SCO packet, including the 3-byte header */
+void bt_sco_pipeline_packet_received(bt_sco_pipeline_t *pipeline, const uint8_t *packet, uint16_t size);
+/* Fills num_samples mono samples, silence on underrun */
+void bt_sco_pipeline_read(bt_sco_pipeline_t *pipeline, int16_t *buffer, uint32_t num_samples);
+bool bt_sco_pipeline_is_primed(const bt_sco_pipeline_t *pipeline);
+uint32_t bt_sco_pipeline_get_depth_us(bt_sco_pipeline_t *pipeline);
@@ -1,4 +1,5 @@
 #include "sdp.h"
+#include "hfp.h"
 #include <btstack.h>
 
 typedef struct 
@@ -7,6 +8,7 @@ typedef struct
     uint8_t sdp_avrcp_target_service_buffer[150];
     uint8_t sdp_avrcp_controller_service_buffer[200];
     uint8_t sdp_device_id_service_buffer[100];
+    uint8_t sdp_hfp_hf_service_buffer[150];
 } bt_sdp_ctx_t;
 
 static bt_sdp_ctx_t ctx;
@@ -41,6 +43,13 @@ static void bt_sdp_register_device_id(void)
     sdp_register_service(ctx.sdp_device_id_service_buffer);
 }
 
+static void bt_sdp_register_hfp_hf(void)
+{
+    const uint32_t handle = sdp_create_service_record_handle();
+    hfp_hf_create_sdp_record(ctx.sdp_hfp_hf_service_buffer, handle, BT_HFP_RFCOMM_CHANNEL, "Hands-Free", bt_hfp_get_supported_features(), 1); // Wide band speech
+    sdp_register_service(ctx.sdp_hfp_hf_service_buffer);
+}
+
 void bt_sdp_init(void)
 {
     sdp_init();
@@ -49,4 +58,5 @@ void bt_sdp_init(void)
     bt_sdp_register_avrcp_controller();
     bt_sdp_register_avrcp_target();
     bt_sdp_register_device_id();
+    bt_sdp_register_hfp_hf();
 }
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <stdint.h>
+
 // BTstack features that can be enabled
 // #define ENABLE_LOG_INFO
 // #define ENABLE_LOG_ERROR
 #define ENABLE_PRINTF_HEXDUMP
 #define ENABLE_SCO_OVER_HCI
+#define ENABLE_HFP_WIDE_BAND_SPEECH
 
 #ifdef ENABLE_BLE
 #define ENABLE_GATT_CLIENT_PAIRING
@@ -40,12 +43,12 @@
 #define MAX_NR_HID_HOST_CONNECTIONS 1
 #define MAX_NR_HIDS_CLIENTS 1
 #define MAX_NR_HFP_CONNECTIONS 1
-#define MAX_NR_L2CAP_CHANNELS  4
-#define MAX_NR_L2CAP_SERVICES  3
+#define MAX_NR_L2CAP_CHANNELS  5
+#define MAX_NR_L2CAP_SERVICES  4
 #define MAX_NR_RFCOMM_CHANNELS 1
 #define MAX_NR_RFCOMM_MULTIPLEXERS 1
 #define MAX_NR_RFCOMM_SERVICES 1
-#define MAX_NR_SERVICE_RECORD_ITEMS 4
+#define MAX_NR_SERVICE_RECORD_ITEMS 5
 #define MAX_NR_SM_LOOKUP_ENTRIES 3
 #define MAX_NR_WHITELIST_ENTRIES 16
 #define MAX_NR_LE_DEVICE_DB_ENTRIES 16
@@ -57,6 +60,7 @@
 // Enable and configure HCI Controller to Host Flow Control to avoid cyw43 shared bus overrun
 #define ENABLE_HCI_CONTROLLER_TO_HOST_FLOW_CONTROL
 #define HCI_HOST_ACL_PACKET_LEN 1024
+// Sent on init, also the upper bound of the pool picked from measured traffic at runtime, see bluetooth/flow_control.h
 #define HCI_HOST_ACL_PACKET_NUM 3
 #define HCI_HOST_SCO_PACKET_LEN 120
 #define HCI_HOST_SCO_PACKET_NUM 3
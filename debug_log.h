@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+
+/* Diagnostic messages from the run loop - connection events, measured latencies, buffer and link stats.
+ * Off by default, the firmware is built without stdio. Configure with -DDEBUG_LOG=ON to get them over UART.
+ * When off, arguments are still type-checked but never evaluated, and the format strings don't take flash. */
+
+#ifndef DEBUG_LOG_ENABLED
+#define DEBUG_LOG_ENABLED 0
+#endif
+
+#define DEBUG_LOG(...) \
+    do { \
+        if (DEBUG_LOG_ENABLED) { \
+            printf(__VA_ARGS__); \
+        } \
+    } while (0)
@@ -0,0 +1,17 @@
+#pragma once
+
+/* Audio hot paths - decode, resample, volume, DMA refill and their tables.
+ * Built with AUDIO_HOT_PATH_IN_RAM=1 these are placed in SRAM, so that XIP cache misses
+ * (which compete with cyw43 SPI traffic) don't add jitter to them. Costs SRAM, see
+ * --print-memory-usage output of both builds for the difference. Coefficient and filter
+ * state used by the hot paths already live in RAM, in the module contexts. BTstack SBC decoder,
+ * code and tables, is moved by a linker script generated in CMakeLists.txt. */
+
+#if defined(AUDIO_HOT_PATH_IN_RAM) && AUDIO_HOT_PATH_IN_RAM
+#include <pico.h>
+#define HOT_PATH_FUNC(name) __not_in_flash_func(name)
+#define HOT_PATH_LOCATION "SRAM"
+#else
+#define HOT_PATH_FUNC(name) name
+#define HOT_PATH_LOCATION "flash"
+#endif
@@ -2,6 +2,7 @@
 #include <pico/stdlib.h>
 #include <pico/cyw43_arch.h>
 #include <bt.h>
+#include <audio_dsp_bench.h>
 
 static void bt_init_done_callback(void *arg)
 {
@@ -12,6 +13,9 @@ int main(void)
 {
     stdio_init_all();
 
+    /* Nothing unless built with AUDIO_DSP_BENCHMARK, runs before cyw43 so nothing interferes */
+    audio_dsp_bench_run();
+
     if (cyw43_arch_init()) {
         panic("Failed to init cyw43_arch!");
     }
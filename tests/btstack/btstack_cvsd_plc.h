@@ -0,0 +1,20 @@
+#pragma once
+
+/* Test double of BTstack CVSD packet loss concealment - good frames pass through unchanged,
+ * bad ones are replaced by the last good frame, and both are counted */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BTSTACK_CVSD_PLC_SAMPLES_MAX 60
+
+typedef struct
+{
+    int16_t last_frame[BTSTACK_CVSD_PLC_SAMPLES_MAX];
+    uint16_t last_frame_samples;
+    uint32_t good_frames;
+    uint32_t bad_frames;
+} btstack_cvsd_plc_state_t;
+
+void btstack_cvsd_plc_init(btstack_cvsd_plc_state_t *plc_state);
+void btstack_cvsd_plc_process_data(btstack_cvsd_plc_state_t *plc_state, bool is_bad_frame, int16_t *in, uint16_t num_samples, int16_t *out);
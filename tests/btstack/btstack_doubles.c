@@ -0,0 +1,132 @@
+#include <btstack_cvsd_plc.h>
+#include <btstack_ring_buffer.h>
+#include <btstack_sbc.h>
+#include <string.h>
+
+#define BTSTACK_SBC_MSBC_SAMPLE_RATE 16000
+
+void btstack_ring_buffer_init(btstack_ring_buffer_t *ring_buffer, uint8_t *storage, uint32_t storage_size)
+{
+    ring_buffer->storage = storage;
+    ring_buffer->size = storage_size;
+    btstack_ring_buffer_reset(ring_buffer);
+}
+
+void btstack_ring_buffer_reset(btstack_ring_buffer_t *ring_buffer)
+{
+    ring_buffer->last_read_index = 0;
+    ring_buffer->last_written_index = 0;
+    ring_buffer->bytes_available = 0;
+}
+
+uint32_t btstack_ring_buffer_bytes_available(btstack_ring_buffer_t *ring_buffer)
+{
+    return ring_buffer->bytes_available;
+}
+
+uint32_t btstack_ring_buffer_bytes_free(btstack_ring_buffer_t *ring_buffer)
+{
+    return ring_buffer->size - ring_buffer->bytes_available;
+}
+
+int btstack_ring_buffer_write(btstack_ring_buffer_t *ring_buffer, uint8_t *data, uint32_t data_length)
+{
+    if (data_length > btstack_ring_buffer_bytes_free(ring_buffer)) {
+        return ERROR_CODE_MEMORY_CAPACITY_EXCEEDED;
+    }
+    for (uint32_t i = 0; i < data_length; ++i) {
+        ring_buffer->storage[ring_buffer->last_written_index] = data[i];
+        ring_buffer->last_written_index = (ring_buffer->last_written_index + 1) % ring_buffer->size;
+    }
+    ring_buffer->bytes_available += data_length;
+    return ERROR_CODE_SUCCESS;
+}
+
+void btstack_ring_buffer_read(btstack_ring_buffer_t *ring_buffer, uint8_t *buffer, uint32_t length, uint32_t *number_of_bytes_read)
+{
+    const uint32_t count = (length < ring_buffer->bytes_available) ? length : ring_buffer->bytes_available;
+    for (uint32_t i = 0; i < count; ++i) {
+        buffer[i] = ring_buffer->storage[ring_buffer->last_read_index];
+        ring_buffer->last_read_index = (ring_buffer->last_read_index + 1) % ring_buffer->size;
+    }
+    ring_buffer->bytes_available -= count;
+    *number_of_bytes_read = count;
+}
+
+void btstack_cvsd_plc_init(btstack_cvsd_plc_state_t *plc_state)
+{
+    memset(plc_state, 0, sizeof(*plc_state));
+}
+
+void btstack_cvsd_plc_process_data(btstack_cvsd_plc_state_t *plc_state, bool is_bad_frame, int16_t *in, uint16_t num_samples, int16_t *out)
+{
+    if (is_bad_frame) {
+        plc_state->bad_frames++;
+        for (uint16_t i = 0; i < num_samples; ++i) {
+            out[i] = (i < plc_state->last_frame_samples) ? plc_state->last_frame[i] : 0;
+        }
+        return;
+    }
+
+    plc_state->good_frames++;
+    memcpy(out, in, num_samples * sizeof(int16_t));
+    plc_state->last_frame_samples = (num_samples < BTSTACK_CVSD_PLC_SAMPLES_MAX) ? num_samples : BTSTACK_CVSD_PLC_SAMPLES_MAX;
+    memcpy(plc_state->last_frame, in, plc_state->last_frame_samples * sizeof(int16_t));
+}
+
+void btstack_sbc_decoder_init(btstack_sbc_decoder_state_t *state, btstack_sbc_mode_t mode, void (*callback)(int16_t *data, int num_samples, int num_channels, int sample_rate, void *context), void *context)
+{
+    memset(state, 0, sizeof(*state));
+    state->mode = mode;
+    state->callback = callback;
+    state->context = context;
+}
+
+static int btstack_sbc_is_h2_header(const uint8_t *header)
+{
+    /* 0x01 followed by sequence number 0..3, each bit doubled */
+    return (header[0] == 0x01) && ((header[1] == 0x08) || (header[1] == 0x38) || (header[1] == 0xC8) || (header[1] == 0xF8));
+}
+
+static void btstack_sbc_frame_complete(btstack_sbc_decoder_state_t *state)
+{
+    int16_t samples[BTSTACK_SBC_MSBC_SAMPLES];
+    const uint8_t *frame = &state->frame[BTSTACK_SBC_MSBC_H2_SIZE];
+
+    if (state->frame_bad || (frame[0] != BTSTACK_SBC_MSBC_SYNCWORD)) {
+        state->concealed_frames++;
+        memcpy(samples, state->last_samples, sizeof(samples));
+    }
+    else {
+        state->good_frames++;
+        const uint16_t frame_number = (uint16_t)(frame[1] | (frame[2] << 8));
+        for (uint32_t i = 0; i < BTSTACK_SBC_MSBC_SAMPLES; ++i) {
+            samples[i] = (int16_t)(frame_number * BTSTACK_SBC_MSBC_SAMPLES + i);
+        }
+        memcpy(state->last_samples, samples, sizeof(samples));
+    }
+
+    state->callback(samples, BTSTACK_SBC_MSBC_SAMPLES, 1, BTSTACK_SBC_MSBC_SAMPLE_RATE, state->context);
+}
+
+void btstack_sbc_decoder_process_data(btstack_sbc_decoder_state_t *state, int packet_status_flag, const uint8_t *buffer, int size)
+{
+    for (int i = 0; i < size; ++i) {
+        state->frame[state->frame_bytes++] = buffer[i];
+        state->frame_bad |= (packet_status_flag != 0);
+
+        /* Hunt for H2 header byte by byte until synchronized */
+        if ((state->frame_bytes == BTSTACK_SBC_MSBC_H2_SIZE) && !btstack_sbc_is_h2_header(state->frame)) {
+            state->frame[0] = state->frame[1];
+            state->frame_bytes = 1;
+            state->frame_bad = (packet_status_flag != 0);
+            continue;
+        }
+
+        if (state->frame_bytes == sizeof(state->frame)) {
+            btstack_sbc_frame_complete(state);
+            state->frame_bytes = 0;
+            state->frame_bad = 0;
+        }
+    }
+}
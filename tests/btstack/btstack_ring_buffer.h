@@ -0,0 +1,24 @@
+#pragma once
+
+/* Test double of BTstack btstack_ring_buffer.h - same API and semantics (all or nothing writes, partial reads) */
+
+#include <stdint.h>
+
+#define ERROR_CODE_SUCCESS 0x00
+#define ERROR_CODE_MEMORY_CAPACITY_EXCEEDED 0x07
+
+typedef struct
+{
+    uint8_t *storage;
+    uint32_t size;
+    uint32_t last_read_index;
+    uint32_t last_written_index;
+    uint32_t bytes_available;
+} btstack_ring_buffer_t;
+
+void btstack_ring_buffer_init(btstack_ring_buffer_t *ring_buffer, uint8_t *storage, uint32_t storage_size);
+void btstack_ring_buffer_reset(btstack_ring_buffer_t *ring_buffer);
+uint32_t btstack_ring_buffer_bytes_available(btstack_ring_buffer_t *ring_buffer);
+uint32_t btstack_ring_buffer_bytes_free(btstack_ring_buffer_t *ring_buffer);
+int btstack_ring_buffer_write(btstack_ring_buffer_t *ring_buffer, uint8_t *data, uint32_t data_length);
+void btstack_ring_buffer_read(btstack_ring_buffer_t *ring_buffer, uint8_t *buffer, uint32_t length, uint32_t *number_of_bytes_read);
@@ -0,0 +1,35 @@
+#pragma once
+
+/* Test double of BTstack SBC decoder in mSBC mode. Like the real one it takes SCO payload in arbitrary chunks,
+ * finds H2 synchronization headers, and conceals frames that had any byte in a packet with bad status.
+ * Frames don't carry real SBC data - the 16-bit number right after the mSBC header is "decoded" into
+ * 120 samples of a ramp, sample n of frame f being (int16_t)(f * 120 + n), so that tests can check order. */
+
+#include <stdint.h>
+
+#define BTSTACK_SBC_MSBC_H2_SIZE 2
+#define BTSTACK_SBC_MSBC_FRAME_SIZE 57
+#define BTSTACK_SBC_MSBC_SAMPLES 120
+#define BTSTACK_SBC_MSBC_SYNCWORD 0xAD
+
+typedef enum
+{
+    SBC_MODE_STANDARD,
+    SBC_MODE_mSBC
+} btstack_sbc_mode_t;
+
+typedef struct
+{
+    btstack_sbc_mode_t mode;
+    void (*callback)(int16_t *data, int num_samples, int num_channels, int sample_rate, void *context);
+    void *context;
+    uint8_t frame[BTSTACK_SBC_MSBC_H2_SIZE + BTSTACK_SBC_MSBC_FRAME_SIZE];
+    uint32_t frame_bytes;
+    int frame_bad;
+    int16_t last_samples[BTSTACK_SBC_MSBC_SAMPLES];
+    uint32_t good_frames;
+    uint32_t concealed_frames;
+} btstack_sbc_decoder_state_t;
+
+void btstack_sbc_decoder_init(btstack_sbc_decoder_state_t *state, btstack_sbc_mode_t mode, void (*callback)(int16_t *data, int num_samples, int num_channels, int sample_rate, void *context), void *context);
+void btstack_sbc_decoder_process_data(btstack_sbc_decoder_state_t *state, int packet_status_flag, const uint8_t *buffer, int size);
@@ -0,0 +1,20 @@
+#pragma once
+
+/* Test double of BTstack btstack_util.h - only what sco_pipeline uses */
+
+#include <stdint.h>
+
+static inline uint32_t btstack_min(uint32_t a, uint32_t b)
+{
+    return (a < b) ? a : b;
+}
+
+static inline uint32_t btstack_max(uint32_t a, uint32_t b)
+{
+    return (a > b) ? a : b;
+}
+
+static inline uint16_t little_endian_read_16(const uint8_t *buffer, int position)
+{
+    return (uint16_t)(buffer[position] | (buffer[position + 1] << 8));
+}
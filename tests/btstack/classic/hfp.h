@@ -0,0 +1,6 @@
+#pragma once
+
+/* Test double of BTstack classic/hfp.h - codec IDs from HFP spec */
+
+#define HFP_CODEC_CVSD 0x01
+#define HFP_CODEC_MSBC 0x02
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Minimal host test harness - failed checks are printed and make the test binary return non-zero */
+
+static int test_failures;
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_CHECK_EQ(actual, expected) \
+    do { \
+        const long long test_actual = (long long)(actual); \
+        const long long test_expected = (long long)(expected); \
+        if (test_actual != test_expected) { \
+            printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #actual, #expected, test_actual, test_expected); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define TEST_RUN(test) \
+    do { \
+        printf("%s\n", #test); \
+        test(); \
+    } while (0)
+
+#define TEST_RESULT() ((test_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+/* Deterministic pseudo-random sequence, so that simulated traces are the same on every run */
+static inline uint32_t test_rand(uint32_t *state)
+{
+    *state = *state * 1664525U + 1013904223U;
+    return *state >> 8;
+}
@@ -0,0 +1,275 @@
+#include "test.h"
+#include <audio_dsp.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+/* AGC and lookahead limiter as bt_i2s runs them - 1024-frame DMA periods at 44.1 kHz, 16-bit in place and
+ * 32-bit output side by side. Output lags input by the lookahead, gains are read back as output over input. */
+
+#define AGC_SAMPLE_RATE 44100
+#define AGC_BLOCK_FRAMES 1024
+#define AGC_FRAMES_MAX (AGC_BLOCK_FRAMES * 440) // ~10 s
+#define AGC_DELAY AUDIO_DSP_AGC_LOOKAHEAD_FRAMES
+#define AGC_CEILING 32112 // -0.18 dBFS, limiter ceiling
+#define AGC_KNEE 20675 // -4 dBFS, limiter soft knee start
+#define AGC_QUIET_DC 2000
+#define AGC_TARGET_DB (-6.02) // Envelope target
+#define AGC_GAIN_MAX (4 * AUDIO_DSP_AGC_GAIN_UNITY)
+#define AGC_RECOVERY_STEP (AUDIO_DSP_AGC_GAIN_UNITY / 16) // Per lookahead sub-block
+#define AGC_PI 3.14159265358979
+
+typedef struct
+{
+    audio_dsp_agc_t agc;
+    audio_dsp_agc_t agc_32;
+    uint32_t frames;
+} agc_run_t;
+
+static int16_t input[AGC_FRAMES_MAX * AUDIO_DSP_CHANNELS];
+static int16_t output[AGC_FRAMES_MAX * AUDIO_DSP_CHANNELS];
+static int32_t output_32[AGC_FRAMES_MAX * AUDIO_DSP_CHANNELS];
+static agc_run_t run;
+
+static void agc_start(void)
+{
+    audio_dsp_agc_init(&run.agc, AGC_SAMPLE_RATE, AGC_BLOCK_FRAMES);
+    audio_dsp_agc_init(&run.agc_32, AGC_SAMPLE_RATE, AGC_BLOCK_FRAMES);
+    run.frames = 0;
+}
+
+/* Next frames_count frames of input through both variants, whole blocks */
+static void agc_process(uint32_t frames_count, int32_t volume)
+{
+    for (uint32_t end = run.frames + frames_count; (run.frames + AGC_BLOCK_FRAMES) <= end; run.frames += AGC_BLOCK_FRAMES) {
+        const uint32_t offset = run.frames * AUDIO_DSP_CHANNELS;
+        memcpy(&output[offset], &input[offset], AGC_BLOCK_FRAMES * AUDIO_DSP_CHANNELS * sizeof(int16_t));
+        audio_dsp_agc_process(&run.agc, &output[offset], AGC_BLOCK_FRAMES, volume);
+        audio_dsp_agc_process_32(&run.agc_32, &input[offset], &output_32[offset], AGC_BLOCK_FRAMES, volume);
+    }
+}
+
+static void agc_fill_sine(uint32_t start, uint32_t frames_count, double freq, double amplitude)
+{
+    for (uint32_t i = start; i < start + frames_count; ++i) {
+        const int16_t sample = (int16_t)lround(amplitude * sin((2.0 * AGC_PI * freq * i) / AGC_SAMPLE_RATE));
+        input[2 * i] = sample;
+        input[2 * i + 1] = sample;
+    }
+}
+
+static void agc_fill_dc(uint32_t start, uint32_t frames_count, int16_t value)
+{
+    for (uint32_t i = start; i < start + frames_count; ++i) {
+        input[2 * i] = value;
+        input[2 * i + 1] = value;
+    }
+}
+
+static double agc_db(double ratio)
+{
+    return 20.0 * log10(ratio);
+}
+
+static int32_t agc_output_peak(uint32_t start, uint32_t frames_count)
+{
+    int32_t peak = 0;
+    for (uint32_t i = AUDIO_DSP_CHANNELS * start; i < AUDIO_DSP_CHANNELS * (start + frames_count); ++i) {
+        const int32_t x = (output[i] < 0) ? -output[i] : output[i];
+        peak = (x > peak) ? x : peak;
+    }
+    return peak;
+}
+
+/* Q12 gain that produced output frame i from the input frame a lookahead earlier, DC input only */
+static int32_t agc_gain_at(uint32_t frame)
+{
+    return (int32_t)(((int64_t)output[2 * frame] * AUDIO_DSP_AGC_GAIN_UNITY) / input[2 * (frame - AGC_DELAY)]);
+}
+
+static void test_output_delayed_by_lookahead(void)
+{
+    agc_start();
+    agc_fill_dc(0, AGC_BLOCK_FRAMES, 0);
+    input[2 * 100] = 8000;
+    input[2 * 100 + 1] = -8000;
+    agc_process(AGC_BLOCK_FRAMES, AUDIO_DSP_GAIN_UNITY);
+
+    uint32_t misplaced = 0;
+    for (uint32_t i = 0; i < AGC_BLOCK_FRAMES * AUDIO_DSP_CHANNELS; ++i) {
+        misplaced += ((output[i] != 0) != ((i / AUDIO_DSP_CHANNELS) == (100 + AGC_DELAY)));
+    }
+    TEST_CHECK_EQ(misplaced, 0);
+    TEST_CHECK(output[2 * (100 + AGC_DELAY)] > 0);
+    TEST_CHECK(abs(output[2 * (100 + AGC_DELAY)] + output[2 * (100 + AGC_DELAY) + 1]) <= 1); // Shift rounds down
+}
+
+static void test_gain_accuracy(void)
+{
+    /* Sine levels in dBFS and where AGC puts them - target, or the +12/-12 dB gain bounds */
+    const double levels_db[] = {-30.0, -24.0, -18.0, -12.0, -6.0, -3.0};
+    double max_error_db = 0.0;
+    for (size_t l = 0; l < sizeof(levels_db) / sizeof(levels_db[0]); ++l) {
+        const double amplitude = 32767.0 * pow(10.0, levels_db[l] / 20.0);
+        agc_start();
+        agc_fill_sine(0, AGC_FRAMES_MAX, 1000.0, amplitude);
+        agc_process(AGC_FRAMES_MAX, AUDIO_DSP_GAIN_UNITY);
+
+        /* Last second, release is 2 s so 8 s are enough to settle from any start */
+        const double gain_db = fmin(fmax(AGC_TARGET_DB - levels_db[l], -12.04), 12.04);
+        const double expected_db = levels_db[l] + gain_db;
+        const double measured_db = agc_db(agc_output_peak(AGC_FRAMES_MAX - AGC_SAMPLE_RATE, AGC_SAMPLE_RATE) / 32767.0);
+        printf("  %6.1f dBFS in: %6.2f dBFS out, expected %6.2f\n", levels_db[l], measured_db, expected_db);
+        max_error_db = fmax(max_error_db, fabs(measured_db - expected_db));
+    }
+    TEST_CHECK(max_error_db < 0.25);
+}
+
+static void test_volume_accuracy(void)
+{
+    /* Volume goes on top of AGC gain, exactly. At target level AGC is settled from the start. */
+    const int32_t volumes[] = {0x4000, 0x2000, 0x0800};
+    const double amplitude = 32767.0 * pow(10.0, AGC_TARGET_DB / 20.0);
+    agc_start();
+    agc_fill_sine(0, AGC_FRAMES_MAX, 1000.0, amplitude);
+    agc_process(AGC_SAMPLE_RATE, AUDIO_DSP_GAIN_UNITY);
+    const double unity_db = agc_db(agc_output_peak(run.frames - AGC_SAMPLE_RATE / 4, AGC_SAMPLE_RATE / 4));
+
+    for (size_t v = 0; v < sizeof(volumes) / sizeof(volumes[0]); ++v) {
+        agc_process(AGC_SAMPLE_RATE / 2, volumes[v]);
+        const double measured_db = agc_db(agc_output_peak(run.frames - AGC_SAMPLE_RATE / 4, AGC_SAMPLE_RATE / 4)) - unity_db;
+        const double expected_db = agc_db((double)volumes[v] / AUDIO_DSP_GAIN_UNITY);
+        printf("  volume %.2f dB: %.2f dB\n", expected_db, measured_db);
+        TEST_CHECK(fabs(measured_db - expected_db) < 0.1);
+    }
+}
+
+static void test_no_overshoot(void)
+{
+    /* Quiet passages get the full +12 dB boost, then full scale bursts start at arbitrary positions -
+     * on block and lookahead boundaries, and off them. No sample may pass the ceiling. */
+    uint32_t seed = 7;
+    agc_start();
+    agc_fill_sine(0, AGC_FRAMES_MAX, 440.0, 32767.0 * pow(10.0, -30.0 / 20.0));
+    const uint32_t starts[] = {3 * AGC_BLOCK_FRAMES, 10 * AGC_BLOCK_FRAMES + AGC_DELAY, 20 * AGC_BLOCK_FRAMES + 1, 30 * AGC_BLOCK_FRAMES - 1};
+    for (uint32_t burst = 0; burst < 200; ++burst) {
+        const uint32_t start = (burst < 4) ? starts[burst] : (40 * AGC_BLOCK_FRAMES + test_rand(&seed) % (AGC_FRAMES_MAX - 41 * AGC_BLOCK_FRAMES));
+        const uint32_t length = 1 + test_rand(&seed) % 600;
+        for (uint32_t i = start; i < start + length; ++i) {
+            input[2 * i] = (int16_t)(test_rand(&seed) >> 16);
+            input[2 * i + 1] = (burst % 2) ? INT16_MIN : INT16_MAX;
+        }
+    }
+
+    /* Max volume, then half - limiter has to work against any gain */
+    agc_process(AGC_FRAMES_MAX / 2, AUDIO_DSP_GAIN_UNITY);
+    agc_process(AGC_FRAMES_MAX / 2, AUDIO_DSP_GAIN_UNITY / 2);
+
+    uint32_t overshoots = 0;
+    uint32_t overshoots_32 = 0;
+    int32_t peak_32 = 0;
+    for (uint32_t i = 0; i < run.frames * AUDIO_DSP_CHANNELS; ++i) {
+        overshoots += (output[i] > AGC_CEILING) || (output[i] < -AGC_CEILING);
+        const int32_t sample_32 = output_32[i] / 65536;
+        overshoots_32 += (sample_32 > AGC_CEILING) || (sample_32 < -AGC_CEILING);
+        peak_32 = (abs(sample_32) > peak_32) ? abs(sample_32) : peak_32;
+    }
+    const int32_t peak = agc_output_peak(0, run.frames);
+    printf("  output peak %.2f dBFS, 32-bit %.2f dBFS\n", agc_db(peak / 32767.0), agc_db(peak_32 / 32767.0));
+    TEST_CHECK_EQ(overshoots, 0);
+    TEST_CHECK_EQ(overshoots_32, 0);
+    TEST_CHECK(peak > AGC_KNEE + (AGC_CEILING - AGC_KNEE) / 2); // Limiter was actually working, deep in the knee
+}
+
+static void test_gain_never_steps(void)
+{
+    /* Quiet DC settles at the +12 dB bound, full scale DC starting right at a block boundary needs -1.3 dB. Gain
+     * has to get there within the lookahead, one ramp - old clamp at block start jumped the whole way in one sample. */
+    const uint32_t quiet_frames = 300 * AGC_BLOCK_FRAMES;
+    const uint32_t loud_frames = 20 * AGC_BLOCK_FRAMES;
+    agc_start();
+    agc_fill_dc(0, quiet_frames, AGC_QUIET_DC);
+    agc_fill_dc(quiet_frames, loud_frames, 30000);
+    agc_fill_dc(quiet_frames + loud_frames, 100 * AGC_BLOCK_FRAMES, AGC_QUIET_DC);
+    agc_process(quiet_frames + loud_frames + 100 * AGC_BLOCK_FRAMES, AUDIO_DSP_GAIN_UNITY);
+
+    int32_t max_fall = 0;
+    int32_t max_rise = 0;
+    int32_t previous = agc_gain_at(quiet_frames - AGC_BLOCK_FRAMES);
+    for (uint32_t i = quiet_frames - AGC_BLOCK_FRAMES + 1; i < run.frames; ++i) {
+        const int32_t gain = agc_gain_at(i);
+        max_fall = ((previous - gain) > max_fall) ? (previous - gain) : max_fall;
+        max_rise = ((gain - previous) > max_rise) ? (gain - previous) : max_rise;
+        previous = gain;
+    }
+
+    /* Gain ahead of the step is the +12 dB bound, under the ceiling from the first loud sample. Measured gain
+     * carries quantization of the quiet output, one LSB of it. */
+    const int32_t resolution = AUDIO_DSP_AGC_GAIN_UNITY / AGC_QUIET_DC + 1;
+    const int32_t quiet_gain = agc_gain_at(quiet_frames);
+    const int32_t loud_gain = agc_gain_at(quiet_frames + AGC_DELAY);
+    printf("  gain %.2f dB before, %.2f dB at the step, max fall %ld, max rise %ld per sample (Q12)\n",
+           agc_db((double)quiet_gain / AUDIO_DSP_AGC_GAIN_UNITY), agc_db((double)loud_gain / AUDIO_DSP_AGC_GAIN_UNITY),
+           (long)max_fall, (long)max_rise);
+    TEST_CHECK(abs(quiet_gain - AGC_GAIN_MAX) <= resolution);
+    TEST_CHECK(loud_gain <= (AGC_CEILING * AUDIO_DSP_AGC_GAIN_UNITY) / 30000);
+    TEST_CHECK(max_fall <= (AGC_GAIN_MAX / AGC_DELAY) + resolution);
+    TEST_CHECK(max_rise <= (AGC_RECOVERY_STEP / AGC_DELAY) + resolution);
+}
+
+static void test_mute_ramps_to_silence(void)
+{
+    agc_start();
+    agc_fill_sine(0, 20 * AGC_BLOCK_FRAMES, 1000.0, 16000.0);
+    agc_process(10 * AGC_BLOCK_FRAMES, AUDIO_DSP_GAIN_UNITY);
+    const uint32_t mute_frame = run.frames;
+    agc_process(10 * AGC_BLOCK_FRAMES, 0);
+
+    /* Over a block, not at once, and silent after that */
+    TEST_CHECK(agc_output_peak(mute_frame + AGC_DELAY, AGC_DELAY) > 8000);
+    TEST_CHECK_EQ(agc_output_peak(mute_frame + AGC_BLOCK_FRAMES + AGC_DELAY, 9 * AGC_BLOCK_FRAMES - AGC_DELAY), 0);
+}
+
+static void test_16_and_32_bit_identical(void)
+{
+    /* 32-bit output keeps the bits 16-bit output drops, and nothing else */
+    uint32_t seed = 99;
+    agc_start();
+    for (uint32_t i = 0; i < AGC_FRAMES_MAX * AUDIO_DSP_CHANNELS; ++i) {
+        input[i] = (int16_t)((int32_t)(test_rand(&seed) >> 16) >> ((i / 50000) % 6));
+    }
+    agc_process(AGC_FRAMES_MAX, AUDIO_DSP_GAIN_UNITY);
+
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < run.frames * AUDIO_DSP_CHANNELS; ++i) {
+        mismatches += (output[i] != (int16_t)(output_32[i] >> 16));
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_host_cost_per_frame(void)
+{
+    /* Host figure only for spotting regressions, target cycles come from AUDIO_DSP_BENCHMARK build */
+    uint32_t seed = 5;
+    for (uint32_t i = 0; i < AGC_FRAMES_MAX * AUDIO_DSP_CHANNELS; ++i) {
+        input[i] = (int16_t)(test_rand(&seed) >> 16);
+    }
+    agc_start();
+    const clock_t start = clock();
+    agc_process(AGC_FRAMES_MAX, AUDIO_DSP_GAIN_UNITY);
+    const double elapsed_ns = (1e9 * (double)(clock() - start)) / CLOCKS_PER_SEC;
+    printf("  host: %.2f ns per frame, 16 and 32-bit together\n", elapsed_ns / AGC_FRAMES_MAX);
+}
+
+int main(void)
+{
+    TEST_RUN(test_output_delayed_by_lookahead);
+    TEST_RUN(test_gain_accuracy);
+    TEST_RUN(test_volume_accuracy);
+    TEST_RUN(test_no_overshoot);
+    TEST_RUN(test_gain_never_steps);
+    TEST_RUN(test_mute_ramps_to_silence);
+    TEST_RUN(test_16_and_32_bit_identical);
+    TEST_RUN(test_host_cost_per_frame);
+    return TEST_RESULT();
+}
@@ -0,0 +1,263 @@
+#include "test.h"
+#include <string.h>
+
+/* Packed kernels (SMULWB/SMULWT/SMLSD/PKHBT/PKHTB, selected on cores with the DSP extension) against portable ones.
+ * audio_dsp.c is built a second time in here with C models of the instructions, its functions renamed
+ * so that they link next to the portable build. */
+
+#define AUDIO_DSP_EMULATE_PACKED 1
+#define audio_dsp_gain_stereo packed_gain_stereo
+#define audio_dsp_gain_stereo_32 packed_gain_stereo_32
+#define audio_dsp_ramp_stereo packed_ramp_stereo
+#define audio_dsp_fade_stereo packed_fade_stereo
+#define audio_dsp_resample_init packed_resample_init
+#define audio_dsp_resample_set_factor packed_resample_set_factor
+#define audio_dsp_resample_block packed_resample_block
+#define audio_dsp_agc_init packed_agc_init
+#define audio_dsp_agc_reset packed_agc_reset
+#define audio_dsp_agc_process packed_agc_process
+#define audio_dsp_agc_process_32 packed_agc_process_32
+#define audio_dsp_crossover_init packed_crossover_init
+#define audio_dsp_crossover_reset packed_crossover_reset
+#define audio_dsp_crossover_process packed_crossover_process
+#include <audio_dsp.c>
+#undef audio_dsp_gain_stereo
+#undef audio_dsp_gain_stereo_32
+#undef audio_dsp_ramp_stereo
+#undef audio_dsp_fade_stereo
+#undef audio_dsp_resample_init
+#undef audio_dsp_resample_set_factor
+#undef audio_dsp_resample_block
+
+void audio_dsp_gain_stereo(int16_t *buffer, size_t frames_count, int32_t gain);
+void audio_dsp_gain_stereo_32(const int16_t *input, int32_t *output, size_t frames_count, int32_t gain);
+void audio_dsp_ramp_stereo(int16_t *buffer, size_t frames_count, int32_t gain_start, int32_t gain_step);
+void audio_dsp_fade_stereo(int16_t *buffer, size_t frames_count, bool fade_in);
+void audio_dsp_resample_init(audio_dsp_resample_t *resample, uint8_t num_channels);
+void audio_dsp_resample_set_factor(audio_dsp_resample_t *resample, uint32_t factor);
+uint32_t audio_dsp_resample_block(audio_dsp_resample_t *resample, const int16_t *input, uint32_t frames_count, int16_t *output);
+
+#define TEST_FRAMES_ALL (65536 / AUDIO_DSP_CHANNELS) // Every int16 value exactly once, L and R
+
+static int16_t input[TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS];
+static int16_t portable[TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS];
+static int16_t packed[TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS];
+
+static void fill_all_values(void)
+{
+    /* Even values left, odd values right in scrambled order, so that lanes can't leak into each other unnoticed */
+    for (uint32_t i = 0; i < TEST_FRAMES_ALL; ++i) {
+        input[2 * i] = (int16_t)(uint16_t)(i * 2);
+        input[2 * i + 1] = (int16_t)(uint16_t)(((i * 40503) & 0x7FFF) * 2 + 1);
+    }
+}
+
+static uint32_t count_mismatches(void)
+{
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS; ++i) {
+        mismatches += (portable[i] != packed[i]);
+    }
+    return mismatches;
+}
+
+static void test_gain_bit_exact_over_all_samples_and_gains(void)
+{
+    fill_all_values();
+
+    /* Every Q15 gain from mute to unity inclusive, on every int16 value including -32768 */
+    uint32_t mismatches = 0;
+    for (int32_t gain = 0; gain <= AUDIO_DSP_GAIN_UNITY; ++gain) {
+        memcpy(portable, input, sizeof(input));
+        memcpy(packed, input, sizeof(input));
+        audio_dsp_gain_stereo(portable, TEST_FRAMES_ALL, gain);
+        packed_gain_stereo(packed, TEST_FRAMES_ALL, gain);
+        mismatches += count_mismatches();
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_gain_corner_cases(void)
+{
+    /* 0x8000 as a sample is -32768, as a gain it's unity - both at once has to pass through unchanged */
+    int16_t frame[2] = {INT16_MIN, INT16_MAX};
+    packed_gain_stereo(frame, 1, AUDIO_DSP_GAIN_UNITY);
+    TEST_CHECK_EQ(frame[0], INT16_MIN);
+    TEST_CHECK_EQ(frame[1], INT16_MAX);
+
+    frame[0] = INT16_MIN;
+    frame[1] = -1;
+    packed_gain_stereo(frame, 1, 1);
+    TEST_CHECK_EQ(frame[0], -1);
+    TEST_CHECK_EQ(frame[1], -1); // Arithmetic shift rounds towards minus infinity on both paths
+
+    frame[0] = INT16_MIN;
+    frame[1] = INT16_MAX;
+    packed_gain_stereo(frame, 1, 0);
+    TEST_CHECK_EQ(frame[0], 0);
+    TEST_CHECK_EQ(frame[1], 0);
+}
+
+static void test_ramps_and_fades_bit_exact(void)
+{
+    fill_all_values();
+
+    /* Ramps over whole buffers, up and down, steep and shallow, ending exactly at unity and at mute */
+    const int32_t steps[] = {1, 3, 7, 64};
+    uint32_t mismatches = 0;
+    for (size_t s = 0; s < sizeof(steps) / sizeof(steps[0]); ++s) {
+        const size_t frames = AUDIO_DSP_GAIN_UNITY / steps[s];
+        const size_t count = (frames < TEST_FRAMES_ALL) ? frames : TEST_FRAMES_ALL;
+
+        memcpy(portable, input, sizeof(input));
+        memcpy(packed, input, sizeof(input));
+        audio_dsp_ramp_stereo(portable, count, AUDIO_DSP_GAIN_UNITY - (int32_t)count * steps[s], steps[s]);
+        packed_ramp_stereo(packed, count, AUDIO_DSP_GAIN_UNITY - (int32_t)count * steps[s], steps[s]);
+        mismatches += count_mismatches();
+
+        memcpy(portable, input, sizeof(input));
+        memcpy(packed, input, sizeof(input));
+        audio_dsp_ramp_stereo(portable, count, (int32_t)count * steps[s], -steps[s]);
+        packed_ramp_stereo(packed, count, (int32_t)count * steps[s], -steps[s]);
+        mismatches += count_mismatches();
+    }
+
+    for (int fade_in = 0; fade_in <= 1; ++fade_in) {
+        memcpy(portable, input, sizeof(input));
+        memcpy(packed, input, sizeof(input));
+        audio_dsp_fade_stereo(portable, 1024, fade_in);
+        packed_fade_stereo(packed, 1024, fade_in);
+        mismatches += count_mismatches();
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_gain_32_keeps_low_bits(void)
+{
+    /* Shared by both builds - upper half is the 16-bit result, lower half only adds precision below it */
+    fill_all_values();
+    static int32_t wide[TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS];
+    const int32_t gains[] = {0, 1, 0x1234, 0x4000, 0x5A82, 0x7FFF, AUDIO_DSP_GAIN_UNITY};
+    uint32_t mismatches = 0;
+    for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); ++g) {
+        memcpy(portable, input, sizeof(input));
+        audio_dsp_gain_stereo(portable, TEST_FRAMES_ALL, gains[g]);
+        audio_dsp_gain_stereo_32(input, wide, TEST_FRAMES_ALL, gains[g]);
+        for (uint32_t i = 0; i < TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS; ++i) {
+            mismatches += (portable[i] != (int16_t)(wide[i] >> 16));
+            mismatches += ((int64_t)wide[i] != ((int64_t)input[i] * gains[g] * 2));
+        }
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+/* Linear interpolation at position k * factor over the whole stream, the way btstack_resample computes it */
+static int16_t resample_reference(const int16_t *stream, uint32_t channels, uint64_t position, uint32_t channel)
+{
+    const uint64_t index = position >> 16;
+    const int32_t t = (int32_t)(position & 0xFFFF);
+    const int32_t s1 = stream[index * channels + channel];
+    const int32_t s2 = stream[(index + 1) * channels + channel];
+    return (int16_t)((s1 * (0x10000 - t) + s2 * t) >> 16);
+}
+
+/* Streams the input through both kernels in SBC sized and random blocks, checks them against each other and the
+ * reference. Returns mismatches. */
+static uint32_t resample_stream(uint32_t channels, uint32_t factor, uint32_t seed)
+{
+    audio_dsp_resample_t portable_resample;
+    audio_dsp_resample_t packed_resample;
+    audio_dsp_resample_init(&portable_resample, (uint8_t)channels);
+    packed_resample_init(&packed_resample, (uint8_t)channels);
+    audio_dsp_resample_set_factor(&portable_resample, factor);
+    packed_resample_set_factor(&packed_resample, factor);
+
+    const uint32_t input_frames = (TEST_FRAMES_ALL * AUDIO_DSP_CHANNELS) / channels;
+    uint32_t mismatches = 0;
+    uint32_t consumed = 0;
+    uint64_t output_frames = 0;
+    while (consumed < input_frames) {
+        uint32_t block = (test_rand(&seed) & 1) ? 128 : (1 + (test_rand(&seed) % 300));
+        block = (block < (input_frames - consumed)) ? block : (input_frames - consumed);
+
+        static int16_t portable_block[400 * AUDIO_DSP_CHANNELS];
+        static int16_t packed_block[400 * AUDIO_DSP_CHANNELS];
+        const int16_t *block_input = &input[consumed * channels];
+        const uint32_t portable_frames = audio_dsp_resample_block(&portable_resample, block_input, block, portable_block);
+        const uint32_t packed_frames = packed_resample_block(&packed_resample, block_input, block, packed_block);
+        mismatches += (portable_frames != packed_frames);
+        mismatches += (uint32_t)(memcmp(portable_block, packed_block, portable_frames * channels * sizeof(int16_t)) != 0);
+
+        /* Stream starts interpolating between its first two frames */
+        for (uint32_t i = 0; i < portable_frames; ++i) {
+            for (uint32_t c = 0; c < channels; ++c) {
+                mismatches += (portable_block[i * channels + c] != resample_reference(input, channels, (output_frames + i) * factor, c));
+            }
+        }
+        output_frames += portable_frames;
+        consumed += block;
+    }
+
+    /* Everything up to the last input frame has been produced, next output needs a frame after it */
+    mismatches += (((output_frames * factor) >> 16) < (input_frames - 1));
+    return mismatches;
+}
+
+static void test_resample_bit_exact(void)
+{
+    fill_all_values();
+
+    /* Unity, playout policy corrections either way, sample rate conversion 44.1 - 48 kHz both ways, and a factor
+     * whose fraction walks through every t */
+    const uint32_t factors[] = {AUDIO_DSP_RESAMPLE_FACTOR_UNITY, 0xFF00, 0xFFC0, 0x10040, 0x10100, 60211, 71331, 0x10001, 0xFFFF};
+    uint32_t mismatches = 0;
+    for (size_t f = 0; f < sizeof(factors) / sizeof(factors[0]); ++f) {
+        mismatches += resample_stream(AUDIO_DSP_CHANNELS, factors[f], 100 + (uint32_t)f);
+        mismatches += resample_stream(1, factors[f], 200 + (uint32_t)f);
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_resample_corner_cases(void)
+{
+    /* Full scale steps both ways in both lanes at every weight, the extremes of the intermediate sum */
+    uint32_t mismatches = 0;
+    const int16_t pairs[][2] = {{INT16_MIN, INT16_MAX}, {INT16_MAX, INT16_MIN}, {INT16_MIN, INT16_MIN}, {INT16_MAX, INT16_MAX}, {-1, 0}};
+    for (size_t p = 0; p < sizeof(pairs) / sizeof(pairs[0]); ++p) {
+        for (uint32_t t = 0; t < 0x10000; ++t) {
+            const int16_t a[2] = {pairs[p][0], pairs[p][1]};
+            const int16_t b[2] = {pairs[p][1], pairs[p][0]};
+            int16_t output[2];
+            audio_dsp_lerp_frames(a, b, t, AUDIO_DSP_CHANNELS, output);
+            mismatches += (output[0] != audio_dsp_lerp(a[0], b[0], t));
+            mismatches += (output[1] != audio_dsp_lerp(a[1], b[1], t));
+        }
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+
+    /* Unity factor passes through, one frame late */
+    audio_dsp_resample_t resample;
+    packed_resample_init(&resample, AUDIO_DSP_CHANNELS);
+    const int16_t first[4] = {1, -1, 2, -2};
+    const int16_t second[4] = {3, -3, 4, -4};
+    int16_t output[8];
+    TEST_CHECK_EQ(packed_resample_block(&resample, first, 2, output), 1);
+    TEST_CHECK_EQ(output[0], 1);
+    TEST_CHECK_EQ(output[1], -1);
+    TEST_CHECK_EQ(packed_resample_block(&resample, second, 2, output), 2);
+    TEST_CHECK_EQ(output[0], 2);
+    TEST_CHECK_EQ(output[1], -2);
+    TEST_CHECK_EQ(output[2], 3);
+    TEST_CHECK_EQ(output[3], -3);
+}
+
+int main(void)
+{
+    TEST_RUN(test_gain_bit_exact_over_all_samples_and_gains);
+    TEST_RUN(test_gain_corner_cases);
+    TEST_RUN(test_ramps_and_fades_bit_exact);
+    TEST_RUN(test_gain_32_keeps_low_bits);
+    TEST_RUN(test_resample_bit_exact);
+    TEST_RUN(test_resample_corner_cases);
+    return TEST_RESULT();
+}
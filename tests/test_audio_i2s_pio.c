@@ -0,0 +1,432 @@
+#include "test.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* audio_i2s.pio assembled and run on a cycle-level model of one PIO state machine - OUT to one data pin,
+ * 2-bit side-set for the clocks, autopull from TX FIFO with the threshold audio_i2s_sm_init sets.
+ * The pins are then read back like a receiver does, on BCLK rising edges, and bit and frame alignment is
+ * checked for I2S, left-justified and TDM at 16, 24 and 32 bits. Only the instructions used by the programs
+ * are modelled - an unknown one fails the test, so that the model is extended together with the programs. */
+
+#define PIO_INSTRUCTIONS_MAX 32
+#define PIO_PROGRAMS_MAX 4
+#define PIO_LABELS_MAX 8
+#define PIO_NAME_MAX 32
+#define PIO_FIFO_WORDS 512
+#define PIO_EDGES_MAX 8192
+#define PIO_FRAMES 16
+#define PIO_SAMPLE_RATE 44100
+
+typedef enum
+{
+    PIO_OP_OUT_PINS,
+    PIO_OP_MOV_X_Y,
+    PIO_OP_JMP_X_DEC
+} pio_op_t;
+
+typedef struct
+{
+    pio_op_t op;
+    uint8_t bit_count;
+    uint8_t target;
+    uint8_t side;
+} pio_instruction_t;
+
+typedef struct
+{
+    char name[PIO_NAME_MAX];
+    int16_t offset;
+} pio_label_t;
+
+typedef struct
+{
+    char name[PIO_NAME_MAX];
+    pio_instruction_t instructions[PIO_INSTRUCTIONS_MAX];
+    uint8_t length;
+    pio_label_t labels[PIO_LABELS_MAX];
+    uint8_t labels_count;
+} pio_program_t;
+
+typedef struct
+{
+    pio_program_t programs[PIO_PROGRAMS_MAX];
+    uint8_t count;
+    uint32_t errors;
+} pio_file_t;
+
+/* Receiver view - data and frame clock at each BCLK rising edge */
+typedef struct
+{
+    uint8_t data[PIO_EDGES_MAX];
+    uint8_t frame_clock[PIO_EDGES_MAX];
+    uint32_t count;
+    uint32_t pulls; // 32-bit FIFO words taken, i.e. DMA transfers
+    uint32_t cycles;
+    uint32_t uneven_periods; // BCLK periods other than two PIO cycles
+} pio_trace_t;
+
+typedef enum
+{
+    FORMAT_I2S,
+    FORMAT_LEFT_JUSTIFIED,
+    FORMAT_TDM
+} format_t;
+
+static pio_file_t file;
+static uint32_t fifo[PIO_FIFO_WORDS];
+static pio_trace_t trace;
+
+static char *pio_trim(char *text)
+{
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while ((end > text) && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+static pio_label_t *pio_find_label(pio_program_t *program, const char *name)
+{
+    for (uint8_t i = 0; i < program->labels_count; ++i) {
+        if (strcmp(program->labels[i].name, name) == 0) {
+            return &program->labels[i];
+        }
+    }
+    return NULL;
+}
+
+static pio_program_t *pio_find_program(const char *name)
+{
+    for (uint8_t i = 0; i < file.count; ++i) {
+        if (strcmp(file.programs[i].name, name) == 0) {
+            return &file.programs[i];
+        }
+    }
+    return NULL;
+}
+
+static void pio_parse_error(const char *line)
+{
+    printf("  can't assemble: %s\n", line);
+    file.errors++;
+}
+
+static void pio_parse_instruction(pio_program_t *program, char *line, char jump_targets[][PIO_NAME_MAX])
+{
+    pio_instruction_t *instruction = &program->instructions[program->length];
+    char *side = strstr(line, " side ");
+    if ((side == NULL) || (strncmp(pio_trim(side + 6), "0b", 2) != 0)) {
+        pio_parse_error(line);
+        return;
+    }
+    instruction->side = (uint8_t)strtoul(pio_trim(side + 6) + 2, NULL, 2);
+    *side = '\0';
+    line = pio_trim(line);
+
+    char target[PIO_NAME_MAX] = "";
+    unsigned bit_count;
+    if (strcmp(line, "mov x, y") == 0) {
+        instruction->op = PIO_OP_MOV_X_Y;
+    }
+    else if (sscanf(line, "out pins, %u", &bit_count) == 1) {
+        instruction->op = PIO_OP_OUT_PINS;
+        instruction->bit_count = (uint8_t)bit_count;
+    }
+    else if (sscanf(line, "jmp x-- %31s", target) == 1) {
+        instruction->op = PIO_OP_JMP_X_DEC;
+    }
+    else {
+        pio_parse_error(line);
+        return;
+    }
+    strcpy(jump_targets[program->length], target);
+    program->length++;
+}
+
+/* Programs, labels and instructions, c-sdk blocks skipped */
+static void pio_assemble(const char *path)
+{
+    memset(&file, 0, sizeof(file));
+    FILE *source = fopen(path, "r");
+    if (source == NULL) {
+        printf("  can't open %s\n", path);
+        file.errors++;
+        return;
+    }
+
+    static char jump_targets[PIO_PROGRAMS_MAX][PIO_INSTRUCTIONS_MAX][PIO_NAME_MAX];
+    pio_program_t *program = NULL;
+    bool in_c_block = false;
+    char buffer[256];
+    while (fgets(buffer, sizeof(buffer), source) != NULL) {
+        char *comment = strchr(buffer, ';');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char *line = pio_trim(buffer);
+        if (strncmp(line, "% c-sdk", 7) == 0) {
+            in_c_block = true;
+        }
+        else if (strncmp(line, "%}", 2) == 0) {
+            in_c_block = false;
+        }
+        else if (in_c_block || (line[0] == '\0') || (strcmp(line, ".side_set 2") == 0)) {
+            continue;
+        }
+        else if (sscanf(line, ".program %31s", buffer) == 1) {
+            program = &file.programs[file.count++];
+            strcpy(program->name, buffer);
+        }
+        else if ((program != NULL) && (line[strlen(line) - 1] == ':')) {
+            line[strlen(line) - 1] = '\0';
+            if (strncmp(line, "public ", 7) == 0) {
+                line = pio_trim(line + 7);
+            }
+            pio_label_t *label = &program->labels[program->labels_count++];
+            strcpy(label->name, line);
+            label->offset = program->length;
+        }
+        else if (program != NULL) {
+            pio_parse_instruction(program, line, jump_targets[program - file.programs]);
+        }
+        else {
+            pio_parse_error(line);
+        }
+    }
+    fclose(source);
+
+    for (uint8_t p = 0; p < file.count; ++p) {
+        for (uint8_t i = 0; i < file.programs[p].length; ++i) {
+            if (file.programs[p].instructions[i].op == PIO_OP_JMP_X_DEC) {
+                const pio_label_t *label = pio_find_label(&file.programs[p], jump_targets[p][i]);
+                if (label == NULL) {
+                    pio_parse_error(jump_targets[p][i]);
+                    continue;
+                }
+                file.programs[p].instructions[i].target = (uint8_t)label->offset;
+            }
+        }
+    }
+}
+
+/* Runs until FIFO runs dry. Side-set bit 0 is BCLK, bit 1 LRCLK/FSYNC, wrap is the whole program. */
+static void pio_run(const pio_program_t *program, uint8_t entry, uint32_t y, uint32_t pull_threshold, uint32_t words)
+{
+    memset(&trace, 0, sizeof(trace));
+    uint32_t osr = 0;
+    uint32_t shift_count = 32; // Emptied by audio_i2s_program_init
+    uint32_t x = 0;
+    uint8_t pc = entry;
+    uint8_t data_pin = 0;
+    uint8_t side = 0;
+    uint32_t edge_cycle = 0;
+
+    for (;;) {
+        const pio_instruction_t *instruction = &program->instructions[pc];
+        uint8_t next = (pc + 1) % program->length;
+
+        switch (instruction->op) {
+            case PIO_OP_OUT_PINS:
+                if (shift_count >= pull_threshold) {
+                    if (trace.pulls == words) {
+                        return; // Would stall
+                    }
+                    osr = fifo[trace.pulls++];
+                    shift_count = 0;
+                }
+                data_pin = (osr >> 31) & 1;
+                osr <<= instruction->bit_count;
+                shift_count += instruction->bit_count;
+                break;
+
+            case PIO_OP_MOV_X_Y:
+                x = y;
+                break;
+
+            case PIO_OP_JMP_X_DEC:
+                if (x != 0) {
+                    next = instruction->target;
+                }
+                x--;
+                break;
+        }
+
+        /* Side-set and OUT take effect together at the end of the cycle */
+        if (!(side & 1) && (instruction->side & 1) && (trace.count < PIO_EDGES_MAX)) {
+            trace.data[trace.count] = data_pin;
+            trace.frame_clock[trace.count] = (instruction->side >> 1) & 1;
+            trace.uneven_periods += (trace.count > 0) && ((trace.cycles - edge_cycle) != 2);
+            edge_cycle = trace.cycles;
+            trace.count++;
+        }
+        side = instruction->side;
+        trace.cycles++;
+        pc = next;
+    }
+}
+
+/* Samples, with the value in upper bits as bt_i2s writes them, chosen so that every bit position flips */
+static int32_t sample_value(uint32_t frame, uint32_t channel)
+{
+    const uint32_t seed = (frame * 8 + channel) * 2654435761U;
+    return (int32_t)(seed ^ (seed >> 13) ^ 0xA5C3F00F);
+}
+
+/* Slot as the receiver assembles it from bits MSB first, left-aligned in 32 bits */
+static int32_t trace_slot(uint32_t first_edge, uint32_t bits)
+{
+    uint32_t value = 0;
+    for (uint32_t b = 0; b < bits; ++b) {
+        value |= (uint32_t)trace.data[first_edge + b] << (31 - b);
+    }
+    return (int32_t)value;
+}
+
+/* Packed words go out upper (right) half first, so the right slot following left n carries right n + 1 - the one slot
+ * skew between channels packed output has always had. Wide samples are one word per slot, in frame order. */
+static int32_t expected_slot(uint32_t frame, uint32_t channel, uint32_t bits, bool packed)
+{
+    const uint32_t value = (uint32_t)sample_value(frame + ((packed && (channel == 1)) ? 1 : 0), channel);
+    return (int32_t)(packed ? (value & 0xFFFF0000U) : (value & (0xFFFFFFFFU << (32 - bits))));
+}
+
+/* Same choice of program, entry point, Y and pull threshold as audio_i2s_sm_init */
+static void run_format(format_t format, uint32_t bits, uint32_t channels, bool packed)
+{
+    const char *names[] = {"i2s_out_master", "lj_out_master", "tdm_out_master"};
+    const pio_program_t *program = pio_find_program(names[format]);
+    TEST_CHECK(program != NULL);
+    if (program == NULL) {
+        return;
+    }
+
+    pio_label_t *entry = pio_find_label((pio_program_t *)program, (packed && (format != FORMAT_TDM)) ? "entry_point" : "entry_left");
+    TEST_CHECK(entry != NULL);
+    if (entry == NULL) {
+        return;
+    }
+    const uint32_t y = (format == FORMAT_TDM) ? (bits * channels - 2) : (bits - 2);
+    const uint32_t pull_threshold = packed ? 32 : bits;
+
+    /* Packed int16_t L/R pairs are one little endian word, left in the lower half */
+    uint32_t words = 0;
+    for (uint32_t frame = 0; frame < PIO_FRAMES; ++frame) {
+        if (packed) {
+            fifo[words++] = ((uint32_t)sample_value(frame, 0) >> 16) | ((uint32_t)sample_value(frame, 1) & 0xFFFF0000U);
+        }
+        else {
+            for (uint32_t channel = 0; channel < channels; ++channel) {
+                fifo[words++] = (uint32_t)sample_value(frame, channel);
+            }
+        }
+    }
+    pio_run(program, (uint8_t)entry->offset, y, pull_threshold, words);
+}
+
+/* Edges at which the frame clock changes to the level of the first slot (I2S, LJ), or a sync pulse starts (TDM) */
+static uint32_t trace_frame_starts(uint32_t *starts, uint8_t first_level)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < trace.count; ++i) {
+        if ((trace.frame_clock[i] == first_level) && ((i == 0) || (trace.frame_clock[i - 1] != first_level))) {
+            starts[count++] = i;
+        }
+    }
+    return count;
+}
+
+/* Checks every complete frame, returns the number checked. MSB is delay edges after frame clock change. */
+static uint32_t check_frames(format_t format, uint32_t bits, uint32_t channels, bool packed, uint32_t delay)
+{
+    /* Left is LRCLK low in I2S, high in left-justified. TDM sync pulse is high. */
+    const uint8_t first_level = (format == FORMAT_I2S) ? 0 : 1;
+    static uint32_t starts[PIO_EDGES_MAX];
+    const uint32_t count = trace_frame_starts(starts, first_level);
+    const uint32_t frame_edges = bits * channels;
+
+    uint32_t mismatches = 0;
+    uint32_t checked = 0;
+    for (uint32_t s = 0; (s + 1) < count; ++s) {
+        /* Frame clock period and duty are exact */
+        mismatches += ((starts[s + 1] - starts[s]) != frame_edges);
+        for (uint32_t e = starts[s]; e < starts[s + 1]; ++e) {
+            const uint32_t position = e - starts[s];
+            const uint8_t expected_clock = (format == FORMAT_TDM) ? (position == 0) : ((position < bits) ? first_level : !first_level);
+            mismatches += (trace.frame_clock[e] != expected_clock);
+        }
+
+        /* First frame clock edge starts frame 0 - packed output has the right slot of frame 0 ahead of it */
+        if ((starts[s] + delay + frame_edges) > trace.count) {
+            break;
+        }
+        for (uint32_t channel = 0; channel < channels; ++channel) {
+            const int32_t slot = trace_slot(starts[s] + delay + channel * bits, bits);
+            mismatches += (slot != expected_slot(s, channel, bits, packed));
+        }
+        checked++;
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+    return checked;
+}
+
+static void check_format(format_t format, uint32_t bits, uint32_t channels, bool packed)
+{
+    /* I2S: MSB one BCLK after LRCLK edge. LJ: MSB with LRCLK edge. TDM (DSP mode A): MSB one BCLK after sync. */
+    const uint32_t delay = (format == FORMAT_LEFT_JUSTIFIED) ? 0 : 1;
+    run_format(format, bits, channels, packed);
+    const uint32_t checked = check_frames(format, bits, channels, packed, delay);
+    TEST_CHECK(checked >= PIO_FRAMES - 3);
+
+    /* Two PIO cycles per BCLK, one DMA word per frame packed, one per slot otherwise */
+    const uint32_t words_per_frame = packed ? 1 : channels;
+    TEST_CHECK_EQ(trace.uneven_periods, 0);
+    TEST_CHECK_EQ(trace.pulls, PIO_FRAMES * words_per_frame);
+    printf("  %-15s %2lu-bit %lu slots%s: %lu frames aligned, %lu BCLK and %lu DMA words per frame, %.3f MHz BCLK at 44.1 kHz\n",
+           (format == FORMAT_I2S) ? "I2S" : ((format == FORMAT_TDM) ? "TDM" : "left-justified"), (unsigned long)bits,
+           (unsigned long)channels, packed ? " packed" : "", (unsigned long)checked, (unsigned long)(bits * channels),
+           (unsigned long)words_per_frame, (PIO_SAMPLE_RATE * bits * channels) / 1e6);
+}
+
+static void test_program_assembles(void)
+{
+    pio_assemble(AUDIO_I2S_PIO_PATH);
+    TEST_CHECK_EQ(file.errors, 0);
+    TEST_CHECK_EQ(file.count, 3);
+}
+
+static void test_i2s_alignment(void)
+{
+    check_format(FORMAT_I2S, 16, 2, true);
+    check_format(FORMAT_I2S, 16, 2, false);
+    check_format(FORMAT_I2S, 24, 2, false);
+    check_format(FORMAT_I2S, 32, 2, false);
+}
+
+static void test_left_justified_alignment(void)
+{
+    check_format(FORMAT_LEFT_JUSTIFIED, 16, 2, true);
+    check_format(FORMAT_LEFT_JUSTIFIED, 16, 2, false);
+    check_format(FORMAT_LEFT_JUSTIFIED, 24, 2, false);
+    check_format(FORMAT_LEFT_JUSTIFIED, 32, 2, false);
+}
+
+static void test_tdm_alignment(void)
+{
+    check_format(FORMAT_TDM, 16, 2, false);
+    check_format(FORMAT_TDM, 24, 2, false);
+    check_format(FORMAT_TDM, 32, 2, false);
+    check_format(FORMAT_TDM, 32, 8, false);
+}
+
+int main(void)
+{
+    TEST_RUN(test_program_assembles);
+    TEST_RUN(test_i2s_alignment);
+    TEST_RUN(test_left_justified_alignment);
+    TEST_RUN(test_tdm_alignment);
+    return TEST_RESULT();
+}
@@ -0,0 +1,174 @@
+#include "test.h"
+#include <audio_dsp.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+/* Linkwitz-Riley crossover as configured in bi-amp mode - 4th order Butterworth squared sections in Q12.
+ * Bands are in phase at every frequency, so woofer and tweeter sum to a flat (allpass) response. */
+
+#define XO_SAMPLE_RATE 44100
+#define XO_FREQ_HZ 2000
+#define XO_AMPLITUDE 8000.0
+#define XO_SETTLE_FRAMES 8192
+#define XO_MEASURE_FRAMES_MAX 16384
+#define XO_FRAMES (XO_SETTLE_FRAMES + XO_MEASURE_FRAMES_MAX)
+#define XO_PI 3.14159265358979
+
+typedef struct
+{
+    double amplitude;
+    double phase; // Radians
+} xo_tone_t;
+
+static int16_t input[XO_FRAMES * AUDIO_DSP_CHANNELS];
+static int16_t low[XO_FRAMES * AUDIO_DSP_CHANNELS];
+static int16_t high[XO_FRAMES * AUDIO_DSP_CHANNELS];
+static int16_t sum[XO_FRAMES]; // Left channel only
+
+static double xo_db(double ratio)
+{
+    return 20.0 * log10(ratio);
+}
+
+static double xo_degrees(double radians)
+{
+    double degrees = radians * 180.0 / XO_PI;
+    while (degrees > 180.0) {
+        degrees -= 360.0;
+    }
+    while (degrees < -180.0) {
+        degrees += 360.0;
+    }
+    return degrees;
+}
+
+/* Same tone on both channels, each has its own filter state */
+static void xo_run(double freq)
+{
+    for (uint32_t i = 0; i < XO_FRAMES; ++i) {
+        const int16_t sample = (int16_t)lround(XO_AMPLITUDE * sin((2.0 * XO_PI * freq * i) / XO_SAMPLE_RATE));
+        input[2 * i] = sample;
+        input[2 * i + 1] = sample;
+    }
+
+    audio_dsp_crossover_t xo;
+    audio_dsp_crossover_init(&xo, XO_SAMPLE_RATE, XO_FREQ_HZ);
+    audio_dsp_crossover_process(&xo, input, low, high, XO_FRAMES);
+}
+
+/* Amplitude and phase at freq over a whole number of periods after the filters have settled */
+static xo_tone_t xo_measure(const int16_t *samples, uint32_t stride, double freq)
+{
+    const uint32_t periods = (uint32_t)((XO_MEASURE_FRAMES_MAX * freq) / XO_SAMPLE_RATE);
+    const uint32_t frames = (uint32_t)lround((periods * (double)XO_SAMPLE_RATE) / freq);
+
+    double re = 0.0;
+    double im = 0.0;
+    for (uint32_t i = XO_SETTLE_FRAMES; i < XO_SETTLE_FRAMES + frames; ++i) {
+        const double w = (2.0 * XO_PI * freq * i) / XO_SAMPLE_RATE;
+        re += samples[i * stride] * sin(w);
+        im += samples[i * stride] * cos(w);
+    }
+
+    xo_tone_t tone = {2.0 * sqrt(re * re + im * im) / frames, atan2(im, re)};
+    return tone;
+}
+
+static xo_tone_t xo_measure_sum(double freq)
+{
+    for (uint32_t i = 0; i < XO_FRAMES; ++i) {
+        sum[i] = (int16_t)(low[2 * i] + high[2 * i]);
+    }
+    return xo_measure(sum, 1, freq);
+}
+
+static void test_bands_sum_flat(void)
+{
+    const double freqs[] = {50, 100, 250, 500, 1000, 1500, 2000, 2500, 3000, 4000, 6000, 8000, 12000, 16000, 20000};
+    double max_dev_db = 0.0;
+    for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); ++f) {
+        xo_run(freqs[f]);
+        const double in = xo_measure(input, 2, freqs[f]).amplitude;
+        const double dev_db = fabs(xo_db(xo_measure_sum(freqs[f]).amplitude / in));
+        max_dev_db = (dev_db > max_dev_db) ? dev_db : max_dev_db;
+    }
+    printf("  max deviation of low + high from input %.3f dB\n", max_dev_db);
+    TEST_CHECK(max_dev_db < 0.1);
+}
+
+static void test_bands_in_phase(void)
+{
+    /* Where both bands carry energy, i.e. two octaves around crossover frequency */
+    const double freqs[] = {500, 1000, 1500, 2000, 2500, 3000, 4000, 8000};
+    double max_phase_deg = 0.0;
+    for (size_t f = 0; f < sizeof(freqs) / sizeof(freqs[0]); ++f) {
+        xo_run(freqs[f]);
+        const double phase_deg = fabs(xo_degrees(xo_measure(low, 2, freqs[f]).phase - xo_measure(high, 2, freqs[f]).phase));
+        max_phase_deg = (phase_deg > max_phase_deg) ? phase_deg : max_phase_deg;
+    }
+    printf("  max phase difference between bands %.2f deg\n", max_phase_deg);
+    TEST_CHECK(max_phase_deg < 2.0);
+}
+
+static void test_both_bands_6db_down_at_crossover(void)
+{
+    xo_run(XO_FREQ_HZ);
+    const double in = xo_measure(input, 2, XO_FREQ_HZ).amplitude;
+    const double low_db = xo_db(xo_measure(low, 2, XO_FREQ_HZ).amplitude / in);
+    const double high_db = xo_db(xo_measure(high, 2, XO_FREQ_HZ).amplitude / in);
+    printf("  at %u Hz: low %.2f dB, high %.2f dB\n", XO_FREQ_HZ, low_db, high_db);
+    TEST_CHECK(fabs(low_db + 6.02) < 0.2);
+    TEST_CHECK(fabs(high_db + 6.02) < 0.2);
+}
+
+static void test_channels_identical(void)
+{
+    /* Channel states don't leak into each other */
+    xo_run(1000);
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < XO_FRAMES; ++i) {
+        mismatches += (low[2 * i] != low[2 * i + 1]) + (high[2 * i] != high[2 * i + 1]);
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_in_place(void)
+{
+    /* bt_i2s splits in place, low band into the input buffer */
+    xo_run(1000);
+    static int16_t in_place[XO_FRAMES * AUDIO_DSP_CHANNELS];
+    memcpy(in_place, input, sizeof(input));
+    audio_dsp_crossover_t xo;
+    audio_dsp_crossover_init(&xo, XO_SAMPLE_RATE, XO_FREQ_HZ);
+    audio_dsp_crossover_process(&xo, in_place, in_place, high, XO_FRAMES);
+    TEST_CHECK(memcmp(in_place, low, sizeof(low)) == 0);
+}
+
+static void test_host_cost_per_biquad(void)
+{
+    /* Host figure only for spotting regressions, target cycles come from AUDIO_DSP_BENCHMARK build */
+    xo_run(1000);
+    audio_dsp_crossover_t xo;
+    audio_dsp_crossover_init(&xo, XO_SAMPLE_RATE, XO_FREQ_HZ);
+
+    const uint32_t runs = 20;
+    const clock_t start = clock();
+    for (uint32_t run = 0; run < runs; ++run) {
+        audio_dsp_crossover_process(&xo, input, low, high, XO_FRAMES);
+    }
+    const double elapsed_ns = (1e9 * (double)(clock() - start)) / CLOCKS_PER_SEC;
+    const double biquads = (double)runs * XO_FRAMES * AUDIO_DSP_CHANNELS * AUDIO_DSP_CROSSOVER_BANDS * AUDIO_DSP_CROSSOVER_STAGES;
+    printf("  host: %.2f ns per biquad\n", elapsed_ns / biquads);
+}
+
+int main(void)
+{
+    TEST_RUN(test_bands_sum_flat);
+    TEST_RUN(test_bands_in_phase);
+    TEST_RUN(test_both_bands_6db_down_at_crossover);
+    TEST_RUN(test_channels_identical);
+    TEST_RUN(test_in_place);
+    TEST_RUN(test_host_cost_per_biquad);
+    return TEST_RESULT();
+}
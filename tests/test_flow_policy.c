@@ -0,0 +1,222 @@
+#include "test.h"
+#include <flow_control.h>
+#include <flow_policy.h>
+#include <string.h>
+
+/* Simulated controller transport feeding the flow policy the way bt_flow_control does - the source sends bursts of
+ * ACL packets, controller forwards them into the transport while it has fewer than pool size outstanding and holds
+ * the rest back. Host reads one packet at a time like BTstack with its single incoming buffer, and returns it once
+ * processed. Windows are closed every 2 s, the connection is concluded at its end. */
+
+#define SIM_TICK_US 100 // Controller forwards at most one packet per tick, i.e. back to back within a burst
+#define SIM_WINDOW_US 2000000
+#define SIM_PACKET_SIZE 679 // 2-DH5 payload
+#define SIM_WINDOWS 10
+
+typedef struct
+{
+    uint32_t burst_packets; // Sent by the source back to back
+    uint32_t burst_period_us;
+    uint32_t turnaround_us; // Host processes each packet this long
+} sim_traffic_t;
+
+typedef struct
+{
+    uint32_t now_us;
+    uint32_t pending; // Held back by the controller
+    uint32_t queued; // Sent by the controller, waiting in the transport
+    uint32_t outstanding; // Sent by the controller and not returned yet
+    bool busy; // Host processing a packet
+    uint32_t busy_since_us;
+} sim_t;
+
+static const sim_traffic_t bursts = {6, 20000, 2000};
+static const sim_traffic_t steady = {1, 20000, 2000};
+static const sim_traffic_t slow = {1, 20000, 30000};
+static const sim_traffic_t idle = {0, 20000, 2000};
+
+static bt_flow_policy_stats_t sim_window(sim_t *sim, bt_flow_policy_t *policy, uint16_t pool, const sim_traffic_t *traffic)
+{
+    const uint32_t end_us = sim->now_us + SIM_WINDOW_US;
+    for (; sim->now_us < end_us; sim->now_us += SIM_TICK_US) {
+        if ((sim->now_us % traffic->burst_period_us) == 0) {
+            sim->pending += traffic->burst_packets;
+        }
+
+        if (sim->busy && ((sim->now_us - sim->busy_since_us) >= traffic->turnaround_us)) {
+            sim->busy = false;
+            sim->outstanding--;
+            bt_flow_policy_packets_completed(policy, sim->now_us, 1);
+        }
+
+        if ((sim->pending > 0) && (sim->outstanding < pool)) {
+            sim->pending--;
+            sim->queued++;
+            sim->outstanding++;
+        }
+
+        if (!sim->busy && (sim->queued > 0)) {
+            sim->queued--;
+            sim->busy = true;
+            sim->busy_since_us = sim->now_us;
+            bt_flow_policy_acl_received(policy, sim->now_us, SIM_PACKET_SIZE);
+        }
+    }
+
+    bt_flow_policy_stats_t stats;
+    bt_flow_policy_update(policy, sim->now_us, &stats);
+    return stats;
+}
+
+/* One connection with the given traffic in each window, returns whether it concluded a change */
+static bool sim_connection(uint16_t pool, const sim_traffic_t *const *traffic, uint32_t windows, uint16_t *packets)
+{
+    sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    bt_flow_policy_t policy;
+    bt_flow_policy_init(&policy, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, pool, 0);
+    for (uint32_t w = 0; w < windows; ++w) {
+        sim_window(&sim, &policy, pool, traffic[w]);
+    }
+    return bt_flow_policy_conclude(&policy, packets);
+}
+
+static bool sim_uniform_connection(uint16_t pool, const sim_traffic_t *traffic, uint16_t *packets)
+{
+    const sim_traffic_t *windows[SIM_WINDOWS];
+    for (uint32_t w = 0; w < SIM_WINDOWS; ++w) {
+        windows[w] = traffic;
+    }
+    return sim_connection(pool, windows, SIM_WINDOWS, packets);
+}
+
+static void test_bursts_grow_pool(void)
+{
+    uint16_t packets = 0;
+    TEST_CHECK(sim_uniform_connection(2, &bursts, &packets));
+    TEST_CHECK_EQ(packets, 3);
+}
+
+static void test_slow_completions_shrink_pool(void)
+{
+    uint16_t packets = 0;
+    TEST_CHECK(sim_uniform_connection(3, &slow, &packets));
+    TEST_CHECK_EQ(packets, 2);
+}
+
+static void test_steady_traffic_keeps_pool(void)
+{
+    uint16_t packets = 0;
+    TEST_CHECK(!sim_uniform_connection(3, &steady, &packets));
+    TEST_CHECK_EQ(packets, 3);
+}
+
+static void test_bounds_hold(void)
+{
+    uint16_t packets = 0;
+    TEST_CHECK(!sim_uniform_connection(BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, &bursts, &packets));
+    TEST_CHECK_EQ(packets, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX);
+    TEST_CHECK(!sim_uniform_connection(BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, &slow, &packets));
+    TEST_CHECK_EQ(packets, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN);
+
+    /* One step from the pool in effect, however one-sided the votes */
+    TEST_CHECK(sim_uniform_connection(BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX - 1, &bursts, &packets));
+    TEST_CHECK_EQ(packets, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX);
+    TEST_CHECK(sim_uniform_connection(BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN + 1, &slow, &packets));
+    TEST_CHECK_EQ(packets, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN);
+}
+
+static void test_one_slow_window_does_not_undo_grow(void)
+{
+    const sim_traffic_t *windows[SIM_WINDOWS] = {&bursts, &bursts, &bursts, &slow, &bursts, &bursts, &bursts, &bursts, &bursts, &bursts};
+    uint16_t packets = 0;
+    TEST_CHECK(sim_connection(2, windows, SIM_WINDOWS, &packets));
+    TEST_CHECK_EQ(packets, 3);
+}
+
+static void test_one_burst_window_does_not_grow(void)
+{
+    const sim_traffic_t *windows[SIM_WINDOWS] = {&steady, &steady, &bursts, &steady, &steady, &steady, &steady, &steady, &steady, &steady};
+    uint16_t packets = 0;
+    TEST_CHECK(!sim_connection(2, windows, SIM_WINDOWS, &packets));
+    TEST_CHECK_EQ(packets, 2);
+}
+
+static void test_idle_windows_do_not_vote(void)
+{
+    /* Paused stream on a long connection doesn't outvote what happened while it played */
+    const sim_traffic_t *windows[30];
+    for (uint32_t w = 0; w < 30; ++w) {
+        windows[w] = (w < 4) ? &bursts : &idle;
+    }
+    uint16_t packets = 0;
+    TEST_CHECK(sim_connection(2, windows, 30, &packets));
+    TEST_CHECK_EQ(packets, 3);
+}
+
+static void test_votes_start_over_after_conclusion(void)
+{
+    sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    bt_flow_policy_t policy;
+    bt_flow_policy_init(&policy, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, 2, 0);
+
+    /* Like a suspend after bursts, then a steady stream on resume - new size not applied yet */
+    for (uint32_t w = 0; w < SIM_WINDOWS; ++w) {
+        sim_window(&sim, &policy, 2, &bursts);
+    }
+    uint16_t packets = 0;
+    TEST_CHECK(bt_flow_policy_conclude(&policy, &packets));
+    TEST_CHECK_EQ(packets, 3);
+
+    for (uint32_t w = 0; w < SIM_WINDOWS; ++w) {
+        sim_window(&sim, &policy, 2, &steady);
+    }
+    TEST_CHECK(!bt_flow_policy_conclude(&policy, &packets));
+    TEST_CHECK_EQ(packets, 2);
+}
+
+static void test_applied_size_is_the_base(void)
+{
+    sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    bt_flow_policy_t policy;
+    bt_flow_policy_init(&policy, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, 2, 0);
+    bt_flow_policy_set_packets(&policy, 3);
+
+    /* Controller runs with the grown pool now, bursts no longer run into it */
+    for (uint32_t w = 0; w < SIM_WINDOWS; ++w) {
+        sim_window(&sim, &policy, 3, &bursts);
+    }
+    uint16_t packets = 0;
+    TEST_CHECK(!bt_flow_policy_conclude(&policy, &packets));
+    TEST_CHECK_EQ(packets, 3);
+}
+
+static void test_host_holds_one_buffer(void)
+{
+    /* Serial host never has more than one buffer in use, whatever the pool - the rest waits in the transport */
+    sim_t sim;
+    memset(&sim, 0, sizeof(sim));
+    bt_flow_policy_t policy;
+    bt_flow_policy_init(&policy, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MIN, BT_FLOW_CONTROL_HOST_ACL_PACKET_NUM_MAX, 3, 0);
+    const bt_flow_policy_stats_t stats = sim_window(&sim, &policy, 3, &bursts);
+    TEST_CHECK_EQ(stats.occupancy_max, 1);
+    TEST_CHECK(stats.burst_max >= 3);
+    TEST_CHECK(stats.stall_us > 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_bursts_grow_pool);
+    TEST_RUN(test_slow_completions_shrink_pool);
+    TEST_RUN(test_steady_traffic_keeps_pool);
+    TEST_RUN(test_bounds_hold);
+    TEST_RUN(test_one_slow_window_does_not_undo_grow);
+    TEST_RUN(test_one_burst_window_does_not_grow);
+    TEST_RUN(test_idle_windows_do_not_vote);
+    TEST_RUN(test_votes_start_over_after_conclusion);
+    TEST_RUN(test_applied_size_is_the_base);
+    TEST_RUN(test_host_holds_one_buffer);
+    return TEST_RESULT();
+}
@@ -0,0 +1,222 @@
+#include "test.h"
+#include <jitter_policy.h>
+#include <string.h>
+
+/* Replays media packet arrival traces through the jitter policy the way bt_a2dp_jitter_target_update
+ * drives it - every arrival is recorded, once per second the window is closed with current RSSI.
+ * Built-in traces are synthetic. A recorded one can be replayed with
+ *   test_jitter_policy <trace>
+ * where each line is "<arrival ms> <RTP sequence number> [<RSSI>]", '#' starts a comment. */
+
+#define TRACE_FRAMES_MIN 20
+#define TRACE_FRAMES_MAX 90
+#define TRACE_FRAMES_INITIAL 60
+#define TRACE_UPDATE_INTERVAL_MS 1000
+#define TRACE_FRAMES_PER_SECOND (44100 / 128)
+#define TRACE_PACKET_MS 20 // 7 SBC frames of 128 samples at 44.1 kHz
+#define TRACE_EVENTS_MAX 65536
+
+typedef struct
+{
+    uint32_t time_ms;
+    uint16_t sequence_number;
+    int8_t rssi;
+} trace_event_t;
+
+typedef struct
+{
+    uint32_t final_target;
+    uint32_t max_target;
+    uint32_t raises; // Windows that ended with a higher target than the previous one
+    uint32_t windows;
+} trace_result_t;
+
+static trace_event_t events[TRACE_EVENTS_MAX];
+
+static trace_result_t trace_replay(const trace_event_t *trace, uint32_t count, bool verbose)
+{
+    bt_jitter_policy_t policy;
+    bt_jitter_policy_init(&policy, TRACE_FRAMES_MIN, TRACE_FRAMES_MAX, TRACE_FRAMES_INITIAL);
+
+    trace_result_t result = {TRACE_FRAMES_INITIAL, 0, 0, 0};
+    uint32_t update_time_ms = (count > 0) ? trace[0].time_ms : 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        bt_jitter_policy_packet_arrived(&policy, trace[i].time_ms, trace[i].sequence_number);
+        if ((trace[i].time_ms - update_time_ms) < TRACE_UPDATE_INTERVAL_MS) {
+            continue;
+        }
+        update_time_ms = trace[i].time_ms;
+
+        bt_jitter_policy_set_rssi(&policy, trace[i].rssi);
+        const uint32_t target = bt_jitter_policy_update(&policy, TRACE_FRAMES_PER_SECOND);
+        result.raises += (target > result.final_target);
+        result.final_target = target;
+        result.max_target = (result.final_target > result.max_target) ? result.final_target : result.max_target;
+        result.windows++;
+        if (verbose) {
+            printf("  %lu ms: target %lu frames\n", (unsigned long)trace[i].time_ms, (unsigned long)result.final_target);
+        }
+    }
+    return result;
+}
+
+/* Steady stream with up to jitter_ms late arrivals */
+static uint32_t trace_generate(uint32_t duration_ms, uint32_t jitter_ms, uint16_t first_sequence_number)
+{
+    uint32_t seed = 4242;
+    uint32_t count = 0;
+    for (uint32_t t = 0; (t < duration_ms) && (count < TRACE_EVENTS_MAX); t += TRACE_PACKET_MS) {
+        events[count].time_ms = t + ((jitter_ms > 0) ? (test_rand(&seed) % jitter_ms) : 0);
+        events[count].sequence_number = (uint16_t)(first_sequence_number + count);
+        events[count].rssi = 0;
+        count++;
+    }
+    return count;
+}
+
+/* Shifts every packet from index on by delay_ms, as if the link stalled and delivered the backlog at once */
+static void trace_stall(uint32_t count, uint32_t index, uint32_t delay_ms)
+{
+    const uint32_t resume_ms = events[index].time_ms + delay_ms;
+    for (uint32_t i = index; (i < count) && (events[i].time_ms < resume_ms); ++i) {
+        events[i].time_ms = resume_ms;
+    }
+}
+
+/* Source flushed packets after failed retransmissions - they never arrive, arrival timing stays regular */
+static uint32_t trace_drop(uint32_t count, uint32_t index, uint32_t dropped)
+{
+    for (uint32_t i = index; (i + dropped) < count; ++i) {
+        events[i] = events[i + dropped];
+        events[i].time_ms -= dropped * TRACE_PACKET_MS;
+    }
+    return count - dropped;
+}
+
+static void test_clean_link_settles_at_minimum(void)
+{
+    const uint32_t count = trace_generate(60000, 4, 0);
+    const trace_result_t result = trace_replay(events, count, false);
+    TEST_CHECK_EQ(result.final_target, TRACE_FRAMES_MIN);
+}
+
+static void test_stall_raises_target_then_releases_slowly(void)
+{
+    /* 150 ms stall needs 52 frames to bridge, 77 with margin */
+    const uint32_t count = trace_generate(30000, 4, 0);
+    trace_stall(count, 500, 150);
+
+    const trace_result_t before = trace_replay(events, 500, false);
+    const trace_result_t after_stall = trace_replay(events, 560, false);
+    const trace_result_t result = trace_replay(events, count, false);
+    TEST_CHECK(after_stall.final_target >= 77);
+    TEST_CHECK(after_stall.final_target > before.final_target);
+
+    /* Released by 2 frames per window, not dropped at once */
+    const uint32_t windows_after = result.windows - after_stall.windows;
+    TEST_CHECK(result.final_target >= after_stall.final_target - 2 * windows_after);
+    TEST_CHECK(result.final_target < after_stall.final_target);
+}
+
+static void test_lost_packets_raise_target(void)
+{
+    /* No arrival gap at all, only sequence numbers tell about the loss */
+    uint32_t count = trace_generate(30000, 0, 0);
+    const trace_result_t clean = trace_replay(events, count, false);
+    count = trace_drop(count, 1000, 3);
+    const trace_result_t lossy = trace_replay(events, count, false);
+
+    TEST_CHECK_EQ(clean.raises, 0);
+    TEST_CHECK_EQ(lossy.raises, 1);
+    TEST_CHECK(lossy.max_target >= TRACE_FRAMES_MIN + 10);
+}
+
+static void test_sequence_wrap_is_not_loss(void)
+{
+    const uint32_t count = trace_generate(60000, 0, 65000);
+    const trace_result_t result = trace_replay(events, count, false);
+    TEST_CHECK_EQ(result.raises, 0);
+}
+
+static void test_sequence_restart_is_not_loss(void)
+{
+    /* Source restarts numbering, e.g. after its own reconfiguration */
+    const uint32_t count = trace_generate(60000, 0, 0);
+    for (uint32_t i = 1500; i < count; ++i) {
+        events[i].sequence_number = (uint16_t)(30000 + i);
+    }
+    const trace_result_t result = trace_replay(events, count, false);
+    TEST_CHECK_EQ(result.raises, 0);
+}
+
+static void test_weak_rssi_adds_margin(void)
+{
+    /* Margin shows once jitter alone needs more than the minimum */
+    const uint32_t count = trace_generate(60000, 10, 0);
+    const trace_result_t strong = trace_replay(events, count, false);
+    for (uint32_t i = 0; i < count; ++i) {
+        events[i].rssi = -10;
+    }
+    const trace_result_t weak = trace_replay(events, count, false);
+    TEST_CHECK(weak.final_target > strong.final_target);
+}
+
+static void test_suspend_gap_is_ignored(void)
+{
+    bt_jitter_policy_t policy;
+    bt_jitter_policy_init(&policy, TRACE_FRAMES_MIN, TRACE_FRAMES_MAX, TRACE_FRAMES_MIN);
+
+    /* Like a2dp does on suspend - arrivals before it don't form a gap with those after resume */
+    bt_jitter_policy_packet_arrived(&policy, 0, 100);
+    bt_jitter_policy_packet_arrived(&policy, 20, 101);
+    bt_jitter_policy_reset_arrivals(&policy);
+    bt_jitter_policy_packet_arrived(&policy, 5000, 500);
+    bt_jitter_policy_packet_arrived(&policy, 5020, 501);
+    TEST_CHECK_EQ(bt_jitter_policy_update(&policy, TRACE_FRAMES_PER_SECOND), TRACE_FRAMES_MIN);
+}
+
+static int replay_file(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        printf("Can't open %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char line[128];
+    uint32_t count = 0;
+    while ((count < TRACE_EVENTS_MAX) && (fgets(line, sizeof(line), file) != NULL)) {
+        unsigned long time_ms;
+        unsigned int sequence_number;
+        int rssi = 0;
+        if ((line[0] == '#') || (sscanf(line, "%lu %u %d", &time_ms, &sequence_number, &rssi) < 2)) {
+            continue;
+        }
+        events[count].time_ms = (uint32_t)time_ms;
+        events[count].sequence_number = (uint16_t)sequence_number;
+        events[count].rssi = (int8_t)rssi;
+        count++;
+    }
+    fclose(file);
+
+    const trace_result_t result = trace_replay(events, count, true);
+    printf("%lu packets, %lu windows, max target %lu, final target %lu frames\n", (unsigned long)count,
+           (unsigned long)result.windows, (unsigned long)result.max_target, (unsigned long)result.final_target);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        return replay_file(argv[1]);
+    }
+
+    TEST_RUN(test_clean_link_settles_at_minimum);
+    TEST_RUN(test_stall_raises_target_then_releases_slowly);
+    TEST_RUN(test_lost_packets_raise_target);
+    TEST_RUN(test_sequence_wrap_is_not_loss);
+    TEST_RUN(test_sequence_restart_is_not_loss);
+    TEST_RUN(test_weak_rssi_adds_margin);
+    TEST_RUN(test_suspend_gap_is_ignored);
+    return TEST_RESULT();
+}
@@ -0,0 +1,210 @@
+#include "test.h"
+#include <playout_policy.h>
+
+/* Simulates a 44.1 kHz SBC stream arriving over a jittery link, played out by double-buffered DMA that
+ * pulls both buffers at start and one per period afterwards, like bt_i2s does */
+
+#define SIM_SAMPLE_RATE 44100
+#define SIM_SAMPLES_PER_FRAME 128
+#define SIM_PERIOD_FRAMES 1024
+#define SIM_FRAMES_PER_PACKET 7
+#define SIM_FRAMES_TARGET 60
+#define SIM_FRAMES_HIGH 120
+
+typedef struct
+{
+    bt_playout_policy_t policy;
+    double ring_samples; // Source samples buffered, SBC and decoded together
+    uint32_t factor;
+    bool started;
+    double start_ms;
+    double next_period_ms;
+    uint32_t underruns;
+    double target_reached_ms;
+    uint32_t max_factor_step;
+    uint32_t min_factor;
+    uint32_t max_factor;
+} sim_t;
+
+static double sim_period_ms(void)
+{
+    return (1000.0 * SIM_PERIOD_FRAMES) / SIM_SAMPLE_RATE;
+}
+
+static void sim_init(sim_t *sim)
+{
+    bt_playout_policy_init(&sim->policy, SIM_SAMPLE_RATE, SIM_SAMPLES_PER_FRAME, SIM_PERIOD_FRAMES);
+    sim->ring_samples = 0.0;
+    sim->factor = BT_PLAYOUT_POLICY_FACTOR_NOMINAL;
+    sim->started = false;
+    sim->underruns = 0;
+    sim->target_reached_ms = -1.0;
+    sim->max_factor_step = 0;
+    sim->min_factor = BT_PLAYOUT_POLICY_FACTOR_NOMINAL;
+    sim->max_factor = BT_PLAYOUT_POLICY_FACTOR_NOMINAL;
+}
+
+static void sim_pull_period(sim_t *sim)
+{
+    /* Resampler consumes factor/2^16 source samples per output sample */
+    const double needed = ((double)SIM_PERIOD_FRAMES * sim->factor) / BT_PLAYOUT_POLICY_FACTOR_NOMINAL;
+    if (sim->ring_samples < needed) {
+        sim->underruns++;
+        sim->ring_samples = 0.0;
+    }
+    else {
+        sim->ring_samples -= needed;
+    }
+}
+
+static void sim_packet(sim_t *sim, double now_ms)
+{
+    sim->ring_samples += SIM_FRAMES_PER_PACKET * SIM_SAMPLES_PER_FRAME;
+
+    const uint32_t frames_in_buffer = (uint32_t)(sim->ring_samples / SIM_SAMPLES_PER_FRAME);
+    const uint32_t factor = bt_playout_policy_update(&sim->policy, frames_in_buffer, SIM_FRAMES_TARGET, SIM_FRAMES_HIGH);
+    const uint32_t step = (factor > sim->factor) ? (factor - sim->factor) : (sim->factor - factor);
+    sim->max_factor_step = (step > sim->max_factor_step) ? step : sim->max_factor_step;
+    sim->min_factor = (factor < sim->min_factor) ? factor : sim->min_factor;
+    sim->max_factor = (factor > sim->max_factor) ? factor : sim->max_factor;
+    sim->factor = factor;
+
+    if (sim->started && (sim->target_reached_ms < 0.0) && (frames_in_buffer >= SIM_FRAMES_TARGET)) {
+        sim->target_reached_ms = now_ms - sim->start_ms;
+    }
+
+    if (!sim->started && (frames_in_buffer >= bt_playout_policy_frames_to_start(&sim->policy, false))) {
+        bt_playout_policy_started(&sim->policy);
+        sim->started = true;
+        sim->start_ms = now_ms;
+        sim->next_period_ms = now_ms + sim_period_ms();
+        sim_pull_period(sim); // Buffer played right away
+        sim_pull_period(sim); // Buffer queued behind it
+    }
+}
+
+/* Packets leave the source on time and arrive up to jitter_ms late, never reordered.
+ * Every burst_every packets the link stalls for burst_ms and the backlog arrives at once. */
+static void sim_run(sim_t *sim, double duration_ms, uint32_t jitter_ms, uint32_t burst_every, uint32_t burst_ms)
+{
+    const double packet_ms = (1000.0 * SIM_FRAMES_PER_PACKET * SIM_SAMPLES_PER_FRAME) / SIM_SAMPLE_RATE;
+    uint32_t seed = 12345;
+    double last_arrival_ms = 0.0;
+    double stall_until_ms = 0.0;
+
+    for (uint32_t packet = 0; ; ++packet) {
+        double arrival_ms = packet * packet_ms + (test_rand(&seed) % (jitter_ms + 1));
+        if ((burst_every > 0) && (packet > 0) && ((packet % burst_every) == 0)) {
+            stall_until_ms = arrival_ms + burst_ms;
+        }
+        arrival_ms = (arrival_ms < stall_until_ms) ? stall_until_ms : arrival_ms;
+        arrival_ms = (arrival_ms < last_arrival_ms) ? last_arrival_ms : arrival_ms;
+        last_arrival_ms = arrival_ms;
+        if (arrival_ms > duration_ms) {
+            break;
+        }
+
+        while (sim->started && (sim->next_period_ms <= arrival_ms)) {
+            sim_pull_period(sim);
+            sim->next_period_ms += sim_period_ms();
+        }
+        sim_packet(sim, arrival_ms);
+    }
+}
+
+static void test_primer_covers_both_buffers_and_margin(void)
+{
+    bt_playout_policy_t policy;
+
+    /* 2048 samples for two DMA periods is 16 frames, 40 ms margin is 14 frames at 44.1 kHz and 15 at 48 kHz */
+    bt_playout_policy_init(&policy, 44100, 128, 1024);
+    TEST_CHECK_EQ(bt_playout_policy_frames_to_start(&policy, false), 16 + 14);
+    bt_playout_policy_init(&policy, 48000, 128, 1024);
+    TEST_CHECK_EQ(bt_playout_policy_frames_to_start(&policy, false), 16 + 15);
+
+    /* Short SBC frames need more of them */
+    bt_playout_policy_init(&policy, 44100, 64, 1024);
+    TEST_CHECK_EQ(bt_playout_policy_frames_to_start(&policy, false), 32 + 28);
+}
+
+static void test_resume_needs_queued_buffer_and_margin_only(void)
+{
+    bt_playout_policy_t policy;
+    bt_playout_policy_init(&policy, 44100, 128, 1024);
+    TEST_CHECK_EQ(bt_playout_policy_frames_to_start(&policy, true), 8 + 14);
+}
+
+static void test_jittery_link_does_not_underrun_during_ramp(void)
+{
+    sim_t sim;
+    sim_init(&sim);
+    sim_run(&sim, 120000.0, 35, 0, 0);
+
+    TEST_CHECK(sim.started);
+    TEST_CHECK(sim.start_ms < 150.0);
+    TEST_CHECK_EQ(sim.underruns, 0);
+    TEST_CHECK(sim.target_reached_ms > 0.0);
+    /* 0.3% stretch adds 3 ms of depth per second played, about 46 frames to build up from the primer */
+    TEST_CHECK(sim.target_reached_ms < 40000.0);
+    printf("  start %.1f ms, target reached %.1f ms after start\n", sim.start_ms, sim.target_reached_ms);
+}
+
+static void test_stalls_right_after_start_do_not_underrun(void)
+{
+    /* 30 ms stall every ~0.5 s on top of jitter, starting before depth has built up */
+    sim_t sim;
+    sim_init(&sim);
+    sim_run(&sim, 15000.0, 10, 25, 30);
+
+    TEST_CHECK(sim.started);
+    TEST_CHECK_EQ(sim.underruns, 0);
+}
+
+static void test_compensation_is_slew_limited(void)
+{
+    sim_t sim;
+    sim_init(&sim);
+    sim_run(&sim, 30000.0, 35, 50, 60);
+
+    /* Pitch glides, never steps by more than 0.05% per packet, and stays within 0.4% of nominal -
+     * 0.3% while ramping up, stalls later on are made up by steady-state correction */
+    TEST_CHECK(sim.max_factor_step <= 0x20);
+    TEST_CHECK(sim.min_factor >= BT_PLAYOUT_POLICY_FACTOR_NOMINAL - 0x100);
+    TEST_CHECK(sim.max_factor <= BT_PLAYOUT_POLICY_FACTOR_NOMINAL + 0x100);
+}
+
+static void test_steady_state_after_target(void)
+{
+    bt_playout_policy_t policy;
+    bt_playout_policy_init(&policy, 44100, 128, 1024);
+    bt_playout_policy_started(&policy);
+
+    /* Once the target is reached, ramp compensation is not used again until next start */
+    for (uint32_t i = 0; i < 64; ++i) {
+        bt_playout_policy_update(&policy, 60, 60, 120);
+    }
+    uint32_t factor = 0;
+    for (uint32_t i = 0; i < 64; ++i) {
+        factor = bt_playout_policy_update(&policy, 50, 60, 120);
+    }
+    TEST_CHECK_EQ(factor, BT_PLAYOUT_POLICY_FACTOR_NOMINAL - 0x100);
+    for (uint32_t i = 0; i < 64; ++i) {
+        factor = bt_playout_policy_update(&policy, 130, 60, 120);
+    }
+    TEST_CHECK_EQ(factor, BT_PLAYOUT_POLICY_FACTOR_NOMINAL + 0x100);
+    for (uint32_t i = 0; i < 64; ++i) {
+        factor = bt_playout_policy_update(&policy, 90, 60, 120);
+    }
+    TEST_CHECK_EQ(factor, BT_PLAYOUT_POLICY_FACTOR_NOMINAL);
+}
+
+int main(void)
+{
+    TEST_RUN(test_primer_covers_both_buffers_and_margin);
+    TEST_RUN(test_resume_needs_queued_buffer_and_margin_only);
+    TEST_RUN(test_jittery_link_does_not_underrun_during_ramp);
+    TEST_RUN(test_stalls_right_after_start_do_not_underrun);
+    TEST_RUN(test_compensation_is_slew_limited);
+    TEST_RUN(test_steady_state_after_target);
+    return TEST_RESULT();
+}
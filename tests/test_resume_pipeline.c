@@ -0,0 +1,241 @@
+#include "test.h"
+#include <audio_dsp.h>
+#include <playout_policy.h>
+#include <playout_stream.h>
+#include <math.h>
+#include <string.h>
+
+/* Suspend/resume through the playback pipeline - playout stream with drain and fade-in and start thresholds from the
+ * playout policy, fed from a simulated source. Output is a simulated bt_i2s double buffer that keeps running across
+ * suspend, everything its DMA would send is logged and checked for latency and clicks. */
+
+#define PIPE_SAMPLE_RATE 44100
+#define PIPE_PERIOD_FRAMES 1024
+#define PIPE_SAMPLES_PER_FRAME 128
+#define PIPE_FRAMES_PER_PACKET 7
+#define PIPE_RING_FRAMES (PIPE_SAMPLE_RATE / 2)
+#define PIPE_LOG_FRAMES (PIPE_SAMPLE_RATE * 5)
+#define PIPE_TONE_HZ 441.0
+#define PIPE_TONE_AMPLITUDE 16000.0
+#define PIPE_PI 3.14159265358979
+
+typedef struct
+{
+    bt_playout_policy_t policy;
+    int16_t ring[PIPE_RING_FRAMES * 2];
+    uint32_t ring_frames;
+    uint32_t tone_position;
+    int16_t buffers[2][PIPE_PERIOD_FRAMES * 2];
+    uint32_t playing;
+    double playing_since_ms;
+    bool running;
+    bt_playout_stream_t stream;
+    int16_t log[PIPE_LOG_FRAMES * 2];
+    double log_start_ms[PIPE_LOG_FRAMES / PIPE_PERIOD_FRAMES];
+    uint32_t log_buffers;
+} pipe_t;
+
+static pipe_t pipe;
+
+static double pipe_period_ms(void)
+{
+    return (1000.0 * PIPE_PERIOD_FRAMES) / PIPE_SAMPLE_RATE;
+}
+
+static void pipe_packet(void)
+{
+    for (uint32_t i = 0; i < PIPE_FRAMES_PER_PACKET * PIPE_SAMPLES_PER_FRAME; ++i) {
+        const double phase = (2.0 * PIPE_PI * PIPE_TONE_HZ * pipe.tone_position++) / PIPE_SAMPLE_RATE;
+        const int16_t sample = (int16_t)lround(PIPE_TONE_AMPLITUDE * sin(phase));
+        pipe.ring[2 * pipe.ring_frames] = sample;
+        pipe.ring[2 * pipe.ring_frames + 1] = sample;
+        pipe.ring_frames++;
+    }
+}
+
+static uint32_t pipe_fill(int16_t *buffer, uint32_t frames, void *context)
+{
+    (void)context;
+    const uint32_t frames_read = (pipe.ring_frames < frames) ? pipe.ring_frames : frames;
+    memcpy(buffer, pipe.ring, frames_read * 2 * sizeof(int16_t));
+    memmove(pipe.ring, &pipe.ring[2 * frames_read], (pipe.ring_frames - frames_read) * 2 * sizeof(int16_t));
+    pipe.ring_frames -= frames_read;
+    return frames_read;
+}
+
+/* Stale audio is dropped the way bt_a2dp_read_samples_callback does it */
+static void pipe_read_samples(int16_t *buffer, uint32_t frames)
+{
+    if (bt_playout_stream_read(&pipe.stream, buffer, frames, pipe_fill, NULL)) {
+        pipe.ring_frames = 0;
+    }
+}
+
+/* Simulated bt_i2s_start_stream */
+static void pipe_start_stream(double now_ms)
+{
+    bt_playout_stream_start(&pipe.stream);
+    if (pipe.running) {
+        pipe_read_samples(pipe.buffers[pipe.playing ^ 1], PIPE_PERIOD_FRAMES);
+        return;
+    }
+    pipe_read_samples(pipe.buffers[pipe.playing], PIPE_PERIOD_FRAMES);
+    pipe_read_samples(pipe.buffers[pipe.playing ^ 1], PIPE_PERIOD_FRAMES);
+    pipe.playing_since_ms = now_ms;
+    pipe.running = true;
+}
+
+static void pipe_suspend(void)
+{
+    if (!bt_playout_stream_stop(&pipe.stream)) {
+        pipe.ring_frames = 0;
+    }
+}
+
+static void pipe_period_end(void)
+{
+    memcpy(&pipe.log[pipe.log_buffers * PIPE_PERIOD_FRAMES * 2], pipe.buffers[pipe.playing], sizeof(pipe.buffers[0]));
+    pipe.log_start_ms[pipe.log_buffers++] = pipe.playing_since_ms;
+    pipe.playing_since_ms += pipe_period_ms();
+
+    /* DMA moves on to the queued buffer, the one just played gets refilled */
+    pipe.playing ^= 1;
+    pipe_read_samples(pipe.buffers[pipe.playing ^ 1], PIPE_PERIOD_FRAMES);
+}
+
+/* Runs the pipeline until end_ms, packets arrive with up to 10 ms jitter while source_active */
+static void pipe_run(double from_ms, double end_ms, bool source_active, double *start_ms)
+{
+    const double packet_ms = (1000.0 * PIPE_FRAMES_PER_PACKET * PIPE_SAMPLES_PER_FRAME) / PIPE_SAMPLE_RATE;
+    uint32_t seed = 777;
+    double next_packet_ms = from_ms;
+
+    for (double now_ms = from_ms; now_ms < end_ms; now_ms += 0.1) {
+        while (pipe.running && ((pipe.playing_since_ms + pipe_period_ms()) <= now_ms)) {
+            pipe_period_end();
+        }
+        if (!source_active || (now_ms < next_packet_ms)) {
+            continue;
+        }
+        next_packet_ms += packet_ms + (test_rand(&seed) % 11) - 5.0;
+
+        pipe_packet();
+        const uint32_t frames_in_buffer = pipe.ring_frames / PIPE_SAMPLES_PER_FRAME;
+        bt_playout_policy_update(&pipe.policy, frames_in_buffer, 60, 120);
+        if (!bt_playout_stream_is_started(&pipe.stream) && (frames_in_buffer >= bt_playout_policy_frames_to_start(&pipe.policy, pipe.running))) {
+            bt_playout_policy_started(&pipe.policy);
+            pipe_start_stream(now_ms);
+            *start_ms = now_ms;
+        }
+    }
+}
+
+static double pipe_first_audio_after_ms(double since_ms)
+{
+    for (uint32_t b = 0; b < pipe.log_buffers; ++b) {
+        if (pipe.log_start_ms[b] < since_ms) {
+            continue;
+        }
+        for (uint32_t i = 0; i < PIPE_PERIOD_FRAMES * 2; ++i) {
+            if (pipe.log[b * PIPE_PERIOD_FRAMES * 2 + i] != 0) {
+                return pipe.log_start_ms[b] + (1000.0 * (i / 2)) / PIPE_SAMPLE_RATE;
+            }
+        }
+    }
+    return -1.0;
+}
+
+static void test_resume_plays_within_one_period_without_clicks(void)
+{
+    memset(&pipe, 0, sizeof(pipe));
+    bt_playout_stream_init(&pipe.stream);
+    bt_playout_policy_init(&pipe.policy, PIPE_SAMPLE_RATE, PIPE_SAMPLES_PER_FRAME, PIPE_PERIOD_FRAMES);
+
+    double start_ms = -1.0;
+    double resume_start_ms = -1.0;
+    pipe_run(0.0, 2000.0, true, &start_ms);
+    pipe_suspend();
+    pipe_run(2000.0, 3000.0, false, &start_ms);
+    pipe_run(3000.0, 4500.0, true, &resume_start_ms);
+
+    TEST_CHECK(start_ms > 0.0);
+    TEST_CHECK(resume_start_ms > 3000.0);
+    TEST_CHECK_EQ(pipe.stream.underruns, 0);
+
+    /* Output kept running, resume only waits for the current period to end */
+    const double first_audio_ms = pipe_first_audio_after_ms(resume_start_ms);
+    TEST_CHECK(first_audio_ms >= resume_start_ms);
+    TEST_CHECK(first_audio_ms <= resume_start_ms + pipe_period_ms());
+    printf("  resume: first packet to start %.1f ms, start to audio %.1f ms\n", resume_start_ms - 3000.0, first_audio_ms - resume_start_ms);
+
+    /* Suspend fades out, resume fades in - no sample to sample step larger than the tone itself has */
+    const double tone_step = PIPE_TONE_AMPLITUDE * 2.0 * PIPE_PI * PIPE_TONE_HZ / PIPE_SAMPLE_RATE;
+    int32_t max_step = 0;
+    for (uint32_t i = 1; i < pipe.log_buffers * PIPE_PERIOD_FRAMES; ++i) {
+        const int32_t step = abs(pipe.log[2 * i] - pipe.log[2 * (i - 1)]);
+        max_step = (step > max_step) ? step : max_step;
+    }
+    TEST_CHECK(max_step <= (int32_t)(tone_step * 1.05) + 2);
+
+    /* Silence in between, i.e. the fade-out has actually ended the first stream */
+    TEST_CHECK(pipe_first_audio_after_ms(2100.0) >= resume_start_ms);
+}
+
+/* Fills context frames of a constant, at most the frames asked for */
+static uint32_t constant_fill(int16_t *buffer, uint32_t frames, void *context)
+{
+    const uint32_t frames_filled = (*(const uint32_t *)context < frames) ? *(const uint32_t *)context : frames;
+    for (uint32_t i = 0; i < frames_filled * 2; ++i) {
+        buffer[i] = 1000;
+    }
+    return frames_filled;
+}
+
+static void test_stream_states(void)
+{
+    bt_playout_stream_t stream;
+    bt_playout_stream_init(&stream);
+    int16_t buffer[PIPE_PERIOD_FRAMES * 2];
+    uint32_t frames = PIPE_PERIOD_FRAMES;
+
+    /* Idle reads silence without touching the source */
+    buffer[0] = 1;
+    TEST_CHECK(!bt_playout_stream_read(&stream, buffer, PIPE_PERIOD_FRAMES, NULL, NULL));
+    TEST_CHECK_EQ(buffer[0], 0);
+
+    /* Nothing to fade out before start */
+    TEST_CHECK(!bt_playout_stream_stop(&stream));
+    TEST_CHECK(bt_playout_stream_is_idle(&stream));
+
+    /* First period fades in, next one plays as is */
+    bt_playout_stream_start(&stream);
+    TEST_CHECK(!bt_playout_stream_read(&stream, buffer, PIPE_PERIOD_FRAMES, constant_fill, &frames));
+    TEST_CHECK_EQ(buffer[0], 0);
+    TEST_CHECK(buffer[2 * (PIPE_PERIOD_FRAMES - 1)] > 990);
+    TEST_CHECK(!bt_playout_stream_read(&stream, buffer, PIPE_PERIOD_FRAMES, constant_fill, &frames));
+    TEST_CHECK_EQ(buffer[0], 1000);
+
+    /* Short fill is an underrun, rest is silenced */
+    frames = PIPE_PERIOD_FRAMES / 2;
+    TEST_CHECK(!bt_playout_stream_read(&stream, buffer, PIPE_PERIOD_FRAMES, constant_fill, &frames));
+    TEST_CHECK_EQ(stream.underruns, 1);
+    TEST_CHECK_EQ(buffer[2 * (PIPE_PERIOD_FRAMES / 2 - 1)], 1000);
+    TEST_CHECK_EQ(buffer[2 * (PIPE_PERIOD_FRAMES / 2)], 0);
+
+    /* Stop drains one faded period, then the stream is idle */
+    frames = PIPE_PERIOD_FRAMES;
+    TEST_CHECK(bt_playout_stream_stop(&stream));
+    TEST_CHECK(!bt_playout_stream_is_started(&stream));
+    TEST_CHECK(!bt_playout_stream_is_idle(&stream));
+    TEST_CHECK(bt_playout_stream_read(&stream, buffer, PIPE_PERIOD_FRAMES, constant_fill, &frames));
+    TEST_CHECK_EQ(buffer[0], 1000);
+    TEST_CHECK_EQ(buffer[2 * (PIPE_PERIOD_FRAMES - 1)], 0);
+    TEST_CHECK(bt_playout_stream_is_idle(&stream));
+}
+
+int main(void)
+{
+    TEST_RUN(test_stream_states);
+    TEST_RUN(test_resume_plays_within_one_period_without_clicks);
+    return TEST_RESULT();
+}
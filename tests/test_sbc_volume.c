@@ -0,0 +1,560 @@
+#include "test.h"
+#include <audio_dsp.h>
+#include <sbc_volume.h>
+#include <math.h>
+#include <string.h>
+
+/* Random SBC frames are packed here following the A2DP spec (bit allocation, CRC, sample packing), attenuated
+ * in the subband domain and then parsed back. The subband samples have to come out scaled by exactly 2^-steps
+ * with unchanged bit allocation. Output is compared against the PCM fallback path too, through a synthesis
+ * filterbank structured like the spec one. Its prototype filter is a windowed sinc rather than the spec table,
+ * which doesn't matter here - only linearity and rounding to int16 are under test. */
+
+#define SBC_SYNCWORD 0x9C
+#define SBC_FRAME_SIZE_MAX 512
+#define SBC_MODE_MONO 0
+#define SBC_MODE_DUAL_CHANNEL 1
+#define SBC_MODE_STEREO 2
+#define SBC_MODE_JOINT_STEREO 3
+#define SBC_ALLOCATION_LOUDNESS 0
+#define SBC_ALLOCATION_SNR 1
+#define SBC_PI 3.14159265358979
+
+typedef struct
+{
+    uint8_t sampling_frequency;
+    uint8_t blocks;
+    uint8_t channel_mode;
+    uint8_t allocation_method;
+    uint8_t subbands;
+    uint8_t bitpool;
+    uint8_t channels;
+    uint8_t join[8];
+    uint8_t scale_factor[2][8];
+    int32_t bits[2][8];
+    uint32_t audio_sample[16][2][8];
+} sbc_frame_t;
+
+typedef struct
+{
+    uint8_t *data;
+    uint32_t bit;
+} bit_cursor_t;
+
+static const int32_t sbc_offset4[4][4] = {
+    {-1, 0, 0, 0}, {-2, 0, 0, 1}, {-2, 0, 0, 1}, {-2, 0, 0, 1}
+};
+
+static const int32_t sbc_offset8[4][8] = {
+    {-2, 0, 0, 0, 0, 0, 0, 1}, {-3, 0, 0, 0, 0, 0, 1, 2}, {-4, 0, 0, 0, 0, 0, 1, 2}, {-4, 0, 0, 0, 0, 0, 1, 2}
+};
+
+static void put_bits(bit_cursor_t *cursor, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = count; i > 0; --i) {
+        const uint32_t bit = (value >> (i - 1)) & 1;
+        cursor->data[cursor->bit / 8] |= bit << (7 - (cursor->bit % 8));
+        cursor->bit++;
+    }
+}
+
+static uint32_t get_bits(bit_cursor_t *cursor, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        value = (value << 1) | ((cursor->data[cursor->bit / 8] >> (7 - (cursor->bit % 8))) & 1);
+        cursor->bit++;
+    }
+    return value;
+}
+
+/* Spec CRC-8, x^8 + x^4 + x^3 + x^2 + 1 with 0x0F init, over header bits collected into a separate buffer */
+static uint8_t sbc_crc(const uint8_t *frame, uint32_t covered_bits)
+{
+    uint8_t bits[64] = {0};
+    bit_cursor_t in = {(uint8_t *)frame, 8};
+    bit_cursor_t out = {bits, 0};
+    put_bits(&out, get_bits(&in, 16), 16);
+    in.bit = 32;
+    for (uint32_t i = 16; i < covered_bits; ++i) {
+        put_bits(&out, get_bits(&in, 1), 1);
+    }
+
+    uint8_t crc = 0x0F;
+    for (uint32_t i = 0; i < covered_bits; ++i) {
+        const uint8_t bit = (bits[i / 8] >> (7 - (i % 8))) & 1;
+        const uint8_t msb = crc & 0x80;
+        crc = (uint8_t)(crc << 1);
+        if ((msb != 0) != (bit != 0)) {
+            crc ^= 0x1D;
+        }
+    }
+    return crc;
+}
+
+static void sbc_bitneed(const sbc_frame_t *f, uint32_t ch, int32_t *bitneed)
+{
+    for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+        const int32_t sf = f->scale_factor[ch][sb];
+        if (f->allocation_method == SBC_ALLOCATION_SNR) {
+            bitneed[sb] = sf;
+        }
+        else if (sf == 0) {
+            bitneed[sb] = -5;
+        }
+        else {
+            const int32_t offset = (f->subbands == 4) ? sbc_offset4[f->sampling_frequency][sb] : sbc_offset8[f->sampling_frequency][sb];
+            const int32_t loudness = sf - offset;
+            bitneed[sb] = (loudness > 0) ? (loudness / 2) : loudness;
+        }
+    }
+}
+
+/* Bit allocation from the spec, channels_count channels of bitneed share the bitpool */
+static void sbc_allocate(const sbc_frame_t *f, int32_t bitneed[][8], int32_t bits[][8], uint32_t channels_count)
+{
+    int32_t max_bitneed = -100;
+    for (uint32_t ch = 0; ch < channels_count; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            max_bitneed = (bitneed[ch][sb] > max_bitneed) ? bitneed[ch][sb] : max_bitneed;
+        }
+    }
+
+    int32_t bitcount = 0;
+    int32_t slicecount = 0;
+    int32_t bitslice = max_bitneed + 1;
+    do {
+        bitslice--;
+        bitcount += slicecount;
+        slicecount = 0;
+        for (uint32_t ch = 0; ch < channels_count; ++ch) {
+            for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+                if ((bitneed[ch][sb] > bitslice + 1) && (bitneed[ch][sb] < bitslice + 16)) {
+                    slicecount++;
+                }
+                else if (bitneed[ch][sb] == bitslice + 1) {
+                    slicecount += 2;
+                }
+            }
+        }
+    } while (bitcount + slicecount < f->bitpool);
+
+    if (bitcount + slicecount == f->bitpool) {
+        bitcount += slicecount;
+        bitslice--;
+    }
+
+    for (uint32_t ch = 0; ch < channels_count; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            if (bitneed[ch][sb] < bitslice + 2) {
+                bits[ch][sb] = 0;
+            }
+            else {
+                bits[ch][sb] = bitneed[ch][sb] - bitslice;
+                bits[ch][sb] = (bits[ch][sb] > 16) ? 16 : bits[ch][sb];
+            }
+        }
+    }
+
+    /* Leftover bits, subband by subband alternating channels */
+    uint32_t ch = 0;
+    uint32_t sb = 0;
+    while ((bitcount < f->bitpool) && (sb < f->subbands)) {
+        if ((bits[ch][sb] >= 2) && (bits[ch][sb] < 16)) {
+            bits[ch][sb]++;
+            bitcount++;
+        }
+        else if ((bitneed[ch][sb] == bitslice + 1) && (f->bitpool > bitcount + 1)) {
+            bits[ch][sb] = 2;
+            bitcount += 2;
+        }
+        if (++ch == channels_count) {
+            ch = 0;
+            sb++;
+        }
+    }
+    ch = 0;
+    sb = 0;
+    while ((bitcount < f->bitpool) && (sb < f->subbands)) {
+        if (bits[ch][sb] < 16) {
+            bits[ch][sb]++;
+            bitcount++;
+        }
+        if (++ch == channels_count) {
+            ch = 0;
+            sb++;
+        }
+    }
+}
+
+static void sbc_bit_allocation(sbc_frame_t *f)
+{
+    int32_t bitneed[2][8];
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        sbc_bitneed(f, ch, bitneed[ch]);
+    }
+
+    /* Stereo modes share the bitpool, mono and dual channel allocate per channel */
+    if ((f->channel_mode == SBC_MODE_STEREO) || (f->channel_mode == SBC_MODE_JOINT_STEREO)) {
+        sbc_allocate(f, bitneed, f->bits, 2);
+    }
+    else {
+        for (uint32_t ch = 0; ch < f->channels; ++ch) {
+            sbc_allocate(f, &bitneed[ch], &f->bits[ch], 1);
+        }
+    }
+}
+
+static uint32_t sbc_crc_bits(const sbc_frame_t *f)
+{
+    const uint32_t join_bits = (f->channel_mode == SBC_MODE_JOINT_STEREO) ? f->subbands : 0;
+    return 16 + join_bits + 4 * f->channels * f->subbands;
+}
+
+static uint32_t sbc_pack(sbc_frame_t *f, uint8_t *frame)
+{
+    memset(frame, 0, SBC_FRAME_SIZE_MAX);
+    sbc_bit_allocation(f);
+
+    bit_cursor_t out = {frame, 0};
+    put_bits(&out, SBC_SYNCWORD, 8);
+    put_bits(&out, f->sampling_frequency, 2);
+    put_bits(&out, (f->blocks / 4) - 1, 2);
+    put_bits(&out, f->channel_mode, 2);
+    put_bits(&out, f->allocation_method, 1);
+    put_bits(&out, f->subbands == 8, 1);
+    put_bits(&out, f->bitpool, 8);
+    put_bits(&out, 0, 8); // CRC, filled in below
+    if (f->channel_mode == SBC_MODE_JOINT_STEREO) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            put_bits(&out, f->join[sb], 1);
+        }
+    }
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            put_bits(&out, f->scale_factor[ch][sb], 4);
+        }
+    }
+    for (uint32_t blk = 0; blk < f->blocks; ++blk) {
+        for (uint32_t ch = 0; ch < f->channels; ++ch) {
+            for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+                put_bits(&out, f->audio_sample[blk][ch][sb], f->bits[ch][sb]);
+            }
+        }
+    }
+
+    frame[3] = sbc_crc(frame, sbc_crc_bits(f));
+    return (out.bit + 7) / 8;
+}
+
+static bool sbc_parse(const uint8_t *frame, sbc_frame_t *f)
+{
+    memset(f, 0, sizeof(*f));
+    bit_cursor_t in = {(uint8_t *)frame, 0};
+    if (get_bits(&in, 8) != SBC_SYNCWORD) {
+        return false;
+    }
+    f->sampling_frequency = get_bits(&in, 2);
+    f->blocks = 4 * (get_bits(&in, 2) + 1);
+    f->channel_mode = get_bits(&in, 2);
+    f->allocation_method = get_bits(&in, 1);
+    f->subbands = get_bits(&in, 1) ? 8 : 4;
+    f->bitpool = get_bits(&in, 8);
+    f->channels = (f->channel_mode == SBC_MODE_MONO) ? 1 : 2;
+    const uint8_t crc = get_bits(&in, 8);
+    if (f->channel_mode == SBC_MODE_JOINT_STEREO) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            f->join[sb] = get_bits(&in, 1);
+        }
+    }
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            f->scale_factor[ch][sb] = get_bits(&in, 4);
+        }
+    }
+    if (crc != sbc_crc(frame, sbc_crc_bits(f))) {
+        return false;
+    }
+
+    sbc_bit_allocation(f);
+    for (uint32_t blk = 0; blk < f->blocks; ++blk) {
+        for (uint32_t ch = 0; ch < f->channels; ++ch) {
+            for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+                f->audio_sample[blk][ch][sb] = get_bits(&in, f->bits[ch][sb]);
+            }
+        }
+    }
+    return true;
+}
+
+/* Dequantization and joint stereo reconstruction from the spec, exact in double */
+static void sbc_dequantize(const sbc_frame_t *f, double sb_sample[16][2][8])
+{
+    for (uint32_t blk = 0; blk < f->blocks; ++blk) {
+        for (uint32_t ch = 0; ch < f->channels; ++ch) {
+            for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+                const int32_t bits = f->bits[ch][sb];
+                if (bits == 0) {
+                    sb_sample[blk][ch][sb] = 0.0;
+                    continue;
+                }
+                const double levels = ldexp(1.0, bits) - 1.0;
+                const double scale = ldexp(1.0, f->scale_factor[ch][sb] + 1);
+                sb_sample[blk][ch][sb] = scale * ((f->audio_sample[blk][ch][sb] * 2.0 + 1.0) / levels - 1.0);
+            }
+        }
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            if (f->join[sb]) {
+                const double mid = sb_sample[blk][0][sb];
+                const double side = sb_sample[blk][1][sb];
+                sb_sample[blk][0][sb] = mid + side;
+                sb_sample[blk][1][sb] = mid - side;
+            }
+        }
+    }
+}
+
+/* Polyphase synthesis with the structure of the spec one, output in double */
+static void sbc_synthesize(const sbc_frame_t *f, double sb_sample[16][2][8], double pcm[16 * 8][2])
+{
+    const uint32_t m = f->subbands;
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        double v[160] = {0};
+        for (uint32_t blk = 0; blk < f->blocks; ++blk) {
+            memmove(&v[2 * m], v, (20 * m - 2 * m) * sizeof(double));
+            for (uint32_t k = 0; k < 2 * m; ++k) {
+                v[k] = 0.0;
+                for (uint32_t i = 0; i < m; ++i) {
+                    v[k] += cos((i + 0.5) * (k + m / 2.0) * SBC_PI / m) * sb_sample[blk][ch][i];
+                }
+            }
+            for (uint32_t j = 0; j < m; ++j) {
+                double sum = 0.0;
+                for (uint32_t i = 0; i < 5; ++i) {
+                    const uint32_t n0 = i * 2 * m + j;
+                    const uint32_t n1 = i * 2 * m + m + j;
+                    const double t0 = (n0 + 0.5) - 5.0 * m;
+                    const double t1 = (n1 + 0.5) - 5.0 * m;
+                    const double d0 = (0.5 - 0.5 * cos(2.0 * SBC_PI * (n0 + 0.5) / (10 * m))) * sin(SBC_PI * t0 / (2 * m)) / (SBC_PI * t0);
+                    const double d1 = (0.5 - 0.5 * cos(2.0 * SBC_PI * (n1 + 0.5) / (10 * m))) * sin(SBC_PI * t1 / (2 * m)) / (SBC_PI * t1);
+                    sum += v[i * 4 * m + j] * d0 + v[i * 4 * m + 3 * m + j] * d1;
+                }
+                pcm[blk * m + j][ch] = sum;
+            }
+        }
+    }
+}
+
+static void sbc_random_frame(sbc_frame_t *f, uint32_t *seed)
+{
+    memset(f, 0, sizeof(*f));
+    f->sampling_frequency = test_rand(seed) % 4;
+    f->blocks = 4 * (1 + test_rand(seed) % 4);
+    f->channel_mode = test_rand(seed) % 4;
+    f->allocation_method = test_rand(seed) % 2;
+    f->subbands = (test_rand(seed) % 2) ? 8 : 4;
+    f->channels = (f->channel_mode == SBC_MODE_MONO) ? 1 : 2;
+    const uint32_t bitpool_max = ((f->channels == 2) && (f->channel_mode != SBC_MODE_DUAL_CHANNEL)) ? 32 * f->subbands : 16 * f->subbands;
+    f->bitpool = 2 + test_rand(seed) % ((bitpool_max < 64 ? bitpool_max : 64) - 1);
+
+    /* Loud frames with all scale factors high and quiet ones with some of them low both occur */
+    const uint32_t sf_min = test_rand(seed) % 10;
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            f->scale_factor[ch][sb] = sf_min + test_rand(seed) % (16 - sf_min);
+            f->join[sb] = ((f->channel_mode == SBC_MODE_JOINT_STEREO) && (sb < f->subbands - 1u)) ? (test_rand(seed) % 2) : 0;
+        }
+    }
+
+    sbc_bit_allocation(f);
+    for (uint32_t blk = 0; blk < f->blocks; ++blk) {
+        for (uint32_t ch = 0; ch < f->channels; ++ch) {
+            for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+                f->audio_sample[blk][ch][sb] = (f->bits[ch][sb] > 0) ? (test_rand(seed) & ((1U << f->bits[ch][sb]) - 1)) : 0;
+            }
+        }
+    }
+}
+
+/* Whether the shift is possible according to the spec allocation itself, i.e. what the module is expected to find */
+static bool sbc_shift_keeps_allocation(const sbc_frame_t *f, uint8_t steps)
+{
+    sbc_frame_t shifted = *f;
+    for (uint32_t ch = 0; ch < f->channels; ++ch) {
+        for (uint32_t sb = 0; sb < f->subbands; ++sb) {
+            if (f->scale_factor[ch][sb] < steps) {
+                return false;
+            }
+            shifted.scale_factor[ch][sb] -= steps;
+        }
+    }
+    sbc_bit_allocation(&shifted);
+    return memcmp(shifted.bits, f->bits, sizeof(f->bits)) == 0;
+}
+
+static int16_t sbc_to_pcm(double value, double scale)
+{
+    const long rounded = lround(value * scale);
+    return (int16_t)((rounded > 32767) ? 32767 : ((rounded < -32768) ? -32768 : rounded));
+}
+
+static void test_subband_samples_scale_exactly(void)
+{
+    uint32_t seed = 2024;
+    uint32_t applied[2] = {0};
+    uint32_t tried[2] = {0};
+    uint32_t missed = 0;
+
+    for (uint32_t n = 0; n < 20000; ++n) {
+        sbc_frame_t f;
+        sbc_random_frame(&f, &seed);
+        uint8_t frame[SBC_FRAME_SIZE_MAX];
+        const uint32_t size = sbc_pack(&f, frame);
+        const uint8_t steps = 1 + test_rand(&seed) % 6;
+
+        uint8_t attenuated[SBC_FRAME_SIZE_MAX];
+        memcpy(attenuated, frame, sizeof(frame));
+        const bool ok = bt_sbc_volume_apply(attenuated, size, steps);
+        tried[f.allocation_method]++;
+
+        if (!ok) {
+            TEST_CHECK(memcmp(attenuated, frame, size) == 0);
+            /* Declined only when the allocation would change, except loudness frames where it is conservative */
+            if ((f.allocation_method == SBC_ALLOCATION_SNR) && sbc_shift_keeps_allocation(&f, steps)) {
+                missed++;
+            }
+            continue;
+        }
+        applied[f.allocation_method]++;
+
+        sbc_frame_t g;
+        TEST_CHECK(sbc_parse(attenuated, &g)); // CRC updated
+        TEST_CHECK(memcmp(g.bits, f.bits, sizeof(f.bits)) == 0);
+        TEST_CHECK(memcmp(g.audio_sample, f.audio_sample, sizeof(f.audio_sample)) == 0);
+
+        static double before[16][2][8];
+        static double after[16][2][8];
+        sbc_dequantize(&f, before);
+        sbc_dequantize(&g, after);
+        bool exact = true;
+        for (uint32_t blk = 0; blk < f.blocks; ++blk) {
+            for (uint32_t ch = 0; ch < f.channels; ++ch) {
+                for (uint32_t sb = 0; sb < f.subbands; ++sb) {
+                    exact = exact && (after[blk][ch][sb] == ldexp(before[blk][ch][sb], -steps));
+                }
+            }
+        }
+        TEST_CHECK(exact);
+    }
+
+    TEST_CHECK_EQ(missed, 0);
+    TEST_CHECK(applied[SBC_ALLOCATION_SNR] > 0);
+    TEST_CHECK(applied[SBC_ALLOCATION_LOUDNESS] > 0);
+    printf("  subband path taken for %u/%u SNR and %u/%u loudness frames\n", applied[SBC_ALLOCATION_SNR], tried[SBC_ALLOCATION_SNR],
+           applied[SBC_ALLOCATION_LOUDNESS], tried[SBC_ALLOCATION_LOUDNESS]);
+}
+
+static void test_output_matches_pcm_fallback(void)
+{
+    uint32_t seed = 99;
+    uint32_t compared = 0;
+    int32_t max_diff = 0;
+
+    for (uint32_t n = 0; (n < 20000) && (compared < 500); ++n) {
+        sbc_frame_t f;
+        sbc_random_frame(&f, &seed);
+        if (f.channels != 2) {
+            continue;
+        }
+        uint8_t frame[SBC_FRAME_SIZE_MAX];
+        const uint32_t size = sbc_pack(&f, frame);
+        const uint8_t steps = 1 + test_rand(&seed) % 6;
+        if (!bt_sbc_volume_apply(frame, size, steps)) {
+            continue;
+        }
+        compared++;
+
+        sbc_frame_t g;
+        sbc_parse(frame, &g);
+        static double sb_before[16][2][8];
+        static double sb_after[16][2][8];
+        static double pcm_before[128][2];
+        static double pcm_after[128][2];
+        sbc_dequantize(&f, sb_before);
+        sbc_dequantize(&g, sb_after);
+        sbc_synthesize(&f, sb_before, pcm_before);
+        sbc_synthesize(&g, sb_after, pcm_after);
+
+        /* Output level normalized to int16 range as a decoder would produce, same factor for both paths */
+        double peak = 1.0;
+        for (uint32_t i = 0; i < f.blocks * f.subbands; ++i) {
+            peak = fmax(peak, fmax(fabs(pcm_before[i][0]), fabs(pcm_before[i][1])));
+        }
+        const double scale = 32000.0 / peak;
+
+        /* Reference - decoded at full scale, then the PCM fallback gain */
+        int16_t reference[128 * 2];
+        int16_t subband[128 * 2];
+        for (uint32_t i = 0; i < f.blocks * f.subbands; ++i) {
+            reference[2 * i] = sbc_to_pcm(pcm_before[i][0], scale);
+            reference[2 * i + 1] = sbc_to_pcm(pcm_before[i][1], scale);
+            subband[2 * i] = sbc_to_pcm(pcm_after[i][0], scale);
+            subband[2 * i + 1] = sbc_to_pcm(pcm_after[i][1], scale);
+        }
+        audio_dsp_gain_stereo(reference, f.blocks * f.subbands, AUDIO_DSP_GAIN_UNITY >> steps);
+
+        for (uint32_t i = 0; i < 2 * f.blocks * f.subbands; ++i) {
+            const int32_t diff = abs(reference[i] - subband[i]);
+            max_diff = (diff > max_diff) ? diff : max_diff;
+        }
+    }
+
+    /* Only rounding differs - subband path rounds once, PCM path rounds and then truncates the gain product */
+    TEST_CHECK(compared >= 500);
+    TEST_CHECK(max_diff <= 1);
+    printf("  %u frames compared, max difference %d LSB\n", compared, max_diff);
+}
+
+static void test_declines_what_it_cannot_do(void)
+{
+    uint32_t seed = 5;
+    sbc_frame_t f;
+    do {
+        sbc_random_frame(&f, &seed);
+        for (uint32_t ch = 0; ch < f.channels; ++ch) {
+            for (uint32_t sb = 0; sb < f.subbands; ++sb) {
+                f.scale_factor[ch][sb] = 12;
+            }
+        }
+    } while (f.allocation_method != SBC_ALLOCATION_LOUDNESS);
+
+    uint8_t frame[SBC_FRAME_SIZE_MAX];
+    const uint32_t size = sbc_pack(&f, frame);
+    uint8_t copy[SBC_FRAME_SIZE_MAX];
+
+    /* Odd steps would move loudness bit need by half a bit */
+    memcpy(copy, frame, size);
+    TEST_CHECK(!bt_sbc_volume_apply(copy, size, 1));
+    TEST_CHECK(bt_sbc_volume_apply(copy, size, 2));
+
+    /* Corrupted frame stays corrupted */
+    memcpy(copy, frame, size);
+    copy[3] ^= 0x01;
+    TEST_CHECK(!bt_sbc_volume_apply(copy, size, 2));
+
+    /* Too short, beyond 4-bit scale factors, no-op and foreign syncword (mSBC) */
+    memcpy(copy, frame, size);
+    TEST_CHECK(!bt_sbc_volume_apply(copy, 4, 2));
+    TEST_CHECK(!bt_sbc_volume_apply(copy, size, 16));
+    TEST_CHECK(!bt_sbc_volume_apply(copy, size, 0));
+    copy[0] = 0xAD;
+    TEST_CHECK(!bt_sbc_volume_apply(copy, size, 2));
+}
+
+int main(void)
+{
+    TEST_RUN(test_subband_samples_scale_exactly);
+    TEST_RUN(test_output_matches_pcm_fallback);
+    TEST_RUN(test_declines_what_it_cannot_do);
+    return TEST_RESULT();
+}
@@ -0,0 +1,327 @@
+#include "test.h"
+#include <classic/hfp.h>
+#include <sco_pipeline.h>
+#include <string.h>
+
+/* SCO packet streams through the voice pipeline the way hfp.c drives it - 8 ms prefill, 16 ms cap, output
+ * started once primed and pulled 1 ms at a time. BTstack parts are replaced by doubles from tests/btstack
+ * (the real decoder and PLC are not part of this tree): CVSD PLC passes good frames, mSBC frames carry a frame
+ * number that decodes to a ramp. Packets themselves are built byte for byte like the controller delivers them -
+ * 3-byte HCI header with packet status flag, 60-byte payload (16-bit linear CVSD every 3.75 ms, or one H2 framed
+ * and padded mSBC frame every 7.5 ms). Packets are synthetic, not captured. Depths checked here are buffering only,
+ * decode latency would need the real decoder and is not covered. */
+
+#define SCO_PREFILL_MS 8
+#define SCO_MAX_DEPTH_MS 16
+#define SCO_HEADER_SIZE 3
+#define SCO_PAYLOAD_SIZE 60
+#define SCO_CVSD_INTERVAL_US 3750 // HV3 or EV3, 30 samples
+#define SCO_MSBC_INTERVAL_US 7500 // 2-EV3, one mSBC frame
+#define SCO_CVSD_SAMPLES (SCO_PAYLOAD_SIZE / 2)
+#define SCO_MSBC_SAMPLES BTSTACK_SBC_MSBC_SAMPLES
+#define SCO_OUTPUT_SAMPLES_MAX 16000
+
+typedef enum
+{
+    SCO_PACKET_GOOD = 0,
+    SCO_PACKET_LOST = 2, // Packet status flag "no data received"
+} sco_packet_status_t;
+
+typedef struct
+{
+    bt_sco_pipeline_t pipeline;
+    uint32_t time_us;
+    uint32_t next_read_us;
+    bool started;
+    int16_t output[SCO_OUTPUT_SAMPLES_MAX];
+    uint32_t output_count;
+} sco_stream_t;
+
+static sco_stream_t stream;
+
+static void sco_stream_init(uint8_t codec)
+{
+    memset(&stream, 0, sizeof(stream));
+    bt_sco_pipeline_init(&stream.pipeline, codec, SCO_PREFILL_MS, SCO_MAX_DEPTH_MS);
+}
+
+/* Output side runs on its own clock once started, like the DMA pulling from bt_i2s */
+static void sco_stream_advance(uint32_t time_us)
+{
+    const uint32_t samples_per_ms = stream.pipeline.sample_rate / 1000;
+    while (stream.started && (stream.next_read_us <= time_us) && ((stream.output_count + samples_per_ms) <= SCO_OUTPUT_SAMPLES_MAX)) {
+        bt_sco_pipeline_read(&stream.pipeline, &stream.output[stream.output_count], samples_per_ms);
+        stream.output_count += samples_per_ms;
+        stream.next_read_us += 1000;
+    }
+    stream.time_us = time_us;
+}
+
+static void sco_stream_packet(const uint8_t *payload, uint8_t size, sco_packet_status_t status)
+{
+    /* Odd offset on purpose - payload is never halfword aligned on target either */
+    uint8_t storage[1 + SCO_HEADER_SIZE + SCO_PAYLOAD_SIZE];
+    uint8_t *packet = &storage[1];
+    packet[0] = 0x01; // Connection handle, low byte
+    packet[1] = (uint8_t)(status << 4);
+    packet[2] = size;
+    memcpy(&packet[SCO_HEADER_SIZE], payload, size);
+
+    bt_sco_pipeline_packet_received(&stream.pipeline, packet, SCO_HEADER_SIZE + size);
+    if (!stream.started && bt_sco_pipeline_is_primed(&stream.pipeline)) {
+        stream.started = true;
+        stream.next_read_us = stream.time_us;
+    }
+    sco_stream_advance(stream.time_us);
+}
+
+static int16_t sco_cvsd_sample(uint32_t index)
+{
+    return (int16_t)(index * 7 - 20000);
+}
+
+/* 16-bit little endian linear PCM, controller does the CVSD transcoding */
+static void sco_cvsd_payload(uint8_t *payload, uint32_t packet_index)
+{
+    for (uint32_t i = 0; i < SCO_CVSD_SAMPLES; ++i) {
+        const uint16_t sample = (uint16_t)sco_cvsd_sample(packet_index * SCO_CVSD_SAMPLES + i);
+        payload[2 * i] = sample & 0xFF;
+        payload[2 * i + 1] = sample >> 8;
+    }
+}
+
+static void sco_cvsd_packet(uint32_t packet_index, sco_packet_status_t status)
+{
+    uint8_t payload[SCO_PAYLOAD_SIZE];
+    sco_cvsd_payload(payload, packet_index);
+    sco_stream_packet(payload, SCO_PAYLOAD_SIZE, status);
+}
+
+/* H2 header, mSBC frame (syncword, frame number in place of the reserved bytes, dummy data) and one padding byte */
+static void sco_msbc_frame(uint8_t *payload, uint16_t frame_number)
+{
+    static const uint8_t h2_sequence[4] = {0x08, 0x38, 0xC8, 0xF8};
+    memset(payload, 0x5A, SCO_PAYLOAD_SIZE);
+    payload[0] = 0x01;
+    payload[1] = h2_sequence[frame_number % 4];
+    payload[2] = BTSTACK_SBC_MSBC_SYNCWORD;
+    payload[3] = frame_number & 0xFF;
+    payload[4] = frame_number >> 8;
+    payload[SCO_PAYLOAD_SIZE - 1] = 0x00;
+}
+
+static void sco_msbc_packet(uint16_t frame_number, sco_packet_status_t status)
+{
+    uint8_t payload[SCO_PAYLOAD_SIZE];
+    sco_msbc_frame(payload, frame_number);
+    sco_stream_packet(payload, SCO_PAYLOAD_SIZE, status);
+}
+
+/* Offset of the first output sample with given value at or after start, output_count - start if none */
+static uint32_t sco_output_find_from(uint32_t start, int16_t value)
+{
+    for (uint32_t i = start; i < stream.output_count; ++i) {
+        if (stream.output[i] == value) {
+            return i - start;
+        }
+    }
+    return stream.output_count - start;
+}
+
+static void test_cvsd_passes_through_exactly(void)
+{
+    sco_stream_init(HFP_CODEC_CVSD);
+    const uint32_t packets = 400; // 1.5 s
+    for (uint32_t p = 0; p < packets; ++p) {
+        sco_stream_advance(p * SCO_CVSD_INTERVAL_US);
+        sco_cvsd_packet(p, SCO_PACKET_GOOD);
+    }
+
+    const uint32_t start = sco_output_find_from(0, sco_cvsd_sample(0));
+    uint32_t mismatches = 0;
+    for (uint32_t i = start; i < stream.output_count; ++i) {
+        mismatches += (stream.output[i] != sco_cvsd_sample(i - start));
+    }
+    TEST_CHECK_EQ(start, 0);
+    TEST_CHECK(stream.output_count > (packets - 4) * SCO_CVSD_SAMPLES);
+    TEST_CHECK_EQ(mismatches, 0);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 0);
+    TEST_CHECK_EQ(stream.pipeline.dropped_samples, 0);
+    TEST_CHECK_EQ(stream.pipeline.cvsd_plc.good_frames, packets);
+}
+
+static void test_cvsd_prefill_and_cap(void)
+{
+    /* 8 ms at 8 kHz is 64 samples - not reached by the first 30-sample packet, nor the second one */
+    sco_stream_init(HFP_CODEC_CVSD);
+    TEST_CHECK_EQ(stream.pipeline.prefill_samples, 64);
+    TEST_CHECK_EQ(stream.pipeline.max_depth_samples, 128);
+    sco_cvsd_packet(0, SCO_PACKET_GOOD);
+    sco_cvsd_packet(1, SCO_PACKET_GOOD);
+    TEST_CHECK(!bt_sco_pipeline_is_primed(&stream.pipeline));
+    sco_cvsd_packet(2, SCO_PACKET_GOOD);
+    TEST_CHECK(bt_sco_pipeline_is_primed(&stream.pipeline));
+
+    /* Burst after a stall on the air, nothing read in between - depth stays at 16 ms, the oldest samples go */
+    sco_stream_init(HFP_CODEC_CVSD);
+    for (uint32_t p = 0; p < 10; ++p) {
+        bt_sco_pipeline_packet_received(&stream.pipeline, NULL, 0); // Runt packets are ignored
+        uint8_t packet[SCO_HEADER_SIZE + SCO_PAYLOAD_SIZE] = {0x01, 0x00, SCO_PAYLOAD_SIZE};
+        sco_cvsd_payload(&packet[SCO_HEADER_SIZE], p);
+        bt_sco_pipeline_packet_received(&stream.pipeline, packet, sizeof(packet));
+    }
+    TEST_CHECK_EQ(stream.pipeline.max_depth_seen, 128);
+    TEST_CHECK_EQ(stream.pipeline.dropped_samples, 10 * SCO_CVSD_SAMPLES - 128);
+    TEST_CHECK_EQ(bt_sco_pipeline_get_depth_us(&stream.pipeline), 16000);
+
+    int16_t newest[128];
+    bt_sco_pipeline_read(&stream.pipeline, newest, 128);
+    TEST_CHECK_EQ(newest[0], sco_cvsd_sample(10 * SCO_CVSD_SAMPLES - 128));
+    TEST_CHECK_EQ(newest[127], sco_cvsd_sample(10 * SCO_CVSD_SAMPLES - 1));
+    TEST_CHECK_EQ(stream.pipeline.underruns, 0);
+}
+
+static void test_cvsd_lost_packets_go_through_plc(void)
+{
+    sco_stream_init(HFP_CODEC_CVSD);
+    const uint32_t packets = 100;
+    for (uint32_t p = 0; p < packets; ++p) {
+        sco_stream_advance(p * SCO_CVSD_INTERVAL_US);
+        sco_cvsd_packet(p, ((p % 10) == 5) ? SCO_PACKET_LOST : SCO_PACKET_GOOD);
+    }
+    TEST_CHECK_EQ(stream.pipeline.bad_packets, 10);
+    TEST_CHECK_EQ(stream.pipeline.cvsd_plc.bad_frames, 10);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 0);
+
+    /* Lost packet replaced by the concealment in place, timing of everything after it unchanged */
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < (packets - 4) * SCO_CVSD_SAMPLES; ++i) {
+        const uint32_t packet_index = i / SCO_CVSD_SAMPLES;
+        const int16_t expected = ((packet_index % 10) == 5) ? sco_cvsd_sample(i - SCO_CVSD_SAMPLES) : sco_cvsd_sample(i);
+        mismatches += (stream.output[i] != expected);
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+}
+
+static void test_underrun_plays_silence_and_reprimes(void)
+{
+    sco_stream_init(HFP_CODEC_CVSD);
+    uint32_t p = 0;
+    for (; p < 40; ++p) {
+        sco_stream_advance(p * SCO_CVSD_INTERVAL_US);
+        sco_cvsd_packet(p, SCO_PACKET_GOOD);
+    }
+
+    /* 50 ms without packets - output runs dry, plays silence */
+    const uint32_t gap_start = stream.output_count;
+    sco_stream_advance((p + 14) * SCO_CVSD_INTERVAL_US);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 1);
+    TEST_CHECK(!bt_sco_pipeline_is_primed(&stream.pipeline));
+
+    /* Still silent until 8 ms are buffered again, then audio resumes where the packets resume */
+    sco_stream_advance((p + 15) * SCO_CVSD_INTERVAL_US);
+    sco_cvsd_packet(p, SCO_PACKET_GOOD);
+    sco_cvsd_packet(p + 1, SCO_PACKET_GOOD);
+    TEST_CHECK(!bt_sco_pipeline_is_primed(&stream.pipeline));
+    sco_cvsd_packet(p + 2, SCO_PACKET_GOOD);
+    TEST_CHECK(bt_sco_pipeline_is_primed(&stream.pipeline));
+    sco_stream_advance((p + 17) * SCO_CVSD_INTERVAL_US);
+
+    /* No sample of the stream is zero, so the first zero marks the underrun */
+    const uint32_t underrun = gap_start + sco_output_find_from(gap_start, 0);
+    const uint32_t resume = gap_start + sco_output_find_from(gap_start, sco_cvsd_sample(p * SCO_CVSD_SAMPLES));
+    TEST_CHECK_EQ(stream.output[underrun - 1], sco_cvsd_sample(p * SCO_CVSD_SAMPLES - 1));
+    TEST_CHECK(resume < stream.output_count);
+    TEST_CHECK(resume >= underrun + 40 * 8);
+    uint32_t non_silent = 0;
+    for (uint32_t i = underrun; i < resume; ++i) {
+        non_silent += (stream.output[i] != 0);
+    }
+    TEST_CHECK_EQ(non_silent, 0);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 1);
+}
+
+static void test_msbc_frames_split_across_packets(void)
+{
+    /* Controllers with 24-byte SCO packets (USB alternate setting 1) split every frame over 2.5 packets */
+    sco_stream_init(HFP_CODEC_MSBC);
+    TEST_CHECK_EQ(stream.pipeline.prefill_samples, 128);
+    TEST_CHECK_EQ(stream.pipeline.max_depth_samples, 256);
+
+    static uint8_t bytes[120 * SCO_PAYLOAD_SIZE];
+    const uint32_t frames = sizeof(bytes) / SCO_PAYLOAD_SIZE;
+    for (uint32_t f = 0; f < frames; ++f) {
+        sco_msbc_frame(&bytes[f * SCO_PAYLOAD_SIZE], (uint16_t)f);
+    }
+    const uint32_t chunk = 24;
+    for (uint32_t offset = 0; offset < sizeof(bytes); offset += chunk) {
+        sco_stream_advance((offset * SCO_MSBC_INTERVAL_US) / SCO_PAYLOAD_SIZE);
+        sco_stream_packet(&bytes[offset], chunk, SCO_PACKET_GOOD);
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < stream.output_count; ++i) {
+        mismatches += (stream.output[i] != (int16_t)i);
+    }
+    TEST_CHECK_EQ(stream.pipeline.msbc_decoder.good_frames, frames);
+    TEST_CHECK_EQ(stream.pipeline.msbc_decoder.concealed_frames, 0);
+    TEST_CHECK(stream.output_count > (frames - 4) * SCO_MSBC_SAMPLES);
+    TEST_CHECK_EQ(mismatches, 0);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 0);
+}
+
+static void test_msbc_prefill_and_cap(void)
+{
+    /* 8 ms at 16 kHz is 128 samples, just over one 120-sample frame */
+    sco_stream_init(HFP_CODEC_MSBC);
+    sco_msbc_packet(0, SCO_PACKET_GOOD);
+    TEST_CHECK(!bt_sco_pipeline_is_primed(&stream.pipeline));
+    sco_msbc_packet(1, SCO_PACKET_GOOD);
+    TEST_CHECK(bt_sco_pipeline_is_primed(&stream.pipeline));
+
+    sco_stream_init(HFP_CODEC_MSBC);
+    for (uint16_t f = 0; f < 8; ++f) {
+        uint8_t packet[SCO_HEADER_SIZE + SCO_PAYLOAD_SIZE] = {0x01, 0x00, SCO_PAYLOAD_SIZE};
+        sco_msbc_frame(&packet[SCO_HEADER_SIZE], f);
+        bt_sco_pipeline_packet_received(&stream.pipeline, packet, sizeof(packet));
+    }
+    TEST_CHECK_EQ(stream.pipeline.max_depth_seen, 256);
+    TEST_CHECK_EQ(bt_sco_pipeline_get_depth_us(&stream.pipeline), 16000);
+    int16_t oldest;
+    bt_sco_pipeline_read(&stream.pipeline, &oldest, 1);
+    TEST_CHECK_EQ(oldest, (int16_t)(8 * SCO_MSBC_SAMPLES - 256));
+}
+
+static void test_msbc_lost_packets_concealed(void)
+{
+    sco_stream_init(HFP_CODEC_MSBC);
+    const uint32_t frames = 100;
+    for (uint32_t f = 0; f < frames; ++f) {
+        sco_stream_advance(f * SCO_MSBC_INTERVAL_US);
+        sco_msbc_packet((uint16_t)f, ((f % 25) == 10) ? SCO_PACKET_LOST : SCO_PACKET_GOOD);
+    }
+    TEST_CHECK_EQ(stream.pipeline.bad_packets, 4);
+    TEST_CHECK_EQ(stream.pipeline.msbc_decoder.concealed_frames, 4);
+
+    /* Concealed frame takes the place of the lost one, the following frame is back on time */
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i < (frames - 3) * SCO_MSBC_SAMPLES; ++i) {
+        const uint32_t frame = i / SCO_MSBC_SAMPLES;
+        const int16_t expected = ((frame % 25) == 10) ? (int16_t)(i - SCO_MSBC_SAMPLES) : (int16_t)i;
+        mismatches += (stream.output[i] != expected);
+    }
+    TEST_CHECK_EQ(mismatches, 0);
+    TEST_CHECK_EQ(stream.pipeline.underruns, 0);
+}
+
+int main(void)
+{
+    TEST_RUN(test_cvsd_passes_through_exactly);
+    TEST_RUN(test_cvsd_prefill_and_cap);
+    TEST_RUN(test_cvsd_lost_packets_go_through_plc);
+    TEST_RUN(test_underrun_plays_silence_and_reprimes);
+    TEST_RUN(test_msbc_frames_split_across_packets);
+    TEST_RUN(test_msbc_prefill_and_cap);
+    TEST_RUN(test_msbc_lost_packets_concealed);
+    return TEST_RESULT();
+}